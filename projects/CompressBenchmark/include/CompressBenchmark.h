@@ -0,0 +1,117 @@
+﻿#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace CompressBenchmark {
+
+/** 测试数据
+*/
+struct TCorpus
+{
+    //名称，合成数据为生成器名称，目录中的数据为文件名
+    std::string m_name;
+
+    std::vector<uint8_t> m_data;
+};
+
+/** 合成数据的生成器名称: random、text、json、log
+*/
+const std::vector<std::string> &GetGeneratorNames();
+
+/** 生成合成数据，同样的参数每次生成的数据相同
+@param[in] name 生成器名称
+@param[in] nSize 数据大小(字节)
+@param[out] corpus 生成的数据
+@return 名称无效时返回false
+*/
+bool GenerateCorpus(const std::string &name, size_t nSize, TCorpus &corpus);
+
+/** 读取目录(包括子目录)中的所有文件，每个文件一份数据，空文件及超过4G的文件跳过
+@return 目录无效时返回false
+*/
+bool LoadCorpusDir(const std::string &dir, std::vector<TCorpus> &corpora);
+
+/** 支持的编码名称: store、zlib、gzip、brotli
+*/
+const std::vector<std::string> &GetCodecNames();
+
+//压缩、解压使用的接口
+enum class TBenchmarkApi
+{
+    VECTOR, //输出到std::vector的重载，每次调用重新分配
+    BUFFER, //输出到外部缓冲区的重载，缓冲区预先按compress_bound分配并复用
+};
+
+/** 单次测试的参数
+*/
+struct TBenchmarkCase
+{
+    //编码名称，见 GetCodecNames
+    std::string m_codec;
+
+    //压缩级别，zlib、gzip为0~9，brotli为0~11
+    int m_nLevel = 6;
+
+    TBenchmarkApi m_api = TBenchmarkApi::VECTOR;
+
+    //每项操作至少重复执行的时间(秒)，至少执行一次
+    double m_minSeconds = 0.5;
+};
+
+/** 单次测试的结果
+*/
+struct TBenchmarkResult
+{
+    TBenchmarkCase m_case;
+
+    //数据名称及大小
+    std::string m_corpus;
+    size_t m_nInputSize = 0;
+
+    //压缩后大小
+    size_t m_nOutputSize = 0;
+
+    //原大小/压缩后大小
+    double m_ratio = 0;
+
+    //按原数据大小计算的速度(MB/s)
+    double m_compressMBps = 0;
+    double m_decompressMBps = 0;
+
+    //测试期间进程内存的峰值及测试开始时的内存(字节)。
+    //linux下每次测试前重置峰值；windows下峰值无法重置，是进程启动以来的峰值
+    uint64_t m_nPeakRss = 0;
+    uint64_t m_nBaseRss = 0;
+};
+
+/** 执行一次测试，解压结果与原数据不同时失败
+@param[in] param 测试参数
+@param[in] corpus 测试数据
+@param[out] result 测试结果
+@param[out] error 失败原因
+@return 是否成功
+*/
+bool RunBenchmark(const TBenchmarkCase &param,
+                  const TCorpus &corpus,
+                  TBenchmarkResult &result,
+                  std::string &error);
+
+/** 往返检查: 在2的整数次幂及前后相邻的大小上，用每种编码、两种接口及流式解压
+压缩后再解压，结果必须与原数据相同。高压缩率的数据解压时正好写满按倍数扩展的输出缓冲区
+@param[out] error 失败原因
+@return 是否全部通过
+*/
+bool RunRoundTripCheck(std::string &error);
+
+/** 输出一行便于阅读的结果
+*/
+void WriteTableHeader(std::ostream &os);
+void WriteTableRow(std::ostream &os, const TBenchmarkResult &result);
+
+/** 以JSON数组的形式输出全部结果
+*/
+void WriteJson(std::ostream &os, const std::vector<TBenchmarkResult> &results);
+
+} // namespace CompressBenchmark
@@ -0,0 +1,343 @@
+﻿#include "CompressBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include "Memory/compress_utility.h"
+
+#ifdef _WIN32
+#    include <Windows.h>
+#    include <Psapi.h>
+#    pragma comment(lib, "Psapi.lib")
+#endif
+
+namespace CompressBenchmark {
+
+namespace {
+
+using TClock = std::chrono::steady_clock;
+
+//重置进程内存的峰值，linux 4.0以上支持
+void ResetPeakRss()
+{
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+//当前内存及峰值(字节)
+void GetRss(uint64_t &nCurrent, uint64_t &nPeak)
+{
+    nCurrent = 0;
+    nPeak = 0;
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) {
+        nCurrent = counters.WorkingSetSize;
+        nPeak = counters.PeakWorkingSetSize;
+    }
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            nCurrent = std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        } else if (line.compare(0, 6, "VmHWM:") == 0) {
+            nPeak = std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+#endif
+}
+
+bool GetCodec(const std::string &name, shr::TCompressCodec &codec, int &nMaxLevel)
+{
+    if (name == "store") {
+        codec = shr::TCompressCodec::STORE;
+        nMaxLevel = 0;
+    } else if (name == "zlib") {
+        codec = shr::TCompressCodec::ZLIB;
+        nMaxLevel = 9;
+    } else if (name == "gzip") {
+        codec = shr::TCompressCodec::GZIP;
+        nMaxLevel = 9;
+    } else if (name == "brotli") {
+        codec = shr::TCompressCodec::BROTLI;
+        nMaxLevel = 11;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/** 重复执行fn，直到总时间不少于minSeconds
+@return 平均每次的秒数，fn失败时返回负数
+*/
+template<class TFunc>
+double MeasureSeconds(double minSeconds, TFunc &&fn)
+{
+    size_t nRounds = 0;
+    TClock::time_point startTime = TClock::now();
+    double seconds = 0;
+    do {
+        if (!fn()) {
+            return -1;
+        }
+        ++nRounds;
+        seconds = std::chrono::duration<double>(TClock::now() - startTime).count();
+    } while (seconds < minSeconds);
+    return seconds / nRounds;
+}
+
+double ToMBps(size_t nBytes, double seconds)
+{
+    return seconds > 0 ? nBytes / seconds / (1024 * 1024) : 0;
+}
+
+} // namespace
+
+const std::vector<std::string> &GetCodecNames()
+{
+    static const std::vector<std::string> s_names{"store", "zlib", "gzip", "brotli"};
+    return s_names;
+}
+
+bool RunBenchmark(const TBenchmarkCase &param,
+                  const TCorpus &corpus,
+                  TBenchmarkResult &result,
+                  std::string &error)
+{
+    shr::TCompressCodec codec;
+    int nMaxLevel = 0;
+    if (!GetCodec(param.m_codec, codec, nMaxLevel)) {
+        error = "unknown codec " + param.m_codec;
+        return false;
+    }
+    if (param.m_nLevel < 0 || param.m_nLevel > nMaxLevel) {
+        error = "invalid level " + std::to_string(param.m_nLevel) + " for " + param.m_codec;
+        return false;
+    }
+    if (corpus.m_data.empty() || corpus.m_data.size() > UINT32_MAX) {
+        error = "invalid corpus size";
+        return false;
+    }
+
+    result = TBenchmarkResult{};
+    result.m_case = param;
+    result.m_corpus = corpus.m_name;
+    result.m_nInputSize = corpus.m_data.size();
+    ResetPeakRss();
+    uint64_t nPeakRss = 0;
+    GetRss(result.m_nBaseRss, nPeakRss);
+
+    const uint8_t *pInput = corpus.m_data.data();
+    const uint32_t nInput = (uint32_t)corpus.m_data.size();
+    const int nLevel = param.m_nLevel;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> decompressed;
+    double compressSeconds = -1;
+    double decompressSeconds = -1;
+    if (param.m_api == TBenchmarkApi::VECTOR) {
+        //每次都用新的vector，分配及缺页的开销计入结果
+        auto compressOnce = [&]() {
+            std::vector<uint8_t> output;
+            bool bResult = shr::compress_data(pInput, nInput, output, codec, nLevel);
+            compressed.swap(output);
+            return bResult;
+        };
+        auto decompressOnce = [&]() {
+            std::vector<uint8_t> output;
+            bool bResult = shr::decompress_data(
+                compressed.data(), (uint32_t)compressed.size(), output);
+            decompressed.swap(output);
+            return bResult;
+        };
+        if (compressOnce()) {
+            compressSeconds = MeasureSeconds(param.m_minSeconds, compressOnce);
+        }
+        if (compressSeconds > 0 && decompressOnce()) {
+            decompressSeconds = MeasureSeconds(param.m_minSeconds, decompressOnce);
+        }
+    } else {
+        //缓冲区分配一次，第一次调用时完成缺页，之后复用
+        uint32_t nBound = shr::compress_bound(nInput, codec);
+        compressed.resize(nBound);
+        decompressed.resize(nInput);
+        uint32_t nCompressed = 0;
+        auto compressOnce = [&]() {
+            nCompressed = nBound;
+            return shr::compress_data(
+                pInput, nInput, compressed.data(), nCompressed, codec, nLevel);
+        };
+        auto decompressOnce = [&]() {
+            uint32_t nOutLength = nInput;
+            return shr::decompress_data(
+                       compressed.data(), nCompressed, decompressed.data(), nOutLength) &&
+                   nOutLength == nInput;
+        };
+        if (nBound != 0 && compressOnce()) {
+            compressSeconds = MeasureSeconds(param.m_minSeconds, compressOnce);
+        }
+        if (compressSeconds > 0 && decompressOnce()) {
+            decompressSeconds = MeasureSeconds(param.m_minSeconds, decompressOnce);
+        }
+        compressed.resize(nCompressed);
+    }
+
+    if (compressSeconds <= 0) {
+        error = "compress failed";
+        return false;
+    }
+    if (decompressSeconds <= 0) {
+        error = "decompress failed";
+        return false;
+    }
+    if (decompressed.size() != corpus.m_data.size() ||
+        std::memcmp(decompressed.data(), pInput, nInput) != 0) {
+        error = "decompressed data mismatch";
+        return false;
+    }
+    uint64_t nCurrentRss = 0;
+    GetRss(nCurrentRss, result.m_nPeakRss);
+    result.m_nOutputSize = compressed.size();
+    result.m_ratio = (double)nInput / compressed.size();
+    result.m_compressMBps = ToMBps(nInput, compressSeconds);
+    result.m_decompressMBps = ToMBps(nInput, decompressSeconds);
+    return true;
+}
+
+bool RunRoundTripCheck(std::string &error)
+{
+    TCorpus text;
+    GenerateCorpus("text", (size_t)1 << 21, text);
+    for (size_t nShift = 0; nShift <= 20; ++nShift) {
+        const size_t nPower = (size_t)1 << nShift;
+        for (size_t nSize : {nPower - 1, nPower, nPower + 1}) {
+            if (nSize == 0) {
+                continue;
+            }
+            //全部相同的字节压缩率最高，解压时输出缓冲区按倍数扩展，正好写满
+            std::vector<uint8_t> same(nSize, 'a');
+            std::vector<uint8_t> prose(text.m_data.begin(), text.m_data.begin() + nSize);
+            for (const std::vector<uint8_t> *pInput : {&same, &prose}) {
+                std::string name = (pInput == &same ? "same " : "text ") + std::to_string(nSize);
+                for (auto &codecName : GetCodecNames()) {
+                    shr::TCompressCodec codec = shr::TCompressCodec::STORE;
+                    int nMaxLevel = 0;
+                    GetCodec(codecName, codec, nMaxLevel);
+                    std::vector<uint8_t> compressed;
+                    std::vector<uint8_t> decompressed;
+                    if (!shr::compress_data(
+                            pInput->data(), (uint32_t)nSize, compressed, codec, nMaxLevel / 2) ||
+                        !shr::decompress_data(
+                            compressed.data(), (uint32_t)compressed.size(), decompressed) ||
+                        decompressed != *pInput) {
+                        error = name + " " + codecName + " vector round trip failed";
+                        return false;
+                    }
+                    //外部缓冲区的接口要求缓冲区大于6字节
+                    decompressed.assign((std::max)(nSize, (size_t)7), 0);
+                    uint32_t nOutLength = (uint32_t)decompressed.size();
+                    if (!shr::decompress_data(compressed.data(),
+                                              (uint32_t)compressed.size(),
+                                              decompressed.data(),
+                                              nOutLength) ||
+                        nOutLength != nSize ||
+                        std::memcmp(decompressed.data(), pInput->data(), nSize) != 0) {
+                        error = name + " " + codecName + " buffer round trip failed";
+                        return false;
+                    }
+                }
+
+                //流式解压，每次输入一小段
+                shr::Compressor compressor(shr::TCompressFormat::GZIP);
+                std::vector<uint8_t> compressed;
+                shr::Decompressor decompressor;
+                std::vector<uint8_t> decompressed;
+                bool bResult = compressor.Compress(pInput->data(), nSize, compressed);
+                for (size_t nPos = 0; bResult && nPos < compressed.size(); nPos += 4096) {
+                    size_t nChunk = (std::min)((size_t)4096, compressed.size() - nPos);
+                    bResult = decompressor.Push(compressed.data() + nPos, nChunk, decompressed);
+                }
+                if (!bResult || !decompressor.IsFinished() || decompressed != *pInput) {
+                    error = name + " stream round trip failed";
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void WriteTableHeader(std::ostream &os)
+{
+    os << std::left << std::setw(20) << "corpus" << std::right << std::setw(12) << "size"
+       << std::setw(8) << "codec" << std::setw(6) << "level" << std::setw(7) << "api"
+       << std::setw(8) << "ratio" << std::setw(12) << "comp(MB/s)" << std::setw(14)
+       << "decomp(MB/s)" << std::setw(10) << "peak(MB)" << std::setw(10) << "+rss(MB)"
+       << '\n';
+}
+
+void WriteTableRow(std::ostream &os, const TBenchmarkResult &result)
+{
+    const TBenchmarkCase &param = result.m_case;
+    const double MB = 1024.0 * 1024.0;
+    std::string corpus = result.m_corpus;
+    if (corpus.size() > 19) {
+        corpus = "..." + corpus.substr(corpus.size() - 16);
+    }
+    os << std::left << std::setw(20) << corpus << std::right << std::setw(12)
+       << result.m_nInputSize << std::setw(8) << param.m_codec << std::setw(6)
+       << param.m_nLevel << std::setw(7)
+       << (param.m_api == TBenchmarkApi::VECTOR ? "vector" : "buffer") << std::fixed
+       << std::setprecision(2) << std::setw(8) << result.m_ratio << std::setprecision(1)
+       << std::setw(12) << result.m_compressMBps << std::setw(14) << result.m_decompressMBps
+       << std::setw(10) << result.m_nPeakRss / MB << std::setw(10)
+       << (result.m_nPeakRss > result.m_nBaseRss ? result.m_nPeakRss - result.m_nBaseRss : 0) /
+              MB
+       << '\n';
+}
+
+void WriteJson(std::ostream &os, const std::vector<TBenchmarkResult> &results)
+{
+    //每个结果一行，字符串由rapidjson转义，文件名中的引号、反斜杠不会破坏格式
+    os << "[\n";
+    rapidjson::StringBuffer buffer;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const TBenchmarkResult &result = results[i];
+        const TBenchmarkCase &param = result.m_case;
+        buffer.Clear();
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        writer.SetMaxDecimalPlaces(4);
+        writer.StartObject();
+        writer.Key("corpus");
+        writer.String(result.m_corpus.c_str(), (rapidjson::SizeType)result.m_corpus.size());
+        writer.Key("input_size");
+        writer.Uint64(result.m_nInputSize);
+        writer.Key("codec");
+        writer.String(param.m_codec.c_str(), (rapidjson::SizeType)param.m_codec.size());
+        writer.Key("level");
+        writer.Int(param.m_nLevel);
+        writer.Key("api");
+        writer.String(param.m_api == TBenchmarkApi::VECTOR ? "vector" : "buffer");
+        writer.Key("output_size");
+        writer.Uint64(result.m_nOutputSize);
+        writer.Key("ratio");
+        writer.Double(result.m_ratio);
+        writer.Key("compress_mbps");
+        writer.Double(result.m_compressMBps);
+        writer.Key("decompress_mbps");
+        writer.Double(result.m_decompressMBps);
+        writer.Key("peak_rss");
+        writer.Uint64(result.m_nPeakRss);
+        writer.Key("base_rss");
+        writer.Uint64(result.m_nBaseRss);
+        writer.EndObject();
+        os << "  " << buffer.GetString() << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
+
+} // namespace CompressBenchmark
@@ -0,0 +1,177 @@
+﻿#include "CompressBenchmark.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <boost/filesystem.hpp>
+
+namespace CompressBenchmark {
+
+namespace {
+
+//词频近似Zipf分布的单词表
+const char *const WORDS[] = {
+    "the",     "of",       "and",      "to",        "in",       "is",      "that",
+    "for",     "it",       "as",       "was",       "with",     "be",      "by",
+    "on",      "not",      "this",     "are",       "from",     "at",      "or",
+    "which",   "an",       "have",     "data",      "buffer",   "thread",  "queue",
+    "server",  "client",   "request",  "response",  "memory",   "file",    "window",
+    "message", "compress", "pipeline", "benchmark", "latency",  "network", "process",
+    "system",  "during",   "between",  "although",  "whenever", "result",  "configuration",
+};
+
+std::string MakeWord(std::mt19937 &rng)
+{
+    //平方分布，靠前的单词出现得多
+    const size_t nCount = sizeof(WORDS) / sizeof(WORDS[0]);
+    double value = std::uniform_real_distribution<double>(0, 1)(rng);
+    return WORDS[(size_t)(value * value * nCount)];
+}
+
+void GenerateRandom(std::mt19937 &rng, size_t nSize, std::vector<uint8_t> &data)
+{
+    data.resize(nSize);
+    for (auto &byte : data) {
+        byte = (uint8_t)rng();
+    }
+}
+
+void GenerateText(std::mt19937 &rng, size_t nSize, std::string &text)
+{
+    std::uniform_int_distribution<int> sentenceLength(6, 24);
+    std::uniform_int_distribution<int> paragraphLength(3, 8);
+    while (text.size() < nSize) {
+        for (int nSentences = paragraphLength(rng); nSentences > 0; --nSentences) {
+            std::string sentence;
+            for (int nWords = sentenceLength(rng); nWords > 0; --nWords) {
+                if (!sentence.empty()) {
+                    sentence += (rng() % 12 == 0) ? ", " : " ";
+                }
+                sentence += MakeWord(rng);
+            }
+            sentence[0] = (char)std::toupper((unsigned char)sentence[0]);
+            text += sentence;
+            text += ". ";
+        }
+        text += '\n';
+    }
+}
+
+void GenerateJson(std::mt19937 &rng, size_t nSize, std::string &text)
+{
+    char buffer[512];
+    text += "[\n";
+    for (unsigned int nId = 1; text.size() < nSize; ++nId) {
+        std::string name = MakeWord(rng) + "_" + MakeWord(rng);
+        int nLength = std::snprintf(buffer,
+                                    sizeof(buffer),
+                                    "  {\"id\": %u, \"name\": \"%s\", "
+                                    "\"email\": \"%s%u@example.com\", \"score\": %.3f, "
+                                    "\"active\": %s, \"tags\": [\"%s\", \"%s\"]},\n",
+                                    nId,
+                                    name.c_str(),
+                                    MakeWord(rng).c_str(),
+                                    (unsigned int)(rng() % 10000),
+                                    std::uniform_real_distribution<double>(0, 100)(rng),
+                                    (rng() % 2) ? "true" : "false",
+                                    MakeWord(rng).c_str(),
+                                    MakeWord(rng).c_str());
+        text.append(buffer, nLength);
+    }
+    text += "  {}\n]\n";
+}
+
+void GenerateLog(std::mt19937 &rng, size_t nSize, std::string &text)
+{
+    static const char *const LEVELS[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+    static const char *const MODULES[] = {"net", "db", "cache", "http", "scheduler", "storage"};
+    char buffer[512];
+    uint64_t nMs = 0;
+    while (text.size() < nSize) {
+        nMs += rng() % 50;
+        int nLength = std::snprintf(buffer,
+                                    sizeof(buffer),
+                                    "2026-10-18 %02u:%02u:%02u.%03u [%s] [%5u] %s: %s %s %s "
+                                    "id=%u cost=%ums\n",
+                                    (unsigned int)(nMs / 3600000 % 24),
+                                    (unsigned int)(nMs / 60000 % 60),
+                                    (unsigned int)(nMs / 1000 % 60),
+                                    (unsigned int)(nMs % 1000),
+                                    LEVELS[rng() % 6],
+                                    (unsigned int)(1000 + rng() % 16),
+                                    MODULES[rng() % 6],
+                                    MakeWord(rng).c_str(),
+                                    MakeWord(rng).c_str(),
+                                    MakeWord(rng).c_str(),
+                                    (unsigned int)(rng() % 1000000),
+                                    (unsigned int)(rng() % 200));
+        text.append(buffer, nLength);
+    }
+}
+
+} // namespace
+
+const std::vector<std::string> &GetGeneratorNames()
+{
+    static const std::vector<std::string> s_names{"random", "text", "json", "log"};
+    return s_names;
+}
+
+bool GenerateCorpus(const std::string &name, size_t nSize, TCorpus &corpus)
+{
+    std::mt19937 rng(20261018);
+    corpus.m_name = name;
+    corpus.m_data.clear();
+    if (name == "random") {
+        GenerateRandom(rng, nSize, corpus.m_data);
+        return true;
+    }
+
+    std::string text;
+    text.reserve(nSize + 512);
+    if (name == "text") {
+        GenerateText(rng, nSize, text);
+    } else if (name == "json") {
+        GenerateJson(rng, nSize, text);
+    } else if (name == "log") {
+        GenerateLog(rng, nSize, text);
+    } else {
+        return false;
+    }
+    text.resize(nSize);
+    corpus.m_data.assign(text.begin(), text.end());
+    return true;
+}
+
+bool LoadCorpusDir(const std::string &dir, std::vector<TCorpus> &corpora)
+{
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    if (!fs::is_directory(dir, ec)) {
+        return false;
+    }
+    std::vector<fs::path> files;
+    for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (fs::is_regular_file(it->status())) {
+            files.push_back(it->path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (auto &file : files) {
+        uint64_t nSize = fs::file_size(file, ec);
+        if (ec || nSize == 0 || nSize > UINT32_MAX) {
+            continue;
+        }
+        std::ifstream stream(file.string(), std::ios::binary);
+        TCorpus corpus;
+        corpus.m_name = fs::relative(file, dir, ec).generic_string();
+        corpus.m_data.resize((size_t)nSize);
+        if (stream.read((char *)corpus.m_data.data(), (std::streamsize)nSize)) {
+            corpora.push_back(std::move(corpus));
+        }
+    }
+    return true;
+}
+
+} // namespace CompressBenchmark
@@ -0,0 +1,213 @@
+﻿#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "CompressBenchmark.h"
+
+/* compress_utility 性能测试，输出每种编码、级别、接口的压缩率、压缩/解压速度及内存峰值
+参数组合成矩阵依次执行，列表参数用逗号分隔，级别可以写成范围如 0-9:
+  --corpus        测试数据目录，目录(包括子目录)中每个文件单独测试，多个目录用逗号分隔
+  --synthetic     合成数据 random,text,json,log，none表示不使用
+  --size          每份合成数据的大小，可以带K、M后缀，默认8M
+  --codecs        store,zlib,gzip,brotli
+  --levels        zlib、gzip的级别，默认0-9
+  --brotli-levels brotli的级别，默认0-11
+  --apis          vector,buffer: 输出到std::vector的重载和外部缓冲区的重载，两者的差别即分配的开销
+  --time          每项操作至少重复的秒数，默认0.5
+  --json          结果以JSON格式写入文件，"-"表示标准输出(此时表格输出到标准错误)
+测试前先在2的整数次幂附近的大小上检查各种编码的往返结果，失败时退出
+示例，日志文本上zlib与brotli常用级别的对比:
+  CompressBenchmark --synthetic log --codecs zlib,brotli --levels 1,6,9 --brotli-levels 1,5,9
+*/
+
+using namespace CompressBenchmark;
+
+namespace {
+
+std::vector<std::string> SplitList(const std::string &value)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+//级别列表，支持 a-b 的范围
+std::vector<int> SplitLevels(const std::string &value)
+{
+    std::vector<int> levels;
+    for (auto &item : SplitList(value)) {
+        int nFirst = std::atoi(item.c_str());
+        int nLast = nFirst;
+        auto pos = item.find('-', 1);
+        if (pos != std::string::npos) {
+            nLast = std::atoi(item.c_str() + pos + 1);
+        }
+        for (int nLevel = nFirst; nLevel <= nLast; ++nLevel) {
+            levels.push_back(nLevel);
+        }
+    }
+    return levels;
+}
+
+size_t ParseSize(const std::string &value)
+{
+    char *pEnd = nullptr;
+    size_t nSize = std::strtoull(value.c_str(), &pEnd, 10);
+    switch (*pEnd) {
+    case 'k':
+    case 'K':
+        return nSize * 1024;
+    case 'm':
+    case 'M':
+        return nSize * 1024 * 1024;
+    case 'g':
+    case 'G':
+        return nSize * 1024 * 1024 * 1024;
+    default:
+        return nSize;
+    }
+}
+
+void PrintUsage()
+{
+    std::cerr << "usage: CompressBenchmark [--corpus dir,...] [--synthetic g1,g2|none]\n"
+                 "                         [--size N[K|M]] [--codecs c1,c2] [--levels 0-9]\n"
+                 "                         [--brotli-levels 0-11] [--apis vector,buffer]\n"
+                 "                         [--time sec] [--json file|-]\n"
+                 "codecs:";
+    for (auto &item : GetCodecNames()) {
+        std::cerr << ' ' << item;
+    }
+    std::cerr << "\nsynthetic:";
+    for (auto &item : GetGeneratorNames()) {
+        std::cerr << ' ' << item;
+    }
+    std::cerr << '\n';
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> corpusDirs;
+    std::vector<std::string> generators = GetGeneratorNames();
+    size_t nSyntheticSize = 8 * 1024 * 1024;
+    std::vector<std::string> codecs = GetCodecNames();
+    std::vector<int> levels = SplitLevels("0-9");
+    std::vector<int> brotliLevels = SplitLevels("0-11");
+    std::vector<TBenchmarkApi> apis{TBenchmarkApi::VECTOR, TBenchmarkApi::BUFFER};
+    double minSeconds = 0.5;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 1;
+        }
+        std::string name = argv[i];
+        std::string value = argv[++i];
+        if (name == "--corpus") {
+            corpusDirs = SplitList(value);
+        } else if (name == "--synthetic") {
+            generators = (value == "none" ? std::vector<std::string>{} : SplitList(value));
+        } else if (name == "--size") {
+            nSyntheticSize = ParseSize(value);
+        } else if (name == "--codecs") {
+            codecs = SplitList(value);
+        } else if (name == "--levels") {
+            levels = SplitLevels(value);
+        } else if (name == "--brotli-levels") {
+            brotliLevels = SplitLevels(value);
+        } else if (name == "--apis") {
+            apis.clear();
+            for (auto &item : SplitList(value)) {
+                if (item == "vector") {
+                    apis.push_back(TBenchmarkApi::VECTOR);
+                } else if (item == "buffer") {
+                    apis.push_back(TBenchmarkApi::BUFFER);
+                } else {
+                    PrintUsage();
+                    return 1;
+                }
+            }
+        } else if (name == "--time") {
+            minSeconds = std::atof(value.c_str());
+        } else if (name == "--json") {
+            jsonPath = value;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::vector<TCorpus> corpora;
+    for (auto &generator : generators) {
+        TCorpus corpus;
+        if (nSyntheticSize == 0 || !GenerateCorpus(generator, nSyntheticSize, corpus)) {
+            std::cerr << "invalid synthetic corpus: " << generator << '\n';
+            return 1;
+        }
+        corpora.push_back(std::move(corpus));
+    }
+    for (auto &dir : corpusDirs) {
+        if (!LoadCorpusDir(dir, corpora)) {
+            std::cerr << "can not read corpus dir " << dir << '\n';
+            return 1;
+        }
+    }
+
+    std::string checkError;
+    if (!RunRoundTripCheck(checkError)) {
+        std::cerr << "round trip check: " << checkError << '\n';
+        return 1;
+    }
+
+    std::ostream &table = (jsonPath == "-" ? std::cerr : std::cout);
+    WriteTableHeader(table);
+    std::vector<TBenchmarkResult> results;
+    for (auto &corpus : corpora) {
+        for (auto &codec : codecs) {
+            const std::vector<int> &codecLevels =
+                (codec == "store" ? std::vector<int>{0}
+                                  : (codec == "brotli" ? brotliLevels : levels));
+            for (auto nLevel : codecLevels) {
+                for (auto api : apis) {
+                    TBenchmarkCase param;
+                    param.m_codec = codec;
+                    param.m_nLevel = nLevel;
+                    param.m_api = api;
+                    param.m_minSeconds = minSeconds;
+                    TBenchmarkResult result;
+                    std::string error;
+                    if (!RunBenchmark(param, corpus, result, error)) {
+                        std::cerr << corpus.m_name << ' ' << codec << ' ' << nLevel << ": "
+                                  << error << '\n';
+                        return 1;
+                    }
+                    WriteTableRow(table, result);
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if (jsonPath == "-") {
+        WriteJson(std::cout, results);
+    } else if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath);
+        if (!file) {
+            std::cerr << "can not open " << jsonPath << '\n';
+            return 1;
+        }
+        WriteJson(file, results);
+    }
+    return 0;
+}
@@ -0,0 +1,391 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "IOCP/IOCPThreadPool.h"
+
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+/* IOCPThreadPool 的吞吐量测试: AsyncCall 的投递、调用速度，及多个读请求同时进行时的文件读取速度。
+windows下测试IOCP的实现，linux下分别测试io_uring和epoll的实现，读文件的部分同一个文件读多轮，
+第一轮之后数据在系统缓存中，主要是异步IO的调度开销
+  --backend     linux下的实现: all、uring、epoll
+  --threads     线程池的最大线程数，0表示CPU核数*2
+  --calls       AsyncCall 的总次数
+  --producers   投递 AsyncCall 的线程数
+  --file-size   测试文件的大小(MB)
+  --rounds      读文件的轮数
+  --block       每次读取的大小(KB)
+  --depth       同时进行的读请求个数
+示例:
+  IOCPBenchmark --calls 1000000 --file-size 64 --block 4 --depth 64
+*/
+
+using namespace shr;
+
+namespace {
+
+struct TOptions
+{
+    std::string m_strBackend = "all";
+    DWORD m_dwThreads = 0;
+    size_t m_nCalls = 1000000;
+    size_t m_nProducers = 2;
+    size_t m_nFileMB = 64;
+    size_t m_nRounds = 4;
+    size_t m_nBlockKB = 16;
+    size_t m_nDepth = 32;
+};
+
+#ifdef _WIN32
+using TDevice = HANDLE;
+const TDevice INVALID_DEVICE = INVALID_HANDLE_VALUE;
+#else
+using TDevice = int;
+const TDevice INVALID_DEVICE = -1;
+#endif
+
+//等待所有回调完成
+class TDoneEvent
+{
+public:
+    void Set()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bDone = true;
+        m_done.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [this]() { return m_bDone; });
+    }
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_done;
+    bool m_bDone = false;
+};
+
+//----------------------------------------------------------------------
+
+struct TCallBench
+{
+    std::atomic<size_t> m_nLeft{0};
+    TDoneEvent m_done;
+};
+
+void OnAsyncCall(DWORD /*dwErrno*/, DWORD /*dwNumberOfBytesTransferred*/, void *pVoid)
+{
+    TCallBench *pBench = (TCallBench *)pVoid;
+    if (--pBench->m_nLeft == 0) {
+        pBench->m_done.Set();
+    }
+}
+
+//AsyncCall 每秒调用的次数
+double RunAsyncCall(IOCPThreadPool &pool, const TOptions &options)
+{
+    TCallBench bench;
+    bench.m_nLeft = options.m_nCalls;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < options.m_nProducers; ++i) {
+        size_t nCount = options.m_nCalls / options.m_nProducers +
+                        (i < options.m_nCalls % options.m_nProducers ? 1 : 0);
+        producers.emplace_back([&pool, &bench, nCount]() {
+            for (size_t n = 0; n < nCount; ++n) {
+                while (!pool.AsyncCall(OnAsyncCall, 0, &bench)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    bench.m_done.Wait();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return (double)options.m_nCalls / std::chrono::duration<double>(elapsed).count();
+}
+
+//----------------------------------------------------------------------
+
+struct TReadBench;
+
+//一个读请求，OVERLAPPED放在开头，回调中转换回来
+struct TReadOp
+{
+    OVERLAPPED m_overlapped;
+    TReadBench *m_pBench;
+    std::vector<char> m_buffer;
+};
+
+struct TReadBench
+{
+    IOCPThreadPool *m_pPool = nullptr;
+    TDevice m_device = INVALID_DEVICE;
+    uint64_t m_nFileSize = 0;
+    uint64_t m_nTotalBytes = 0; //所有轮次要读取的字节数
+    std::atomic<uint64_t> m_nNextOffset{0};
+    std::atomic<uint64_t> m_nReadBytes{0};
+    std::atomic<uint64_t> m_nReads{0};
+    std::atomic<size_t> m_nInflight{0};
+    std::atomic<bool> m_bFailed{false};
+    TDoneEvent m_done;
+};
+
+//提交读请求，所有轮次读完时返回false
+bool SubmitRead(TReadOp *pOp)
+{
+    TReadBench *pBench = pOp->m_pBench;
+    uint64_t nOffset = pBench->m_nNextOffset.fetch_add(pOp->m_buffer.size());
+    if (nOffset >= pBench->m_nTotalBytes) {
+        return false;
+    }
+    nOffset %= pBench->m_nFileSize;
+    std::memset(&pOp->m_overlapped, 0, sizeof(pOp->m_overlapped));
+    pOp->m_overlapped.Offset = (DWORD)nOffset;
+    pOp->m_overlapped.OffsetHigh = (DWORD)(nOffset >> 32);
+    DWORD dwBytes = (DWORD)pOp->m_buffer.size();
+#ifdef _WIN32
+    if (!::ReadFile(pBench->m_device, pOp->m_buffer.data(), dwBytes, nullptr, &pOp->m_overlapped) &&
+        ::GetLastError() != ERROR_IO_PENDING) {
+        pBench->m_bFailed = true;
+        return false;
+    }
+#else
+    if (!pBench->m_pPool->AsyncRead(
+            pBench->m_device, pOp->m_buffer.data(), dwBytes, &pOp->m_overlapped)) {
+        pBench->m_bFailed = true;
+        return false;
+    }
+#endif
+    return true;
+}
+
+void OnReadCompleted(DWORD dwErrno, DWORD dwNumberOfBytesTransferred, LPOVERLAPPED pOverlapped)
+{
+    TReadOp *pOp = (TReadOp *)pOverlapped;
+    TReadBench *pBench = pOp->m_pBench;
+    if (dwErrno != ERROR_SUCCESS) {
+        pBench->m_bFailed = true;
+    } else {
+        pBench->m_nReadBytes += dwNumberOfBytesTransferred;
+        ++pBench->m_nReads;
+    }
+    //每个请求完成后立即提交下一个，保持同时进行的请求个数
+    if ((pBench->m_bFailed || !SubmitRead(pOp)) && --pBench->m_nInflight == 0) {
+        pBench->m_done.Set();
+    }
+}
+
+bool CreateTestFile(const std::string &strPath, uint64_t nSize)
+{
+    std::FILE *pFile = std::fopen(strPath.c_str(), "wb");
+    if (!pFile) {
+        return false;
+    }
+    std::vector<char> block(1024 * 1024);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = (char)(i * 131 + 7);
+    }
+    bool bOK = true;
+    for (uint64_t nWritten = 0; bOK && nWritten < nSize; nWritten += block.size()) {
+        size_t nOnce = (size_t)(std::min)((uint64_t)block.size(), nSize - nWritten);
+        bOK = std::fwrite(block.data(), 1, nOnce, pFile) == nOnce;
+    }
+    return (std::fclose(pFile) == 0) && bOK;
+}
+
+TDevice OpenDevice(const std::string &strPath)
+{
+#ifdef _WIN32
+    return ::CreateFileA(strPath.c_str(),
+                         GENERIC_READ,
+                         FILE_SHARE_READ,
+                         nullptr,
+                         OPEN_EXISTING,
+                         FILE_FLAG_OVERLAPPED,
+                         nullptr);
+#else
+    return ::open(strPath.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+void CloseDevice(TDevice device)
+{
+#ifdef _WIN32
+    ::CloseHandle(device);
+#else
+    ::close(device);
+#endif
+}
+
+//读文件的速度，失败时返回负数
+double RunFileRead(IOCPThreadPool &pool,
+                   const TOptions &options,
+                   const std::string &strPath,
+                   double &fIops)
+{
+    TReadBench bench;
+    bench.m_pPool = &pool;
+    bench.m_nFileSize = (uint64_t)options.m_nFileMB * 1024 * 1024;
+    bench.m_nTotalBytes = bench.m_nFileSize * options.m_nRounds;
+    bench.m_device = OpenDevice(strPath);
+    if (bench.m_device == INVALID_DEVICE ||
+        !pool.BindDeviceToIOCPThreadPool(bench.m_device, OnReadCompleted)) {
+        return -1;
+    }
+
+    std::vector<std::unique_ptr<TReadOp>> ops;
+    for (size_t i = 0; i < options.m_nDepth; ++i) {
+        ops.emplace_back(new TReadOp);
+        ops.back()->m_pBench = &bench;
+        ops.back()->m_buffer.resize(options.m_nBlockKB * 1024);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bench.m_nInflight = ops.size();
+    for (auto &spOp : ops) {
+        if (!SubmitRead(spOp.get()) && --bench.m_nInflight == 0) {
+            bench.m_done.Set();
+        }
+    }
+    bench.m_done.Wait();
+    double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                          .count();
+#ifndef _WIN32
+    pool.UnbindDevice(bench.m_device);
+#endif
+    CloseDevice(bench.m_device);
+    if (bench.m_bFailed || bench.m_nReadBytes != bench.m_nTotalBytes) {
+        return -1;
+    }
+    fIops = (double)bench.m_nReads / fSeconds;
+    return (double)bench.m_nReadBytes / fSeconds / (1024 * 1024);
+}
+
+//----------------------------------------------------------------------
+
+int RunOne(const char *pName,
+           const TOptions &options,
+           const std::string &strPath
+#ifndef _WIN32
+           ,
+           TIOBackend backend
+#endif
+)
+{
+    IOCPThreadPool pool;
+#ifdef _WIN32
+    bool bCreated = pool.CreateIOCPThreadPool(0, options.m_dwThreads);
+#else
+    bool bCreated = pool.CreateIOCPThreadPool(0, options.m_dwThreads, backend);
+#endif
+    if (!bCreated) {
+        std::cout << std::left << std::setw(10) << pName << " not supported\n";
+        return 0;
+    }
+
+    double fCalls = RunAsyncCall(pool, options);
+    double fIops = 0;
+    double fMBps = RunFileRead(pool, options, strPath, fIops);
+    pool.CloseIOCPThreadPool();
+    if (fMBps < 0) {
+        std::cerr << pName << ": file read failed\n";
+        return 1;
+    }
+    std::cout << std::left << std::setw(10) << pName << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << fCalls / 1e6 << " Mcalls/s"
+              << std::setw(12) << fMBps << " MB/s" << std::setw(12) << std::setprecision(0)
+              << fIops << " reads/s\n";
+    return 0;
+}
+
+void PrintUsage()
+{
+    std::cerr << "usage: IOCPBenchmark [--backend all|uring|epoll] [--threads N] [--calls N]\n"
+                 "                     [--producers N] [--file-size MB] [--rounds N]\n"
+                 "                     [--block KB] [--depth N]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    TOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 1;
+        }
+        std::string name = argv[i];
+        std::string value = argv[++i];
+        size_t nValue = std::strtoull(value.c_str(), nullptr, 10);
+        if (name == "--backend") {
+            options.m_strBackend = value;
+        } else if (name == "--threads") {
+            options.m_dwThreads = (DWORD)nValue;
+        } else if (name == "--calls") {
+            options.m_nCalls = nValue;
+        } else if (name == "--producers") {
+            options.m_nProducers = nValue;
+        } else if (name == "--file-size") {
+            options.m_nFileMB = nValue;
+        } else if (name == "--rounds") {
+            options.m_nRounds = nValue;
+        } else if (name == "--block") {
+            options.m_nBlockKB = nValue;
+        } else if (name == "--depth") {
+            options.m_nDepth = nValue;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (options.m_nCalls == 0 || options.m_nProducers == 0 || options.m_nFileMB == 0 ||
+        options.m_nRounds == 0 || options.m_nBlockKB == 0 || options.m_nDepth == 0 ||
+        (options.m_nFileMB * 1024) % options.m_nBlockKB != 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    const std::string strPath = "IOCPBenchmark.dat";
+    if (!CreateTestFile(strPath, (uint64_t)options.m_nFileMB * 1024 * 1024)) {
+        std::cerr << "can not create " << strPath << '\n';
+        return 1;
+    }
+    std::cout << "calls " << options.m_nCalls << " from " << options.m_nProducers
+              << " threads; file " << options.m_nFileMB << " MB x " << options.m_nRounds
+              << " rounds, block " << options.m_nBlockKB << " KB, depth " << options.m_nDepth
+              << '\n';
+
+    int nResult = 0;
+#ifdef _WIN32
+    nResult = RunOne("iocp", options, strPath);
+#else
+    if (options.m_strBackend == "all" || options.m_strBackend == "uring") {
+        nResult |= RunOne("io_uring", options, strPath, TIOBackend::IO_URING);
+    }
+    if (options.m_strBackend == "all" || options.m_strBackend == "epoll") {
+        nResult |= RunOne("epoll", options, strPath, TIOBackend::EPOLL);
+    }
+#endif
+    std::remove(strPath.c_str());
+    return nResult;
+}
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include <memory>
 #include <type_traits>
 #include <boost/filesystem/fstream.hpp>
 #include <rapidjson/document.h>
@@ -14,6 +15,7 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 #include "MacroDefBase.h"
+#include "Memory/MonotonicArena.h"
 
 SHARELIB_BEGIN_NAMESPACE
 namespace JsonUtility {
@@ -239,5 +241,62 @@ bool WriteToString(
     }
 }
 
+/*!
+ * \class ArenaAllocator
+ * \brief 从 MonotonicArena 分配的rapidjson分配器，满足rapidjson的Allocator要求
+ Free什么都不做，文档用完后Reset arena即可，适合每个请求解析、生成一次的json.
+ 默认构造(GenericDocument没有传入分配器时)使用自己持有的arena
+ \code
+    MonotonicArena arena;
+    JsonUtility::ArenaAllocator allocator(arena);
+    JsonUtility::ArenaDocument doc(&allocator);
+    JsonUtility::ParseUtf8Memory(doc, pData, nSize);
+    ...
+    arena.Reset();
+ \endcode
+ */
+class ArenaAllocator
+{
+    SHARELIB_DISABLE_COPY_CLASS(ArenaAllocator);
+
+public:
+    static const bool kNeedFree = false;
+
+    ArenaAllocator()
+        : m_spOwnArena(new MonotonicArena())
+        , m_pArena(m_spOwnArena.get())
+    {}
+
+    explicit ArenaAllocator(MonotonicArena &arena)
+        : m_pArena(&arena)
+    {}
+
+    void *Malloc(size_t size)
+    {
+        return size ? m_pArena->Allocate(size) : nullptr;
+    }
+
+    void *Realloc(void *originalPtr, size_t originalSize, size_t newSize)
+    {
+        return newSize ? m_pArena->Reallocate(originalPtr, originalSize, newSize) : nullptr;
+    }
+
+    static void Free(void *) {}
+
+    MonotonicArena &GetArena() const
+    {
+        return *m_pArena;
+    }
+
+private:
+    std::unique_ptr<MonotonicArena> m_spOwnArena;
+    MonotonicArena *m_pArena;
+};
+
+//从 MonotonicArena 分配的文档及值
+using ArenaDocument =
+    RAPIDJSON_NAMESPACE::GenericDocument<RAPIDJSON_NAMESPACE::UTF8<>, ArenaAllocator>;
+using ArenaValue = RAPIDJSON_NAMESPACE::GenericValue<RAPIDJSON_NAMESPACE::UTF8<>, ArenaAllocator>;
+
 } // namespace JsonUtility
 SHARELIB_END_NAMESPACE
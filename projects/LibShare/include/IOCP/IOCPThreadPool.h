@@ -1,18 +1,53 @@
 ﻿#pragma once
 #include <future>
-#include <windows.h>
 #include "MacroDefBase.h"
+#ifdef _WIN32
+#    include <windows.h>
 //线程池回调函数不允许使用ExitThread
-#pragma deprecated(ExitThread)
+#    pragma deprecated(ExitThread)
+#else
+#    include <cstdint>
+#endif
 
 /*!
  * \file IocpThreadPool.h
  * \brief IOCP线程池封装.
  基于IOCP封装，win32 API GetQueuedCompletionStatus中占用第三个参数lpCompletionKey，作为函数指针使用。
+ linux下用io_uring实现同样的接口(内核不支持时用epoll)，仍然是proactor方式: 由 AsyncRead、AsyncWrite
+ 提交IO(对应windows下带OVERLAPPED的ReadFile、WriteFile)，完成后在线程池中调用设备绑定的回调函数。
  */
 
 SHARELIB_BEGIN_NAMESPACE
 
+#ifndef _WIN32
+/* linux下没有windows.h，在库的命名空间中定义回调原型中用到的类型，不与其它兼容层冲突;
+命名空间内或 using namespace 之后原有的回调函数不用修改。回调中的错误码是errno的值
+*/
+using DWORD = uint32_t;
+
+//其它兼容层已经用宏定义了同名常量时使用它们的定义，值相同
+#    ifndef ERROR_SUCCESS
+//成功的错误码，与windows的ERROR_SUCCESS相同
+constexpr DWORD ERROR_SUCCESS = 0;
+#    endif
+
+#    ifndef INFINITE
+//一直等待
+constexpr DWORD INFINITE = 0xFFFFFFFF;
+#    endif
+
+//与windows的OVERLAPPED对应，Internal、InternalHigh在IO完成之前由线程池使用
+struct OVERLAPPED
+{
+    uintptr_t Internal;
+    uintptr_t InternalHigh;
+    DWORD Offset; //文件偏移的低32位，socket、管道等不能定位的设备忽略偏移
+    DWORD OffsetHigh;
+    void *hEvent;
+};
+using LPOVERLAPPED = OVERLAPPED *;
+#endif
+
 //---------------------------------------
 
 //异步IO完成的回调函数，注意，会有多个线程同时调用此函数
@@ -25,6 +60,16 @@ typedef void (*TPFIOCPAsyncCallBack)(DWORD /*dwErrno*/, //该参数不使用
                                      DWORD dwNumberOfBytesTransferred,
                                      void *pVoid);
 
+#ifndef _WIN32
+//linux下IO的实现方式
+enum class TIOBackend
+{
+    AUTO,     //优先使用io_uring，内核不支持时使用epoll
+    IO_URING, //io_uring，内核5.6以上
+    EPOLL,    //epoll，socket、管道等等待可读写后在IO线程读写，普通文件在线程池中读写
+};
+#endif
+
 class IOCPThreadPool
 {
     SHARELIB_DISABLE_COPY_CLASS(IOCPThreadPool);
@@ -43,6 +88,13 @@ public:
     */
     bool CreateIOCPThreadPool(DWORD dwNumOfRun = 0, DWORD dwNumOfMax = 0);
 
+#ifndef _WIN32
+    /** 指定IO的实现方式创建线程池，其它同上。linux下没有同时激活线程数的限制，dwNumOfRun不使用
+    @param [in] backend IO的实现方式，指定IO_URING而内核不支持时返回false
+    */
+    bool CreateIOCPThreadPool(DWORD dwNumOfRun, DWORD dwNumOfMax, TIOBackend backend);
+#endif
+
     /** 结束线程池的运行并关闭IOCP，会同步等待所有线程退出后函数才返回。注意不能在IOCP回调中调用该函数,会死锁.
     */
     void CloseIOCPThreadPool();
@@ -63,7 +115,33 @@ public:
     @param[in] pfOnIOCompleted IO完成时的回调函数，不可为空
     @return 操作是否成功
     */
+#ifdef _WIN32
     bool BindDeviceToIOCPThreadPool(HANDLE hFileHandle, TPFOnIOCompleted pfOnIOCompleted);
+#else
+    bool BindDeviceToIOCPThreadPool(int fd, TPFOnIOCompleted pfOnIOCompleted);
+
+    /** 解除文件描述符的绑定，关闭fd之前调用，否则新打开的相同fd会沿用原来的绑定。
+    未完成的IO以ECANCELED完成(io_uring需要内核5.19以上，否则等待IO自然完成)
+    */
+    void UnbindDevice(int fd);
+
+    /** 异步读，对应windows下带OVERLAPPED的ReadFile，完成后在线程池中调用fd绑定的回调函数，
+    回调的pOverlapped即这里传入的指针。偏移由pOverlapped的Offset、OffsetHigh指定
+    @param[in] fd 已绑定的文件描述符
+    @param[in] pBuffer 缓冲区，IO完成之前必须有效
+    @param[in] dwBytes 读取的字节数
+    @param[in] pOverlapped IO完成之前必须有效，不能同时用于两个IO
+    @return 是否提交成功，失败时不会调用回调
+    */
+    bool AsyncRead(int fd, void *pBuffer, DWORD dwBytes, LPOVERLAPPED pOverlapped);
+
+    /** 异步写，对应windows下带OVERLAPPED的WriteFile，其它同 AsyncRead。写socket时不会产生SIGPIPE
+    */
+    bool AsyncWrite(int fd, const void *pBuffer, DWORD dwBytes, LPOVERLAPPED pOverlapped);
+
+    //实际使用的IO实现方式，线程池没有创建时返回AUTO
+    TIOBackend GetIOBackend() const;
+#endif
 
     /** 向IOCP发送消息，使其异步执行函数pfOnIOCompleted，函数的参数则由 dwNumberOfBytesTransferred，
     pVoid指定，与BindDeviceToIOCPThreadPool类似，不可为空。实际封装的是封装PostQueuedCompletionStatus，
@@ -93,12 +171,13 @@ public:
             return std::future<resultType>();
         }
         taskType *pTask = new taskType(std::forward<_Callable>(callObj));
+        //投递之后任务可能已经执行并删除，必须在投递之前取得future
+        std::future<resultType> result = pTask->get_future();
         if (!AsyncCall(AsyncCallHelper<taskType>, 0, pTask)) {
             delete pTask;
             return std::future<resultType>();
-        } else {
-            return pTask->get_future();
         }
+        return result;
     }
 
 private:
@@ -116,7 +195,11 @@ private:
 
     /** 线程池工作线程
     */
+#ifdef _WIN32
     static unsigned int __stdcall IOCPWorkThread(void *pVoid);
+#else
+    static void *IOCPWorkThread(void *pVoid);
+#endif
 
 private:
     //Iocp内部实现
@@ -0,0 +1,267 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include "MacroDefBase.h"
+
+/*!
+ * \file BinaryLog.h
+ * \brief 延迟格式化的二进制日志
+ 调用处只记录格式串的编号、steady_clock时间戳和参数的原始值，格式化由写文件线程完成，
+ 或者原样写入 *_bin.log 文件，由 LogDecoder 工具离线转换成文本.
+ 格式串与printf相同，支持 d i u x X o c f F e E g G a A s p 及 %%，不支持 * 宽度;
+ 参数只能是算术类型、枚举、指针、const char*及std::string，字符串会被复制
+ */
+
+#ifdef NO_SHARE_LOG
+#    define logbin(...) ((void)0)
+#else
+#    define logbin(pLog, pFormat, ...)                                                             \
+        do {                                                                                       \
+            static const uint32_t s_nBinaryLogSiteId =                                            \
+                shr::RegisterBinaryLogSite(pFormat, __FILE__, __LINE__);                           \
+            shr::WriteBinaryLog(pLog, s_nBinaryLogSiteId, ##__VA_ARGS__);                          \
+        } while (0)
+#endif
+
+SHARELIB_BEGIN_NAMESPACE
+
+class FileLog;
+
+//二进制日志记录的头部，后面紧跟参数
+struct TBinaryLogHeader
+{
+    //整条记录的长度，包括头部
+    uint32_t m_nSize;
+
+    //格式串编号，见 RegisterBinaryLogSite
+    uint32_t m_nSiteId;
+
+    //steady_clock的纳秒数
+    uint64_t m_nTimestamp;
+};
+
+enum TBinaryLogSiteId : uint32_t
+{
+    //文件头记录，参数为 BINARY_LOG_MAGIC 及 m_nTimestamp 对应的系统时间(微秒)
+    BINARY_LOG_SITE_HEADER = 0xFFFFFFFF,
+
+    //格式串定义记录，参数为编号、行号、格式串、文件名
+    BINARY_LOG_SITE_DEFINE = 0xFFFFFFFE,
+};
+
+//文件头记录的标识
+#define BINARY_LOG_MAGIC "SHRBLOG1"
+
+//参数类型标记，每个参数以一个字节的标记开头
+enum TBinaryLogArgTag : char
+{
+    BINARY_LOG_ARG_INT = 'i',     //int64_t
+    BINARY_LOG_ARG_UINT = 'u',    //uint64_t
+    BINARY_LOG_ARG_DOUBLE = 'd',  //double
+    BINARY_LOG_ARG_POINTER = 'p', //uint64_t
+    BINARY_LOG_ARG_STRING = 's',  //uint32_t长度 + 字符
+};
+
+/** 登记格式串，每个调用处只调用一次
+@param[in] pFormat 格式串，必须是静态字符串
+@param[in] pFile 文件名，必须是静态字符串
+@param[in] nLine 行号
+@return 格式串编号
+*/
+uint32_t RegisterBinaryLogSite(const char *pFormat, const char *pFile, uint32_t nLine);
+
+//格式串信息
+struct TBinaryLogSite
+{
+    const char *m_pFormat = nullptr;
+    const char *m_pFile = nullptr;
+    uint32_t m_nLine = 0;
+};
+
+/** 查询本进程登记的格式串
+@return 编号无效时返回false
+*/
+bool GetBinaryLogSite(uint32_t nSiteId, TBinaryLogSite &site);
+
+//steady_clock与系统时间的对应关系，用于把时间戳转换成时间
+struct TBinaryLogClock
+{
+    uint64_t m_nSteadyNs = 0;
+    int64_t m_nSystemUs = 0;
+};
+
+//本进程的时间对应关系，第一次调用时确定
+const TBinaryLogClock &GetBinaryLogClock();
+
+/** 把一条记录转换成文本追加到strText，格式为"[时:分:秒.微秒]"加格式化的内容
+@param[in] header 记录头
+@param[in] pFormat 格式串
+@param[in] pArgs 参数
+@param[in] nArgBytes 参数的字节数
+@param[in] clock 时间对应关系
+@param[out] strText 输出
+*/
+void RenderBinaryLog(const TBinaryLogHeader &header,
+                     const char *pFormat,
+                     const char *pArgs,
+                     size_t nArgBytes,
+                     const TBinaryLogClock &clock,
+                     std::string &strText);
+
+/** 追加文件头记录及格式串定义记录，用于原样写入文件
+*/
+void AppendBinaryLogPreamble(std::string &strData);
+void AppendBinaryLogSiteDefine(uint32_t nSiteId, std::string &strData);
+
+/** *_bin.log 文件的解码器，数据可以分多次输入.
+遇到文件头记录时清空格式串定义，因此同一个文件中可以有多个进程先后写入的数据;
+文件回滚后每个新文件开头都重新写入文件头及格式串定义，每个文件都可以单独解码
+*/
+class BinaryLogDecoder
+{
+public:
+    /** 输入数据，完整的记录转换成文本追加到strText
+    @return 数据格式错误时返回false
+    */
+    bool Decode(const char *pData, size_t nSize, std::string &strText);
+
+private:
+    std::string m_pending;
+    TBinaryLogClock m_clock;
+    std::unordered_map<uint32_t, std::pair<std::string, std::string>> m_sites;
+};
+
+//----------------------------------------------------------------------
+
+/** 一条二进制日志记录，析构时提交
+*/
+class BinaryLogRecord
+{
+    SHARELIB_DISABLE_COPY_CLASS(BinaryLogRecord);
+
+public:
+    /** 构造函数
+    @param[in] pLog 日志，空值则使用全局日志
+    @param[in] nSiteId 格式串编号
+    @param[in] nArgBytes 参数的字节数
+    */
+    BinaryLogRecord(FileLog *pLog, uint32_t nSiteId, size_t nArgBytes);
+
+    ~BinaryLogRecord();
+
+    //参数的写入位置，分配失败时为nullptr
+    char *GetArgBuffer() const { return m_pArgs; }
+
+private:
+    FileLog *m_pLog = nullptr;
+    char *m_pBuffer = nullptr;
+    char *m_pArgs = nullptr;
+    size_t m_nSize = 0;
+};
+
+namespace binary_log_detail {
+
+inline void EncodeValue(char *&pDst, char tag, const void *pValue, size_t nSize)
+{
+    *pDst++ = tag;
+    std::memcpy(pDst, pValue, nSize);
+    pDst += nSize;
+}
+
+inline size_t ArgSize(const char *pStr)
+{
+    return 1 + sizeof(uint32_t) + (pStr ? std::strlen(pStr) : 0);
+}
+
+inline size_t ArgSize(char *pStr)
+{
+    return ArgSize((const char *)pStr);
+}
+
+inline size_t ArgSize(const std::string &str)
+{
+    return 1 + sizeof(uint32_t) + str.size();
+}
+
+template<class T>
+std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value ||
+                     std::is_pointer<T>::value,
+                 size_t>
+ArgSize(T)
+{
+    return 1 + sizeof(uint64_t);
+}
+
+inline void EncodeString(char *&pDst, const char *pStr, size_t nLength)
+{
+    uint32_t nLength32 = (uint32_t)nLength;
+    EncodeValue(pDst, BINARY_LOG_ARG_STRING, &nLength32, sizeof(nLength32));
+    std::memcpy(pDst, pStr, nLength);
+    pDst += nLength;
+}
+
+inline void EncodeArg(char *&pDst, const char *pStr)
+{
+    EncodeString(pDst, pStr ? pStr : "", pStr ? std::strlen(pStr) : 0);
+}
+
+inline void EncodeArg(char *&pDst, char *pStr)
+{
+    EncodeArg(pDst, (const char *)pStr);
+}
+
+inline void EncodeArg(char *&pDst, const std::string &str)
+{
+    EncodeString(pDst, str.data(), str.size());
+}
+
+template<class T>
+std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value> EncodeArg(char *&pDst,
+                                                                                T value)
+{
+    using TInt = std::conditional_t<std::is_enum<T>::value, std::underlying_type<T>, std::decay<T>>;
+    if (std::is_signed<typename TInt::type>::value) {
+        int64_t nValue = (int64_t)value;
+        EncodeValue(pDst, BINARY_LOG_ARG_INT, &nValue, sizeof(nValue));
+    } else {
+        uint64_t nValue = (uint64_t)value;
+        EncodeValue(pDst, BINARY_LOG_ARG_UINT, &nValue, sizeof(nValue));
+    }
+}
+
+template<class T>
+std::enable_if_t<std::is_floating_point<T>::value> EncodeArg(char *&pDst, T value)
+{
+    double fValue = (double)value;
+    EncodeValue(pDst, BINARY_LOG_ARG_DOUBLE, &fValue, sizeof(fValue));
+}
+
+template<class T>
+std::enable_if_t<std::is_pointer<T>::value> EncodeArg(char *&pDst, T value)
+{
+    uint64_t nValue = (uint64_t)(uintptr_t)value;
+    EncodeValue(pDst, BINARY_LOG_ARG_POINTER, &nValue, sizeof(nValue));
+}
+
+} // namespace binary_log_detail
+
+/** 写入一条二进制日志，一般通过 logbin 宏调用
+*/
+template<class... TArgs>
+void WriteBinaryLog(FileLog *pLog, uint32_t nSiteId, const TArgs &... args)
+{
+    size_t nArgBytes = 0;
+    (void)std::initializer_list<int>{(nArgBytes += binary_log_detail::ArgSize(args), 0)...};
+    BinaryLogRecord record(pLog, nSiteId, nArgBytes);
+    char *pDst = record.GetArgBuffer();
+    if (pDst) {
+        (void)std::initializer_list<int>{(binary_log_detail::EncodeArg(pDst, args), 0)...};
+    }
+}
+
+SHARELIB_END_NAMESPACE
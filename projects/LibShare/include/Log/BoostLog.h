@@ -1,6 +1,10 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/log/attributes/named_scope.hpp>
 #include <boost/log/attributes/scoped_attribute.hpp>
@@ -8,6 +12,9 @@
 #include <boost/log/sources/global_logger_storage.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 #include <boost/log/sources/severity_channel_logger.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+#include "Log/LogArchiver.h"
+#include "Log/SimpleAsyncSink.h"
 #include "MacroDefBase.h"
 
 SHARELIB_BEGIN_NAMESPACE
@@ -18,7 +25,7 @@ namespace log {
 */
 void InitLog();
 
-/** 设置日志系统是否开启，默认为开启状态。关闭后所有日志都禁用。
+/** 设置日志系统是否开启，默认为开启状态。关闭后所有日志都禁用，SHARE_LOG 不会构造日志记录。
 *  多线程安全，可重入。
 * @param[in] is_enable 是否开启
 */
@@ -40,37 +47,94 @@ enum class LogLevel
 const char *ToString(LogLevel level);
 
 /** 设置日志过滤级别，多线程安全，可以多次调用，并且可以在运行时调用。
-*  默认输出所有日志
+*  默认输出所有日志。级别不够的 SHARE_LOG 在构造日志记录之前就被过滤掉，只有一次比较;
+*  不经过 SHARE_LOG 直接使用 global_logger 的日志不受此级别限制
 * @param[in] level 大于等于该级别的日志才会输出
 */
 void SetGlobalLogLevel(LogLevel level);
 
+namespace detail {
+//SetGlobalLogLevel 及 SetEnableLog 的综合结果，小于该值的级别不输出
+extern std::atomic<int> g_minLogLevel;
+} // namespace detail
+
+/** 该级别的日志是否会输出，SHARE_LOG 在构造日志记录之前调用
+*/
+inline bool IsLogLevelEnabled(LogLevel level)
+{
+    return (int)level >= detail::g_minLogLevel.load(std::memory_order_relaxed);
+}
+
+/** 日志的channel，名字在第一次使用时转换为编号，sink按编号过滤，不用比较字符串
+*/
+struct TLogChannel
+{
+    //编号，0表示空的channel
+    uint32_t m_nId = 0;
+
+    //名字，指向全局的存储，不会释放
+    const char *m_pName = "";
+};
+
+inline std::ostream &operator<<(std::ostream &os, const TLogChannel &channel)
+{
+    return os << channel.m_pName;
+}
+
+/** 获取channel名字对应的编号，同一名字总是得到同一个编号。多线程安全，需要加锁查找，
+*  SHARE_LOG 每个调用处只调用一次
+* @param[in] pName channel的名字
+*/
+TLogChannel InternLogChannel(const char *pName);
+TLogChannel InternLogChannel(const std::string &name);
+
 /** 文件日志参数
 */
 struct FileLogParam
 {
+    FileLogParam() { async_options_.m_nMaxQueueSize = FILE_LOG_MAX_QUEUE_SIZE; }
+
+    /// 异步日志默认的队列大小
+    static constexpr size_t FILE_LOG_MAX_QUEUE_SIZE = 500000;
+
     /// 日志存放的全路径
     boost::filesystem::path full_path_;
 
     /// 日志过滤器，如果非空，只有 channel 与此相同的日志才会输出到该文件
     std::string channel_filter_;
 
+    /// 日志过滤器，可以接受多个 channel，与 channel_filter_ 合并。都为空时输出所有 channel
+    std::vector<std::string> channel_filters_;
+
     /// 单个日志的过滤级别。需要先通过全局的日志级别过滤，才会检查单个日志的过滤条件。
     LogLevel level_ = LogLevel::debug;
 
     /// 是否使用异步日志，如果使用异步日志，每一个日志会开启一个后台线程
     bool is_async_ = true;
 
-    /// 日志是否自动刷新，is_async_为true时该参数无效，会根据负载自动调节
+    /// 日志是否自动刷新，is_async_为true时该参数无效，按 async_options_ 的策略flush
     bool is_auto_flush_ = true;
 
+    /// 异步日志的队列大小、每批写入的记录数及flush策略，is_async_为false时无效。
+    /// 队列默认最多 FILE_LOG_MAX_QUEUE_SIZE 条记录，超出时丢弃新的记录
+    TAsyncSinkOptions async_options_;
+
     /// 日志回滚大小
     uintmax_t rotation_size_ = 10 * 1024 * 1024;
 
     /// 最大保存日志的大小
     uintmax_t max_backup_size_ = rotation_size_;
+
+    /// 回滚文件的压缩及保留策略。IsEnabled()时代替 max_backup_size_，回滚的文件交给后台线程
+    /// 压缩，按个数、时间、压缩后的总大小删除旧文件
+    TLogArchiveOptions archive_options_;
 };
 
+/** 默认的日志格式: [时间][channel][线程][级别][文件名(行号),scope]消息，AddFileLog 使用.
+*  日期到分钟的部分每个线程缓存一份，分钟变化时才重新格式化; 文件名按scope的位置缓存
+*/
+void DefaultFormater(const boost::log::record_view &view, boost::log::formatting_ostream &stream);
+
 /** 添加文件日志
 * @param param 日志参数
 * @return 文件日志指针，注意，这个指针只有两个用途：
@@ -79,6 +143,14 @@ struct FileLogParam
 */
 boost::shared_ptr<boost::log::sinks::sink> AddFileLog(const FileLogParam &param);
 
+/** 获取异步文件日志的统计，如丢弃的日志数、队列的最大长度
+* @param sp_log AddFileLog 返回的文件日志指针
+* @param[out] stats 统计
+* @return 不是异步日志时返回false
+*/
+bool GetFileLogStats(const boost::shared_ptr<boost::log::sinks::sink> &sp_log,
+                     TAsyncSinkStats &stats);
+
 /** 删除文件日志，已经保存在磁盘上的日志文件不会删除
 * @param sp_log 文件日志指针
 */
@@ -90,13 +162,32 @@ void RemoveAllLogs();
 
 /** 日志source单例定义
 */
-BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(global_logger,
-                                       boost::log::sources::severity_channel_logger_mt<LogLevel>)
+using global_logger_type = boost::log::sources::severity_channel_logger_mt<LogLevel, TLogChannel>;
+BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(global_logger, global_logger_type)
 
 } // namespace log
 SHARELIB_END_NAMESPACE
 
 /** 示例： SHARE_LOG("net_work", info) << "connect sucess!";
+ *  级别不够时只有一次比较。channel在每个调用处第一次执行时转换为编号，之后不再查找，
+ *  因此同一调用处的channel必须不变，运行时变化的channel使用 SHARE_LOG_DYNAMIC
  */
 #define SHARE_LOG(channel, level)                                                                  \
-    BOOST_LOG_CHANNEL_SEV(::shr::log::global_logger::get(), channel, ::shr::log::LogLevel::level)
+    SHARE_LOG_IMPL(                                                                                \
+        ([&]() -> const ::shr::log::TLogChannel & {                                                \
+            static const ::shr::log::TLogChannel s_shareLogChannel =                               \
+                ::shr::log::InternLogChannel(channel);                                             \
+            return s_shareLogChannel;                                                              \
+        }()),                                                                                      \
+        level)
+
+/** 每次都查找channel的编号
+ */
+#define SHARE_LOG_DYNAMIC(channel, level)                                                          \
+    SHARE_LOG_IMPL(::shr::log::InternLogChannel(channel), level)
+
+#define SHARE_LOG_IMPL(channel, level)                                                             \
+    if (!::shr::log::IsLogLevelEnabled(::shr::log::LogLevel::level)) {                             \
+    } else                                                                                         \
+        BOOST_LOG_CHANNEL_SEV(                                                                     \
+            ::shr::log::global_logger::get(), channel, ::shr::log::LogLevel::level)
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "FakeOstream.h"
+#include "LogArchiver.h"
 #include "MacroDefBase.h"
 #include "Other/OstreamCodeConvert.h"
 #include "std_streambuf_adaptor.h"
@@ -20,6 +21,14 @@ SHARELIB_BEGIN_NAMESPACE
 */
 void SetGlobalOneLogPerProcess(bool bOneLogPerProcess);
 
+/** 设置全局Log是否使用内存映射文件，见 FileLog 的构造函数，必须在第一次写日志之前调用
+*/
+void SetGlobalMappedLogFile(bool bMappedFile);
+
+/** 设置全局Log回滚文件的压缩及保留策略，见 FileLog::SetArchiveOptions，必须在第一次写日志之前调用
+*/
+void SetGlobalLogArchiveOptions(const TLogArchiveOptions &options);
+
 class FileLog;
 class FileLogOstream : public std::ostream
 {
@@ -49,13 +58,27 @@ public:
     @param [in] pPath 日志路径，如果为nullptr或长度为0则取当前可执行文件所在文件夹
     @param [in] pName 日志名字，如果为nullptr或长度为0则取当前可执行文件的名字
     @param [in] bOneLogPerProcess 是否每个进程一个日志文件
+    @param [in] bMappedFile 是否使用内存映射文件. 是则写日志的线程直接复制到映射内存中，
+           没有写文件线程和系统调用，进程崩溃时已写入的日志不会丢失，但文件预先占用最大长度
     */
     explicit FileLog(const char *pPath = nullptr,
                      const char *pName = nullptr,
-                     bool bOneLogPerProcess = false);
+                     bool bOneLogPerProcess = false,
+                     bool bMappedFile = false);
 
     ~FileLog();
 
+    /** 设置二进制日志(logbin)的输出方式，必须在第一次写日志之前调用，映射模式下无效
+    @param [in] bRaw false(默认)表示由写文件线程转换成文本后写入日志；true表示原样写入
+           日志名加"_bin"的文件，由 LogDecoder 工具离线转换成文本，写文件线程不做格式化
+    */
+    void SetBinaryLogRaw(bool bRaw);
+
+    /** 设置回滚文件(超过 MAX_LOG_FILE_SIZE 后改名的文件)的压缩及保留策略，必须在第一次写日志之前调用。
+    压缩及删除都在后台线程进行，二进制日志的回滚文件使用相同的策略，单独计算个数及大小
+    */
+    void SetArchiveOptions(const TLogArchiveOptions &options);
+
     /** 删除日志
     @param [in] bDeleteAll true表示删除所有的日志，false表示今天的不删除，其他的删除
     */
@@ -71,6 +94,7 @@ public:
 
 private:
     friend class FileLogOstream;
+    friend class BinaryLogRecord;
 
     struct TImpl;
     TImpl *m_pImpl;
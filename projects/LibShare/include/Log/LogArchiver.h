@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MacroDefBase.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+/** 日志回滚文件的压缩及保留策略，默认不压缩也不删除
+*/
+struct TLogArchiveOptions
+{
+    //回滚后的文件是否用gzip压缩，压缩后的文件名加".gz"，并删除原文件
+    bool m_bCompress = false;
+
+    //压缩级别，1表示速度最快，9表示压缩率最高
+    int m_nLevel = 6;
+
+    //最多保留的回滚文件个数，0表示不限
+    size_t m_nMaxFiles = 0;
+
+    //回滚文件最长的保留时间(秒)，按文件的修改时间计算，0表示不限
+    uint64_t m_nMaxAgeSeconds = 0;
+
+    //回滚文件的最大总大小，已压缩的文件按压缩后的大小计算，0表示不限
+    uintmax_t m_nMaxTotalBytes = 0;
+
+    //是否需要在后台处理回滚文件
+    bool IsEnabled() const
+    {
+        return m_bCompress || m_nMaxFiles != 0 || m_nMaxAgeSeconds != 0 || m_nMaxTotalBytes != 0;
+    }
+};
+
+/** 回滚文件名的格式: 开头 + 时间 + 结尾，压缩后再加".gz"
+*/
+struct TRotatedFileName
+{
+    //回滚文件所在的文件夹
+    std::string m_strDir;
+
+    //是否包括子文件夹
+    bool m_bRecursive = false;
+
+    //文件名的开头
+    std::string m_strPrefix;
+
+    //时间部分，'#'匹配一个数字，其它字符原样匹配
+    std::string m_strTimeMask;
+
+    //时间后面是否可以有"_序号"，同一秒内多次回滚时用序号区分
+    bool m_bAllowCounter = false;
+
+    //文件名的结尾
+    std::string m_strSuffix;
+};
+
+/*!
+ * \class LogArchiver
+ * \brief 日志回滚文件的后台处理，多线程安全
+ 回滚后的文件由 Submit 交给后台线程，流式gzip压缩后删除原文件，再按个数、时间、总大小删除
+ 最旧的回滚文件。写日志的线程只加锁入队，后台线程在第一次提交时启动
+ */
+class LogArchiver
+{
+    SHARELIB_DISABLE_COPY_CLASS(LogArchiver);
+
+public:
+    /** 构造函数
+    @param [in] options 压缩及保留策略
+    @param [in] fileName 回滚文件名的格式，只处理符合格式的文件
+    */
+    LogArchiver(const TLogArchiveOptions &options, const TRotatedFileName &fileName);
+
+    //处理完已提交的文件后退出
+    ~LogArchiver();
+
+    /** 提交已关闭的回滚文件
+    @param [in] strFile 文件的全路径
+    */
+    void Submit(const std::string &strFile);
+
+    /** 在后台整理已有的回滚文件: 压缩上次没有压缩的文件，再执行保留策略
+    */
+    void Scan();
+
+    /** 等待已提交的文件处理完成
+    */
+    void WaitIdle();
+
+private:
+    struct TImpl;
+    std::unique_ptr<TImpl> m_spImpl;
+};
+
+SHARELIB_END_NAMESPACE
@@ -1,173 +1,645 @@
-﻿#pragma once
-#include <boost/atomic.hpp>
-#include <boost/log/sinks/basic_sink_frontend.hpp>
-#include <boost/log/sinks/frontend_requirements.hpp>
-#include <boost/log/sinks/unbounded_fifo_queue.hpp>
-#include <boost/smart_ptr.hpp>
-#include <boost/thread.hpp>
-#include "MacroDefBase.h"
-
-SHARELIB_BEGIN_NAMESPACE
-
-/** 复制自 boost::log::sinks::asynchronous_sink，主要为了解决以下问题：
- *  text_file_backend 可以设置是否自动flush，为true时每输出一条日志就flush，可以及时落盘但速度慢，
- *  false时速度快但如果不手动调flush就不落盘，不能及时看到日志。速度和即时性不能很好兼顾。这里的实现
- *  修改为，当队列中有数据时不flush，队列为空时flush。text_file_backend设置为不自动flush，这样就
- *  可以实现高负载时速度优先，低负载时落盘，两方兼顾。
- *
- *  其他区别：
- *  去掉了boost::log::sinks::asynchronous_sink中的flush相关的public接口，因为内部实现已经兼顾
- *  速度和即时性，没有必要再留这些接口了。
- */
-template<typename SinkBackendT,
-         typename QueueingStrategyT = boost::log::sinks::unbounded_fifo_queue>
-class SimpleAsyncSink
-    : public boost::log::sinks::aux::make_sink_frontend_base<SinkBackendT>::type
-    , public QueueingStrategyT
-{
-    typedef typename boost::log::sinks::aux::make_sink_frontend_base<SinkBackendT>::type base_type;
-    typedef QueueingStrategyT queue_base_type;
-
-    //! Backend synchronization mutex type
-    typedef boost::recursive_mutex backend_mutex_type;
-    //! Frontend synchronization mutex type
-    typedef typename base_type::mutex_type frontend_mutex_type;
-
-public:
-    //! Sink implementation type
-    typedef SinkBackendT sink_backend_type;
-    //! \cond
-    BOOST_STATIC_ASSERT_MSG(
-        (boost::log::sinks::has_requirement<typename sink_backend_type::frontend_requirements,
-                                            boost::log::sinks::synchronized_feeding>::value),
-        "Asynchronous sink frontend is incompatible with the specified backend: thread "
-        "synchronization requirements are not met");
-    //! \endcond
-
-    /*!
-    * Constructor attaches user-constructed backend instance
-    *
-    * \param backend Pointer to the backend instance.
-    *
-    * \pre \a backend is not \c NULL.
-    */
-    explicit SimpleAsyncSink(boost::shared_ptr<sink_backend_type> const &backend)
-        : base_type(true)
-        , m_pBackend(backend)
-        , m_StopRequested(false)
-    {
-        boost::thread(boost::bind(&SimpleAsyncSink::run, this)).swap(m_DedicatedFeedingThread);
-    }
-
-    /*!
-    * Destructor. Implicitly stops the dedicated feeding thread, if one is running.
-    */
-    ~SimpleAsyncSink() BOOST_NOEXCEPT
-    {
-        try {
-            boost::this_thread::disable_interruption no_interrupts;
-            stop();
-        } catch (...) {
-            std::terminate();
-        }
-    }
-
-    /*!
-    * Enqueues the log record to the backend
-    */
-    void consume(boost::log::record_view const &rec) { queue_base_type::enqueue(rec); }
-
-    /*!
-    * The method attempts to pass logging record to the backend
-    */
-    bool try_consume(boost::log::record_view const &rec)
-    {
-        return queue_base_type::try_enqueue(rec);
-    }
-
-    void flush() {}
-
-private:
-    /*!
-    * The method starts record feeding loop and effectively blocks until either of this happens:
-    *
-    * \li the thread is interrupted due to either standard thread interruption or a call to \c stop
-    * \li an exception is thrown while processing a log record in the backend, and the exception is
-    *     not terminated by the exception handler, if one is installed
-    *
-    * \pre The sink frontend must be constructed without spawning a dedicated thread
-    */
-    void run()
-    {
-        for (;;) {
-            do_feed_records();
-            if (!m_StopRequested.load(boost::memory_order_acquire)) {
-                // Block until new record is available
-                boost::log::record_view rec;
-                if (queue_base_type::dequeue_ready(rec))
-                    base_type::feed_record(rec, m_BackendMutex, *m_pBackend);
-            } else
-                break;
-        }
-    }
-
-    //! The record feeding loop
-    void do_feed_records()
-    {
-        while (!m_StopRequested.load(boost::memory_order_acquire)) {
-            boost::log::record_view rec;
-            if (queue_base_type::try_dequeue_ready(rec))
-                base_type::feed_record(rec, m_BackendMutex, *m_pBackend);
-            else
-                break;
-        }
-        base_type::flush_backend(m_BackendMutex, *m_pBackend);
-    }
-
-    /*!
-    * The method softly interrupts record feeding loop. This method must be called when the \c run
-    * method execution has to be interrupted. Unlike regular thread interruption, calling
-    * \c stop will not interrupt the record processing in the middle. Instead, the sink frontend
-    * will attempt to finish its business with the record in progress and return afterwards.
-    * This method can be called either if the sink was created with a dedicated thread,
-    * or if the feeding loop was initiated by user.
-    *
-    * \note Returning from this method does not guarantee that there are no records left buffered
-    *       in the sink frontend. It is possible that log records keep coming during and after this
-    *       method is called. At some point of execution of this method log records stop being processed,
-    *       and all records that come after this point are put into the queue. These records will be
-    *       processed upon further calls to \c run or \c feed_records.
-    */
-    void stop()
-    {
-        boost::unique_lock<frontend_mutex_type> lock(base_type::frontend_mutex());
-        if (m_DedicatedFeedingThread.joinable()) {
-            try {
-                m_StopRequested.store(true, boost::memory_order_release);
-                queue_base_type::interrupt_dequeue();
-            } catch (...) {
-                m_StopRequested.store(false, boost::memory_order_release);
-                throw;
-            }
-
-            lock.unlock();
-            m_DedicatedFeedingThread.join();
-        }
-    }
-
-private:
-    //! Synchronization mutex
-    backend_mutex_type m_BackendMutex;
-    //! Pointer to the backend
-    const boost::shared_ptr<sink_backend_type> m_pBackend;
-
-    //! Dedicated record feeding thread
-    boost::thread m_DedicatedFeedingThread;
-    //! Condition variable to implement blocking operations
-    boost::condition_variable_any m_BlockCond;
-
-    //! The flag indicates that the feeding loop has to be stopped
-    boost::atomic<bool> m_StopRequested;
-};
-
-SHARELIB_END_NAMESPACE
+﻿#pragma once
+
+//boost.log的sink使用boost.thread的timed_wait，BOOST_THREAD_VERSION=5时需要打开
+#ifndef BOOST_THREAD_USES_DATETIME
+#    define BOOST_THREAD_USES_DATETIME
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/log/attributes/value_extraction.hpp>
+#include <boost/log/detail/default_attribute_names.hpp>
+#include <boost/log/detail/fake_mutex.hpp>
+#include <boost/log/detail/locks.hpp>
+#include <boost/log/sinks/basic_sink_frontend.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
+#include <boost/log/sinks/frontend_requirements.hpp>
+#include <boost/log/sinks/unbounded_fifo_queue.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+#include <boost/mpl/bool.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+#include "MacroDefBase.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+//SimpleAsyncSink 的参数
+struct TAsyncSinkOptions
+{
+    //队列中最多的记录数，超出时丢弃新的记录，0表示不限制.
+    //QueueingStrategyT 为 bounded_fifo_queue 时以其容量为准
+    size_t m_nMaxQueueSize = 0;
+
+    //写线程一次加锁最多写入后端的记录数
+    size_t m_nBatchSize = 1024;
+
+    //队列空闲(没有新记录)超过该时间(毫秒)时flush，0表示队列一空就flush.
+    //默认与原来一样队列一空就flush，崩溃前的日志不会滞留在后端的缓冲区中;
+    //日志量大、可以接受延迟时设置该值，减少flush的次数
+    uint32_t m_nIdleFlushMs = 0;
+
+    //有未flush的记录时，最长多久(毫秒)flush一次，避免持续的少量日志一直不落盘，0表示不限制
+    uint32_t m_nMaxFlushDelayMs = 1000;
+
+    //未flush的消息字节数(不含格式化添加的前缀)达到该值时flush，0表示不按字节数
+    size_t m_nFlushBytes = 0;
+
+    //未flush的记录数达到该值时flush，0表示不按记录数
+    size_t m_nFlushRecords = 0;
+
+    //格式化线程数. 大于1时由这些线程并行格式化，写线程按进入队列的顺序写入后端，
+    //文件中的顺序不变; 否则由写线程格式化. 只对需要格式化的后端有效
+    size_t m_nFormatThreads = 0;
+};
+
+//SimpleAsyncSink 的统计，用于确定队列的大小
+struct TAsyncSinkStats
+{
+    //进入队列的记录数
+    uint64_t m_nEnqueued = 0;
+
+    //队列满时丢弃的记录数
+    uint64_t m_nDropped = 0;
+
+    //当前队列中的记录数
+    size_t m_nQueueSize = 0;
+
+    //队列中记录数的最大值
+    size_t m_nPeakQueueSize = 0;
+
+    //写线程成批写入后端的次数
+    uint64_t m_nBatches = 0;
+
+    //flush后端的次数
+    uint64_t m_nFlushes = 0;
+};
+
+/** SimpleAsyncSink 的队列是内置的，QueueingStrategyT 只决定队列的容量及队列满时的处理方式.
+ *  支持 unbounded_fifo_queue，以及 bounded_fifo_queue 配合 drop_on_overflow 或 block_on_overflow
+ */
+template<typename QueueingStrategyT>
+struct TAsyncSinkQueueTraits;
+
+template<>
+struct TAsyncSinkQueueTraits<boost::log::sinks::unbounded_fifo_queue>
+{
+    //队列容量，0表示由 TAsyncSinkOptions::m_nMaxQueueSize 决定
+    static constexpr size_t MAX_QUEUE_SIZE = 0;
+
+    //队列满时是否阻塞写日志的线程，否则丢弃新的记录
+    static constexpr bool BLOCK_ON_OVERFLOW = false;
+};
+
+template<size_t MaxQueueSizeV>
+struct TAsyncSinkQueueTraits<
+    boost::log::sinks::bounded_fifo_queue<MaxQueueSizeV, boost::log::sinks::drop_on_overflow>>
+{
+    static constexpr size_t MAX_QUEUE_SIZE = MaxQueueSizeV;
+    static constexpr bool BLOCK_ON_OVERFLOW = false;
+};
+
+template<size_t MaxQueueSizeV>
+struct TAsyncSinkQueueTraits<
+    boost::log::sinks::bounded_fifo_queue<MaxQueueSizeV, boost::log::sinks::block_on_overflow>>
+{
+    static constexpr size_t MAX_QUEUE_SIZE = MaxQueueSizeV;
+    static constexpr bool BLOCK_ON_OVERFLOW = true;
+};
+
+/** 复制自 boost::log::sinks::asynchronous_sink，主要为了解决以下问题：
+ *  text_file_backend 可以设置是否自动flush，为true时每输出一条日志就flush，可以及时落盘但速度慢，
+ *  false时速度快但如果不手动调flush就不落盘，不能及时看到日志。速度和即时性不能很好兼顾。这里的实现
+ *  修改为按 TAsyncSinkOptions 的策略flush: 队列空闲一段时间、未flush的字节数或记录数达到上限、
+ *  或者距第一条未flush的记录超过一定时间。text_file_backend设置为不自动flush，这样就
+ *  可以实现高负载时速度优先，低负载时落盘，两方兼顾。
+ *
+ *  其他区别：
+ *  去掉了boost::log::sinks::asynchronous_sink中的flush相关的public接口，因为内部实现已经兼顾
+ *  速度和即时性，没有必要再留这些接口了。
+ *  队列是内置的，写线程一次取出一批记录，只加一次后端的锁; QueueingStrategyT 决定队列的容量及
+ *  队列满时丢弃新记录(计数，见 get_stats)还是阻塞，见 TAsyncSinkQueueTraits.
+ *  析构时写完队列中剩余的记录.
+ *  格式化较慢时可以设置 m_nFormatThreads: 格式化线程各自从队列取出一批记录并按取出的顺序编号，
+ *  格式化到自己的缓冲区，写线程按编号依次写入后端，吞吐量随核数增加
+ */
+template<typename SinkBackendT,
+         typename QueueingStrategyT = boost::log::sinks::unbounded_fifo_queue>
+class SimpleAsyncSink : public boost::log::sinks::aux::make_sink_frontend_base<SinkBackendT>::type
+{
+    typedef typename boost::log::sinks::aux::make_sink_frontend_base<SinkBackendT>::type base_type;
+    typedef TAsyncSinkQueueTraits<QueueingStrategyT> queue_traits;
+
+    //! Backend synchronization mutex type
+    typedef boost::recursive_mutex backend_mutex_type;
+    //! Frontend synchronization mutex type
+    typedef typename base_type::mutex_type frontend_mutex_type;
+
+    typedef boost::chrono::steady_clock clock_type;
+
+    //! Whether the backend consumes formatted strings
+    typedef boost::log::sinks::has_requirement<typename SinkBackendT::frontend_requirements,
+                                               boost::log::sinks::formatted_records>
+        is_formatting;
+
+    //! A batch formatted by a formatting thread, committed by the feeding thread in m_nSeq order
+    struct TFormatJob
+    {
+        uint64_t m_nSeq = 0;
+        std::vector<boost::log::record_view> m_records;
+        std::vector<std::string> m_texts;
+    };
+
+public:
+    //! Sink implementation type
+    typedef SinkBackendT sink_backend_type;
+    //! \cond
+    BOOST_STATIC_ASSERT_MSG(
+        (boost::log::sinks::has_requirement<typename sink_backend_type::frontend_requirements,
+                                            boost::log::sinks::synchronized_feeding>::value),
+        "Asynchronous sink frontend is incompatible with the specified backend: thread "
+        "synchronization requirements are not met");
+    //! \endcond
+
+    /*!
+    * Constructor attaches user-constructed backend instance
+    *
+    * \param backend Pointer to the backend instance.
+    * \param options Queue size and flush policy.
+    *
+    * \pre \a backend is not \c NULL.
+    */
+    explicit SimpleAsyncSink(boost::shared_ptr<sink_backend_type> const &backend,
+                             const TAsyncSinkOptions &options = TAsyncSinkOptions{})
+        : base_type(true)
+        , m_pBackend(backend)
+        , m_options(options)
+        , m_StopRequested(false)
+    {
+        if (queue_traits::MAX_QUEUE_SIZE != 0) {
+            m_options.m_nMaxQueueSize = queue_traits::MAX_QUEUE_SIZE;
+        }
+        if (m_options.m_nBatchSize == 0) {
+            m_options.m_nBatchSize = 1;
+        }
+        if (!is_formatting::value || m_options.m_nFormatThreads < 2) {
+            m_options.m_nFormatThreads = 0;
+        }
+        start_formatters(typename is_formatting::type());
+        boost::thread(boost::bind(&SimpleAsyncSink::run, this)).swap(m_DedicatedFeedingThread);
+    }
+
+    /*!
+    * Destructor. Implicitly stops the dedicated feeding thread, if one is running.
+    */
+    ~SimpleAsyncSink() BOOST_NOEXCEPT
+    {
+        try {
+            boost::this_thread::disable_interruption no_interrupts;
+            stop();
+        } catch (...) {
+            std::terminate();
+        }
+    }
+
+    /*!
+    * Enqueues the log record to the backend
+    */
+    void consume(boost::log::record_view const &rec)
+    {
+        boost::unique_lock<boost::mutex> lock(m_QueueMutex);
+        if (queue_traits::BLOCK_ON_OVERFLOW) {
+            //等待写线程取走记录，停止后不再等待
+            while (is_queue_full() && !m_StopRequested.load(boost::memory_order_acquire)) {
+                m_SpaceCond.wait(lock);
+            }
+        }
+        if (is_queue_full()) {
+            ++m_stats.m_nDropped;
+            return;
+        }
+        push_record(rec);
+    }
+
+    /*!
+    * The method attempts to pass logging record to the backend
+    */
+    bool try_consume(boost::log::record_view const &rec)
+    {
+        boost::unique_lock<boost::mutex> lock(m_QueueMutex, boost::try_to_lock);
+        if (!lock.owns_lock() || is_queue_full()) {
+            return false;
+        }
+        push_record(rec);
+        return true;
+    }
+
+    void flush() {}
+
+    /*!
+    * Returns queue and feeding counters
+    */
+    TAsyncSinkStats get_stats() const
+    {
+        boost::lock_guard<boost::mutex> lock(m_QueueMutex);
+        TAsyncSinkStats stats = m_stats;
+        stats.m_nQueueSize = m_Queue.size();
+        stats.m_nBatches = m_nBatches.load(boost::memory_order_relaxed);
+        stats.m_nFlushes = m_nFlushes.load(boost::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    bool is_queue_full() const
+    {
+        return m_options.m_nMaxQueueSize != 0 && m_Queue.size() >= m_options.m_nMaxQueueSize;
+    }
+
+    void push_record(boost::log::record_view const &rec)
+    {
+        m_Queue.push_back(rec);
+        ++m_stats.m_nEnqueued;
+        if (m_Queue.size() > m_stats.m_nPeakQueueSize) {
+            m_stats.m_nPeakQueueSize = m_Queue.size();
+        }
+        if (m_Queue.size() == 1) {
+            m_QueueCond.notify_one();
+        }
+    }
+
+    /*!
+    * Takes up to \c m_nBatchSize records. Blocks while the queue is empty until a record arrives,
+    * \a deadline expires (if \a bTimed) or \c stop is called.
+    * If \a pSeq is not \c NULL, a non-empty batch gets the next sequence number.
+    */
+    void dequeue_batch(std::vector<boost::log::record_view> &batch,
+                       bool bTimed,
+                       clock_type::time_point deadline,
+                       uint64_t *pSeq = nullptr)
+    {
+        boost::unique_lock<boost::mutex> lock(m_QueueMutex);
+        while (m_Queue.empty() && !m_StopRequested.load(boost::memory_order_acquire)) {
+            if (!bTimed) {
+                m_QueueCond.wait(lock);
+            } else if (m_QueueCond.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                break;
+            }
+        }
+        size_t nCount = (std::min)(m_Queue.size(), m_options.m_nBatchSize);
+        for (size_t i = 0; i < nCount; ++i) {
+            batch.push_back(boost::move(m_Queue.front()));
+            m_Queue.pop_front();
+        }
+        if (pSeq && nCount != 0) {
+            *pSeq = m_nNextSeq++;
+        }
+        if (queue_traits::BLOCK_ON_OVERFLOW && nCount != 0) {
+            m_SpaceCond.notify_all();
+        }
+
+        //入队只在队列由空变为非空时唤醒一个线程，剩下的记录交给下一个格式化线程
+        if (!m_Queue.empty() && m_options.m_nFormatThreads != 0) {
+            m_QueueCond.notify_one();
+        }
+    }
+
+    //! Feeds the whole batch under one backend lock
+    void feed_batch(std::vector<boost::log::record_view> &batch)
+    {
+        {
+            boost::log::aux::exclusive_lock_guard<backend_mutex_type> lock(m_BackendMutex);
+            boost::log::aux::fake_mutex fakeMutex;
+            for (auto &rec : batch) {
+                base_type::feed_record(rec, fakeMutex, *m_pBackend);
+            }
+        }
+        m_nBatches.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    static size_t get_message_size(boost::log::record_view const &rec)
+    {
+        auto &&message = boost::log::extract<std::string>(
+            boost::log::aux::default_attribute_names::message(), rec);
+        return message ? message.get().size() : 0;
+    }
+
+    /*!
+    * The record feeding loop, runs on the dedicated thread until \c stop is called.
+    * Records left in the queue at that point are still written, then the backend is flushed.
+    */
+    void run()
+    {
+        std::vector<boost::log::record_view> batch;
+        batch.reserve(m_options.m_nBatchSize);
+        TFormatJob *pJob = nullptr;
+
+        //上次flush之后写入的记录数、消息字节数及第一条的时间
+        size_t nPendingRecords = 0;
+        size_t nPendingBytes = 0;
+        clock_type::time_point firstPendingTime;
+
+        for (;;) {
+            //没有未flush的记录时一直等待，否则最多等到需要flush的时间
+            bool bTimed = (nPendingRecords != 0);
+            clock_type::time_point deadline;
+            if (bTimed) {
+                deadline =
+                    clock_type::now() + boost::chrono::milliseconds(m_options.m_nIdleFlushMs);
+                if (m_options.m_nMaxFlushDelayMs != 0) {
+                    auto maxDeadline = firstPendingTime +
+                                       boost::chrono::milliseconds(m_options.m_nMaxFlushDelayMs);
+                    if (maxDeadline < deadline) {
+                        deadline = maxDeadline;
+                    }
+                }
+            }
+
+            //取出一批记录写入后端，bDone表示已经停止并且全部写完
+            bool bDone = false;
+            batch.clear();
+            if (m_options.m_nFormatThreads == 0) {
+                dequeue_batch(batch, bTimed, deadline);
+                bDone = batch.empty() && m_StopRequested.load(boost::memory_order_acquire);
+                if (!batch.empty()) {
+                    feed_batch(batch);
+                }
+            } else {
+                pJob = wait_formatted_job(bTimed, deadline, bDone);
+                if (pJob) {
+                    commit_job(*pJob);
+                    batch.swap(pJob->m_records);
+                    release_job(pJob);
+                }
+            }
+
+            if (!batch.empty()) {
+                if (nPendingRecords == 0) {
+                    firstPendingTime = clock_type::now();
+                }
+                nPendingRecords += batch.size();
+                if (m_options.m_nFlushBytes != 0) {
+                    for (auto &rec : batch) {
+                        nPendingBytes += get_message_size(rec);
+                    }
+                }
+            }
+
+            bool bFlush = (nPendingRecords != 0) &&
+                          (batch.empty() ||
+                           (m_options.m_nFlushRecords != 0 &&
+                            nPendingRecords >= m_options.m_nFlushRecords) ||
+                           (m_options.m_nFlushBytes != 0 &&
+                            nPendingBytes >= m_options.m_nFlushBytes) ||
+                           (m_options.m_nMaxFlushDelayMs != 0 &&
+                            clock_type::now() - firstPendingTime >=
+                                boost::chrono::milliseconds(m_options.m_nMaxFlushDelayMs)));
+            if (bFlush) {
+                base_type::flush_backend(m_BackendMutex, *m_pBackend);
+                m_nFlushes.fetch_add(1, boost::memory_order_relaxed);
+                nPendingRecords = 0;
+                nPendingBytes = 0;
+            }
+
+            if (bDone) {
+                break;
+            }
+        }
+    }
+
+    //! Starts the formatting threads
+    void start_formatters(boost::mpl::true_)
+    {
+        if (m_options.m_nFormatThreads == 0) {
+            return;
+        }
+
+        //每个线程两个任务，一个格式化时另一个等待写入
+        size_t nJobs = m_options.m_nFormatThreads * 2;
+        m_Jobs.resize(nJobs);
+        m_DoneJobs.resize(nJobs, nullptr);
+        for (auto &spJob : m_Jobs) {
+            spJob.reset(new TFormatJob());
+            spJob->m_records.reserve(m_options.m_nBatchSize);
+            m_FreeJobs.push_back(spJob.get());
+        }
+        m_nActiveFormatters = m_options.m_nFormatThreads;
+        for (size_t i = 0; i < m_options.m_nFormatThreads; ++i) {
+            m_FormatThreads.emplace_back(boost::bind(&SimpleAsyncSink::run_formatter, this));
+        }
+    }
+
+    void start_formatters(boost::mpl::false_) {}
+
+    //! Calls the exception handler from a catch block, rethrows if there is none
+    void handle_exception()
+    {
+        boost::log::aux::shared_lock_guard<frontend_mutex_type> lock(base_type::frontend_mutex());
+        if (this->exception_handler().empty()) {
+            throw;
+        }
+        this->exception_handler()();
+    }
+
+    /*!
+    * The formatting loop. Takes a batch with a sequence number, formats it into the job buffers
+    * and hands it to the feeding thread. Exits when \c stop is called and the queue is empty.
+    */
+    void run_formatter()
+    {
+        typename base_type::formatter_type formatter;
+        typename base_type::stream_type stream;
+        for (;;) {
+            TFormatJob *pJob = nullptr;
+            {
+                boost::unique_lock<boost::mutex> lock(m_JobMutex);
+                while (m_FreeJobs.empty()) {
+                    m_FreeJobCond.wait(lock);
+                }
+                pJob = m_FreeJobs.back();
+                m_FreeJobs.pop_back();
+            }
+
+            pJob->m_records.clear();
+            dequeue_batch(pJob->m_records, false, clock_type::time_point(), &pJob->m_nSeq);
+            if (pJob->m_records.empty()) {
+                release_job(pJob);
+                break;
+            }
+
+            //复制一份formatter，set_formatter可以在任意时刻调用
+            {
+                boost::log::aux::shared_lock_guard<frontend_mutex_type> lock(
+                    base_type::frontend_mutex());
+                formatter = base_type::formatter();
+            }
+            stream.imbue(this->getloc());
+
+            auto &records = pJob->m_records;
+            auto &texts = pJob->m_texts;
+            texts.resize(records.size());
+            for (size_t i = 0; i < records.size();) {
+                texts[i].clear();
+                stream.attach(texts[i]);
+                try {
+                    formatter(records[i], stream);
+                    stream.flush();
+                    stream.detach();
+                    ++i;
+                } catch (...) {
+                    stream.detach();
+                    handle_exception();
+                    records.erase(records.begin() + i);
+                    texts.erase(texts.begin() + i);
+                }
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lock(m_JobMutex);
+                m_DoneJobs[pJob->m_nSeq % m_DoneJobs.size()] = pJob;
+                if (pJob->m_nSeq == m_nNextCommitSeq) {
+                    m_DoneJobCond.notify_one();
+                }
+            }
+        }
+
+        boost::lock_guard<boost::mutex> lock(m_JobMutex);
+        --m_nActiveFormatters;
+        m_DoneJobCond.notify_one();
+    }
+
+    /*!
+    * Waits for the job with the next sequence number. Returns \c NULL on timeout, or with
+    * \a bDone set when all formatting threads have exited and every job has been taken.
+    */
+    TFormatJob *wait_formatted_job(bool bTimed, clock_type::time_point deadline, bool &bDone)
+    {
+        boost::unique_lock<boost::mutex> lock(m_JobMutex);
+        size_t nSlot = m_nNextCommitSeq % m_DoneJobs.size();
+        while (!m_DoneJobs[nSlot]) {
+            if (m_nActiveFormatters == 0) {
+                bDone = true;
+                return nullptr;
+            }
+            if (!bTimed) {
+                m_DoneJobCond.wait(lock);
+            } else if (m_DoneJobCond.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                return nullptr;
+            }
+        }
+        TFormatJob *pJob = m_DoneJobs[nSlot];
+        m_DoneJobs[nSlot] = nullptr;
+        ++m_nNextCommitSeq;
+        return pJob;
+    }
+
+    //! Writes the formatted job under one backend lock
+    void commit_job(TFormatJob &job)
+    {
+        {
+            boost::log::aux::exclusive_lock_guard<backend_mutex_type> lock(m_BackendMutex);
+            commit_job_impl(job, typename is_formatting::type());
+        }
+        m_nBatches.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    void commit_job_impl(TFormatJob &job, boost::mpl::true_)
+    {
+        for (size_t i = 0; i < job.m_records.size(); ++i) {
+            try {
+                m_pBackend->consume(job.m_records[i], job.m_texts[i]);
+            } catch (...) {
+                handle_exception();
+            }
+        }
+    }
+
+    void commit_job_impl(TFormatJob &, boost::mpl::false_) {}
+
+    void release_job(TFormatJob *pJob)
+    {
+        boost::lock_guard<boost::mutex> lock(m_JobMutex);
+        m_FreeJobs.push_back(pJob);
+        m_FreeJobCond.notify_one();
+    }
+
+    /*!
+    * The method softly interrupts record feeding loop. This method must be called when the \c run
+    * method execution has to be interrupted. Unlike regular thread interruption, calling
+    * \c stop will not interrupt the record processing in the middle. Instead, the sink frontend
+    * will write the records already queued, flush the backend and return afterwards.
+    *
+    * \note Records that come after the queue has been drained are discarded.
+    */
+    void stop()
+    {
+        boost::unique_lock<frontend_mutex_type> lock(base_type::frontend_mutex());
+        if (m_DedicatedFeedingThread.joinable()) {
+            {
+                boost::lock_guard<boost::mutex> queueLock(m_QueueMutex);
+                m_StopRequested.store(true, boost::memory_order_release);
+                m_QueueCond.notify_all();
+                m_SpaceCond.notify_all();
+            }
+
+            lock.unlock();
+            for (auto &formatThread : m_FormatThreads) {
+                formatThread.join();
+            }
+            m_DedicatedFeedingThread.join();
+        }
+    }
+
+private:
+    //! Synchronization mutex
+    backend_mutex_type m_BackendMutex;
+    //! Pointer to the backend
+    const boost::shared_ptr<sink_backend_type> m_pBackend;
+
+    //! Queue size and flush policy
+    TAsyncSinkOptions m_options;
+
+    //! Record queue, protected by m_QueueMutex
+    mutable boost::mutex m_QueueMutex;
+    boost::condition_variable m_QueueCond;
+    std::deque<boost::log::record_view> m_Queue;
+    //! Signalled when records are taken, only used with block_on_overflow
+    boost::condition_variable m_SpaceCond;
+
+    //! Queue counters, protected by m_QueueMutex
+    TAsyncSinkStats m_stats;
+
+    //! Feeding counters, written by the feeding thread only
+    boost::atomic<uint64_t> m_nBatches{0};
+    boost::atomic<uint64_t> m_nFlushes{0};
+
+    //! Next sequence number for formatting threads, protected by m_QueueMutex
+    uint64_t m_nNextSeq = 0;
+
+    //! Formatting jobs, protected by m_JobMutex. m_DoneJobs is indexed by sequence number
+    boost::mutex m_JobMutex;
+    boost::condition_variable m_FreeJobCond;
+    boost::condition_variable m_DoneJobCond;
+    std::vector<std::unique_ptr<TFormatJob>> m_Jobs;
+    std::vector<TFormatJob *> m_FreeJobs;
+    std::vector<TFormatJob *> m_DoneJobs;
+    uint64_t m_nNextCommitSeq = 0;
+    size_t m_nActiveFormatters = 0;
+
+    //! Formatting threads, empty unless m_nFormatThreads > 1
+    std::vector<boost::thread> m_FormatThreads;
+
+    //! Dedicated record feeding thread
+    boost::thread m_DedicatedFeedingThread;
+
+    //! The flag indicates that the feeding loop has to be stopped
+    boost::atomic<bool> m_StopRequested;
+};
+
+SHARELIB_END_NAMESPACE
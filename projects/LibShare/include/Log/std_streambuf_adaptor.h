@@ -12,6 +12,10 @@ class fix_length_buf_adaptor : public std::basic_streambuf<_CharType, _Traits>
     using _BaseType = std::basic_streambuf<_CharType, _Traits>;
 
 public:
+    using char_type = typename _BaseType::char_type;
+    using pos_type = typename _BaseType::pos_type;
+    using off_type = typename _BaseType::off_type;
+
     fix_length_buf_adaptor() {}
 
     fix_length_buf_adaptor(char_type *pBuf, std::streamsize nSize)
@@ -19,9 +23,9 @@ public:
         _BaseType::pubsetbuf(pBuf, nSize);
     }
 
-    char_type *get_buffer() const { return pbase(); }
+    char_type *get_buffer() const { return _BaseType::pbase(); }
 
-    std::streamsize get_buffer_size() const { return epptr() - pbase(); }
+    std::streamsize get_buffer_size() const { return _BaseType::epptr() - _BaseType::pbase(); }
 
 protected:
     /** offer buffer to external agent
@@ -32,8 +36,8 @@ protected:
     {
         assert(pBuf);
         assert(nSize > 0);
-        setg(pBuf, pBuf, pBuf + nSize);
-        setp(pBuf, pBuf, pBuf + nSize);
+        _BaseType::setg(pBuf, pBuf, pBuf + nSize);
+        _BaseType::setp(pBuf, pBuf + nSize);
         return (this);
     }
 
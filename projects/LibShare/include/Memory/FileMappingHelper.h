@@ -17,22 +17,58 @@ class path;
 
 SHARELIB_BEGIN_NAMESPACE
 
+/** FileMappingHelper::View 返回的只读数据, 直接指向映射内存, 不复制.
+持有映射的引用计数, 多个View可以同时有效, FileMappingHelper析构后也仍然有效
+*/
+class FileMappingView
+{
+public:
+    FileMappingView() = default;
+
+    const char *data() const { return m_pData; }
+
+    size_t size() const { return m_nSize; }
+
+    bool empty() const { return m_nSize == 0; }
+
+private:
+    friend class FileMappingHelper;
+
+    std::shared_ptr<boost::interprocess::mapped_region> m_spRegion;
+    const char *m_pData = nullptr;
+    size_t m_nSize = 0;
+};
+
 /** 该类内部使用FileMapping进行读写文件, 相比直接对文件读写, 速度快得多!
-并且每次读写只映射文件的一部分, 而不是整个的文件, 因此内存占用也很小;
-限制: 文件大小固定, 在传给该类之前已经固定好, 读、写都不能越界
+读、写各保持一个映射窗口, 位置离开窗口时才重新映射, 因此内存占用也有上限;
+读窗口提示系统顺序预读, 写窗口换出时异步回写;
+限制: 文件大小固定, 在传给该类之前已经固定好, 读、写都不能越界;
+可扩展模式下写入超出文件大小时按窗口大小扩展文件, 析构时截断到实际写入的大小
 */
 class FileMappingHelper : private boost::noncopyable
 {
 public:
+    enum : size_t
+    {
+        //默认的映射窗口大小
+        DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024,
+    };
+
     /** 构造函数
     @param[in] pFile 文件，如果映射失败抛出异常
+    @param[in] nWindowSize 读、写窗口各自的大小，按系统的映射粒度对齐
+    @param[in] bGrowable 是否可扩展，是则文件不存在时创建
     */
-    explicit FileMappingHelper(const wchar_t *pFile);
-    explicit FileMappingHelper(const char *pFile);
+    explicit FileMappingHelper(const wchar_t *pFile,
+                               size_t nWindowSize = DEFAULT_WINDOW_SIZE,
+                               bool bGrowable = false);
+    explicit FileMappingHelper(const char *pFile,
+                               size_t nWindowSize = DEFAULT_WINDOW_SIZE,
+                               bool bGrowable = false);
 
     ~FileMappingHelper();
 
-    /** 获取文件大小
+    /** 获取文件大小, 可扩展模式下为实际写入的大小
     */
     uint64_t GetFileSize();
 
@@ -59,7 +95,8 @@ public:
 
     //----读写操作-----------------------------------------------------
 
-    /** 写入数据,会自动更新写入位置.文件需要有 GENERIC_READ | GENERIC_WRITE 属性
+    /** 写入数据,会自动更新写入位置.文件需要有 GENERIC_READ | GENERIC_WRITE 属性.
+    可扩展模式下可以写到文件结尾之后
     @param[in] pBits 数据指针
     @param[in] nBytes 数据大小
     @return 是否成功，如果失败，一个字节也不会写入
@@ -73,8 +110,15 @@ public:
     */
     size_t ReadBytes(void *pBuffer, size_t bufferSize);
 
+    /** 获取只读数据, 不复制, 不影响读写位置. 连续的View共享同一个窗口大小的映射
+    @param[in] offset 偏移,从文件开头算起
+    @param[in] nBytes 数据大小
+    @return 越界或失败时返回空的View
+    */
+    FileMappingView View(uint64_t offset, size_t nBytes);
+
     /** 获取内存指针用于读写, 文件需要有 GENERIC_READ | GENERIC_WRITE 属性.
-    注意: LockBits之后不要再次LockBits、WriteBytes或者ReadBytes,他们都会导致前一次获取的内存指针失效.
+    注意: LockBits之后不要再次LockBits,会导致前一次获取的内存指针失效.
     @param[in] offset 偏移,从文件开头算起
     @param[in] nLockBytes 内存块大小,如果实际可操作内存小于该值，返回nullptr
     @return 内存指针,大小等于nLockBytes, 失败返回nullptr
@@ -86,10 +130,34 @@ public:
     void UnLockBits();
 
 private:
+    /** 映射窗口, 覆盖文件的[m_nBegin, m_nEnd)
+    */
+    struct TWindow
+    {
+        std::unique_ptr<boost::interprocess::mapped_region> m_spRegion;
+        uint64_t m_nBegin = 0;
+        uint64_t m_nEnd = 0;
+    };
+
     /** 初始化
     @param[in] filePath 文件路径
+    @param[in] nWindowSize 窗口大小
     */
-    void Init(const boost::filesystem::path &filePath);
+    void Init(const boost::filesystem::path &filePath, size_t nWindowSize, bool bGrowable);
+
+    /** 可扩展模式下确保文件至少有endPos大小
+    @return 不可扩展且超出大小, 或者扩展失败时返回false
+    */
+    bool GrowFile(uint64_t endPos);
+
+    /** 确保窗口包含[pos, pos + nBytes), 不包含时从pos所在的对齐位置重新映射
+    @param[in,out] window 读或写窗口
+    @param[in] pos 文件位置
+    @param[in] nBytes 数据大小, pos + nBytes不能超过文件大小
+    @param[in] bWrite 是否是写窗口
+    @return 指向pos的内存指针, 失败返回nullptr
+    */
+    char *MapWindow(TWindow &window, uint64_t pos, size_t nBytes, bool bWrite);
 
     /** 定位
     @param[in,out] prevSize 更新之前的大小
@@ -102,10 +170,37 @@ private:
     */
     std::unique_ptr<boost::interprocess::file_mapping> m_spFileMapping;
 
-    /** 文件映射
+    /** 文件路径, 可扩展模式下用于截断文件
+    */
+    std::unique_ptr<boost::filesystem::path> m_spFilePath;
+
+    /** LockBits的文件映射
     */
     std::unique_ptr<boost::interprocess::mapped_region> m_spMappedRegion;
 
+    /** 读、写窗口
+    */
+    TWindow m_readWindow;
+    TWindow m_writeWindow;
+
+    /** View共享的映射, 覆盖文件的[m_viewBegin, m_viewEnd)
+    */
+    std::shared_ptr<boost::interprocess::mapped_region> m_spViewRegion;
+    uint64_t m_viewBegin;
+    uint64_t m_viewEnd;
+
+    /** 窗口大小, 也是可扩展模式下每次扩展的大小
+    */
+    size_t m_nWindowSize;
+
+    /** 是否可扩展
+    */
+    bool m_bGrowable;
+
+    /** 磁盘上的文件大小, 可扩展模式下大于等于m_fileSize
+    */
+    uint64_t m_fileCapacity;
+
     /** 文件大小
     */
     uint64_t m_fileSize;
@@ -0,0 +1,177 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include "MacroDefBase.h"
+#include "Memory/std_allocator_adaptor.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+/*!
+ * \class MonotonicArena
+ * \brief 单调增长的内存区，满足 IRealAlloc 的要求，非多线程安全
+ 从链接起来的块中顺序切分(只移动指针)，Free什么都不做，内存在 Reset 时一次性回收.
+ Reset 不归还普通块，只把分配位置移回第一块，之后的分配依次复用已有的块，因此是O(1)的;
+ 超过块大小1/4的请求单独向系统申请，Reset 时归还.
+ 适合一次请求内大量创建、请求结束时整体丢弃的临时对象(解析的json、临时容器等).
+ 对象的析构函数不会被调用，只能存放不需要析构、或者析构函数没有副作用的对象
+ */
+class MonotonicArena
+{
+    SHARELIB_DISABLE_COPY_CLASS(MonotonicArena);
+
+public:
+    enum : size_t
+    {
+        //默认的块大小
+        DEFAULT_BLOCK_SIZE = 64 * 1024,
+
+        //默认的对齐，与系统堆相同
+        DEFAULT_ALIGNMENT = alignof(std::max_align_t),
+    };
+
+    //分配位置，用于 Rewind
+    struct TMarker
+    {
+        void *m_pBlock = nullptr;
+        char *m_pPos = nullptr;
+        void *m_pLargeBlock = nullptr;
+    };
+
+    /** 构造函数，不会立即申请内存
+    @param[in] nBlockSize 每块的大小
+    */
+    explicit MonotonicArena(size_t nBlockSize = DEFAULT_BLOCK_SIZE);
+    ~MonotonicArena();
+
+    /** 分配内存
+    @param[in] nBytes 字节数
+    @param[in] nAlign 对齐，必须是2的幂
+    @return 失败返回nullptr
+    */
+    void *Allocate(size_t nBytes, size_t nAlign = DEFAULT_ALIGNMENT) throw()
+    {
+        char *p = (char *)(((uintptr_t)m_pPos + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+        if (p < m_pEnd && nBytes <= (size_t)(m_pEnd - p)) {
+            m_pPos = p + nBytes;
+            return p;
+        }
+        return AllocateSlow(nBytes, nAlign);
+    }
+
+    /** 什么都不做，内存在 Reset 时回收
+    */
+    void Free(void *) throw() {}
+
+    /** 改变大小. 如果p是最后一次分配的内存并且当前块足够，原地扩展，否则分配新内存并复制
+    @param[in] p 原内存，可以为nullptr
+    @param[in] nOldBytes 原大小
+    @param[in] nNewBytes 新大小
+    @return 失败返回nullptr，原内存不变
+    */
+    void *Reallocate(void *p, size_t nOldBytes, size_t nNewBytes) throw();
+
+    /** 回收全部内存. 普通块保留下来供之后的分配复用，单独申请的大块归还给系统
+    */
+    void Reset() throw();
+
+    /** 回收全部内存并归还所有的块
+    */
+    void Release() throw();
+
+    /** 获取当前的分配位置
+    */
+    TMarker GetMarker() const;
+
+    /** 回收marker之后分配的内存
+    @param[in] marker 之前由 GetMarker 获取，之间不能调用 Reset/Release 或者Rewind到更早的位置
+    */
+    void Rewind(const TMarker &marker) throw();
+
+    /** 向系统申请的总字节数
+    */
+    size_t GetReservedBytes() const
+    {
+        return m_nReservedBytes;
+    }
+
+    /** 分配并构造对象，对象不需要释放，见 monotonic_destroy
+    @return 分配失败抛出std::bad_alloc
+    */
+    template<class T, class... TArgs>
+    T *New(TArgs &&... args)
+    {
+        void *p = Allocate(sizeof(T), alignof(T));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return ::new (p) T(std::forward<TArgs>(args)...);
+    }
+
+private:
+    struct TBlock;
+
+    void *AllocateSlow(size_t nBytes, size_t nAlign) throw();
+    void *AllocateLarge(size_t nBytes, size_t nAlign) throw();
+    void FreeLargeBlocks(TBlock *pStop) throw();
+    void SetCurrentBlock(TBlock *pBlock);
+
+private:
+    //当前块的分配位置及结尾
+    char *m_pPos = nullptr;
+    char *m_pEnd = nullptr;
+
+    //普通块的链表，m_pCurrent之后的块已被Reset，等待复用
+    TBlock *m_pFirst = nullptr;
+    TBlock *m_pCurrent = nullptr;
+
+    //单独申请的大块，后申请的在前
+    TBlock *m_pLarge = nullptr;
+
+    size_t m_nBlockSize = 0;
+    size_t m_nReservedBytes = 0;
+};
+
+/** 作用域结束时回收作用域内从arena分配的内存
+*/
+class MonotonicArenaScope
+{
+    SHARELIB_DISABLE_COPY_CLASS(MonotonicArenaScope);
+
+public:
+    explicit MonotonicArenaScope(MonotonicArena &arena)
+        : m_arena(arena)
+        , m_marker(arena.GetMarker())
+    {}
+
+    ~MonotonicArenaScope()
+    {
+        m_arena.Rewind(m_marker);
+    }
+
+private:
+    MonotonicArena &m_arena;
+    MonotonicArena::TMarker m_marker;
+};
+
+//用MonotonicArena分配的标准分配器，arena的生命周期要长于容器
+//如 std::vector<int, arena_allocator<int>> v(arena_allocator<int>(arena));
+template<class T>
+using arena_allocator = std_allocator_ref_adaptor<T, MonotonicArena>;
+
+/** 只析构不释放，可用作 MonotonicArena::New 创建的对象的删除器
+*/
+struct monotonic_destroy
+{
+    template<class T>
+    void operator()(T *p) const
+    {
+        if (p) {
+            p->~T();
+        }
+    }
+};
+
+SHARELIB_END_NAMESPACE
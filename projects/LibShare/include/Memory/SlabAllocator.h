@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+#include "MacroDefBase.h"
+#include "Memory/std_allocator_adaptor.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+//一个分级的统计
+struct TSlabClassStats
+{
+    //每块可用的字节数
+    size_t m_nBlockSize = 0;
+
+    //调用者正在使用的块数及字节数
+    size_t m_nBlocksInUse = 0;
+    size_t m_nBytesInUse = 0;
+
+    //该分级向系统申请的字节数，不会归还
+    size_t m_nBytesReserved = 0;
+};
+
+//整个分配器的统计
+struct TSlabStats
+{
+    //按块大小从小到大
+    std::vector<TSlabClassStats> m_classes;
+
+    //超出最大分级、直接从系统堆分配的块数及字节数
+    size_t m_nLargeBlocks = 0;
+    size_t m_nLargeBytes = 0;
+};
+
+/*!
+ * \class SlabAllocator
+ * \brief 按大小分级的slab分配器，满足 IRealAlloc 的要求，所有接口都是静态的、多线程安全
+ 不超过 MAX_SMALL_SIZE 的请求按16字节、再按每2倍分4级向上取整，从64K的slab中切分;
+ 每个线程按分级缓存空闲块，分配、释放只操作本线程的链表，缓存空了或超出上限时才与
+ 全局链表成批交换(加锁). 任意线程都可以释放，块进入释放线程的缓存.
+ slab从不归还给系统，适合数量多、生命周期短的小对象(容器结点、队列的页等).
+ 更大的请求直接从系统堆分配. 每块前有16字节的头部记录分级
+ */
+class SlabAllocator
+{
+public:
+    enum : size_t
+    {
+        //分级的最大大小
+        MAX_SMALL_SIZE = 4096,
+    };
+
+    /** 分配内存，对齐与系统堆相同
+    @return 失败返回nullptr
+    */
+    static void *Allocate(size_t nBytes) throw();
+
+    /** 释放Allocate返回的内存，可以在任意线程调用
+    */
+    static void Free(void *p) throw();
+
+    /** 统计各分级的使用情况. 正在使用的块数由每个线程分别计数，统计时累加，不影响分配的速度
+    */
+    static void GetStats(TSlabStats &stats);
+};
+
+//用SlabAllocator分配的标准分配器，可用于stl容器及 lockfree_queue 的 _Alloc.
+//SlabAllocator没有状态，用无状态的适配器，复制、rebind没有开销
+template<class T>
+using slab_allocator = std_allocator_singleton_adaptor<T, SlabAllocator>;
+
+/** 用SlabAllocator分配并构造对象
+@return 分配失败抛出std::bad_alloc
+*/
+template<class T, class... TArgs>
+T *slab_new(TArgs &&... args)
+{
+    void *p = SlabAllocator::Allocate(sizeof(T));
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    try {
+        return ::new (p) T(std::forward<TArgs>(args)...);
+    } catch (...) {
+        SlabAllocator::Free(p);
+        throw;
+    }
+}
+
+/** 析构并释放slab_new创建的对象，可用作 tree_node::destroy_tree_node 等的删除器
+*/
+struct slab_delete
+{
+    template<class T>
+    void operator()(T *p) const
+    {
+        if (p) {
+            p->~T();
+            SlabAllocator::Free(p);
+        }
+    }
+};
+
+SHARELIB_END_NAMESPACE
@@ -1,10 +1,16 @@
 ﻿#pragma once
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include "MacroDefBase.h"
 
 SHARELIB_BEGIN_NAMESPACE
 
+/* 以下函数每个线程缓存压缩、解压对象，不会每次调用都初始化zlib;
+长度超过uint32_t或需要分段输入时使用 Compressor、Decompressor
+*/
+
 /** zlib方式压缩数据
 @param[in] pInput 原数据
 @param[in] nLength 原数据长度
@@ -57,7 +63,7 @@ bool gzip_compress_data(const void *pInput,
                         uint32_t &nOutLength,
                         int nLevel = 6);
 
-/** 解压数据，支持zlib 和 gzip
+/** 解压数据，支持zlib、gzip 及 compress_data 带帧头的数据(brotli、不压缩)
 @param[in] pInput 数据
 @param[in] nLength 原数据长度
 @param[out] output 压缩后数据
@@ -65,7 +71,7 @@ bool gzip_compress_data(const void *pInput,
 */
 bool decompress_data(const void *pInput, uint32_t nLength, std::vector<uint8_t> &output);
 
-/** 解压数据，支持zlib 和 gzip
+/** 解压数据，支持zlib、gzip 及 compress_data 带帧头的数据(brotli、不压缩)
 @param[in] pInput 数据
 @param[in] nLength 原数据长度
 @param[out] pOutput 输出缓冲区
@@ -74,4 +80,202 @@ bool decompress_data(const void *pInput, uint32_t nLength, std::vector<uint8_t>
 */
 bool decompress_data(const void *pInput, uint32_t nLength, void *pOutput, uint32_t &nOutLength);
 
+//----------------------------------------------------------------------
+
+//压缩格式
+enum class TCompressFormat
+{
+    ZLIB,
+    GZIP,
+};
+
+/** 流式压缩. z_stream在多个数据流之间复用, 一个流结束后用deflateReset开始下一个,
+不重新分配zlib的内部状态; 数据可以分多次输入, 长度不受uint32_t限制. 非多线程安全
+*/
+class Compressor
+{
+    SHARELIB_DISABLE_COPY_CLASS(Compressor);
+
+public:
+    /** 构造函数
+    @param[in] format 压缩格式
+    @param[in] nLevel 0~9,0表示不压缩,1表示速度最快,9表示压缩率最高,-1表示默认(6)
+    */
+    explicit Compressor(TCompressFormat format = TCompressFormat::ZLIB, int nLevel = 6);
+
+    ~Compressor();
+
+    /** zlib是否初始化成功, 失败时其它操作都返回false
+    */
+    bool IsValid() const;
+
+    /** 输入一段数据, 压缩结果追加到output末尾
+    @param[in] pInput 数据
+    @param[in] nLength 数据长度
+    @param[in,out] output 输出
+    @param[in] bFinish 是否是当前流的最后一段, 是则结束当前流, 之后的输入属于新的流
+    @return 是否成功, 失败时放弃当前流
+    */
+    bool Push(const void *pInput,
+              size_t nLength,
+              std::vector<uint8_t> &output,
+              bool bFinish = false);
+
+    /** 结束当前流, 剩余的压缩结果追加到output末尾
+    */
+    bool Finish(std::vector<uint8_t> &output);
+
+    /** 压缩一段完整的数据, 按deflateBound预先分配输出, 只调用一次deflate
+    @param[in] pInput 数据
+    @param[in] nLength 数据长度
+    @param[out] output 压缩后数据
+    @return 是否成功
+    */
+    bool Compress(const void *pInput, size_t nLength, std::vector<uint8_t> &output);
+
+    /** 压缩一段完整的数据到外部缓冲区
+    @param[in,out] nOutLength in:输出缓冲区的大小，out:返回true时表示压缩后数据大小，否则保持不变
+    @return 是否成功,输出空间不够也返回false
+    */
+    bool Compress(const void *pInput, size_t nLength, void *pOutput, size_t &nOutLength);
+
+    /** 放弃当前流
+    */
+    void Reset();
+
+    /** 压缩nLength字节后数据大小的上限, 用于预先分配输出
+    */
+    size_t Bound(size_t nLength);
+
+private:
+    struct TImpl;
+    std::unique_ptr<TImpl> m_spImpl;
+};
+
+/** 流式解压, 自动识别zlib和gzip. z_stream在多个数据流之间复用(inflateReset).
+多个连续的流(如多个gzip成员)依次解压; 流结束后不是有效流的剩余数据被忽略. 非多线程安全
+*/
+class Decompressor
+{
+    SHARELIB_DISABLE_COPY_CLASS(Decompressor);
+
+public:
+    Decompressor();
+
+    ~Decompressor();
+
+    /** zlib是否初始化成功, 失败时其它操作都返回false
+    */
+    bool IsValid() const;
+
+    /** 输入一段压缩数据, 解压结果追加到output末尾
+    @return 数据错误时返回false, 之后需要Reset
+    */
+    bool Push(const void *pInput, size_t nLength, std::vector<uint8_t> &output);
+
+    /** 已输入的数据是否以完整的流结束
+    */
+    bool IsFinished() const;
+
+    /** 解压一段完整的压缩数据
+    @param[out] output 解压后数据
+    @return 是否成功, 数据不完整也返回false
+    */
+    bool Decompress(const void *pInput, size_t nLength, std::vector<uint8_t> &output);
+
+    /** 解压一段完整的压缩数据到外部缓冲区
+    @param[in,out] nOutLength in:输出缓冲区的大小，out:返回true时表示解压后数据大小，否则保持不变
+    @return 是否成功,输出空间不够也返回false
+    */
+    bool Decompress(const void *pInput, size_t nLength, void *pOutput, size_t &nOutLength);
+
+    /** 放弃已输入的数据, 开始新的流
+    */
+    void Reset();
+
+private:
+    struct TImpl;
+    std::unique_ptr<TImpl> m_spImpl;
+};
+
+/** 并行压缩(同pigz的方式): 数据分块后在多个线程上分别压缩, 每块用前一块末尾的32K数据做字典,
+结果拼接成一个标准的gzip或zlib流, 校验值用crc32_combine/adler32_combine合并, 可以用decompress_data、
+Decompressor解压. 数据不足两块时在当前线程压缩
+@param[in] pInput 原数据
+@param[in] nLength 原数据长度
+@param[out] output 压缩后数据
+@param[in] format 压缩格式
+@param[in] nLevel 0~9,0表示不压缩,1表示速度最快,9表示压缩率最高
+@param[in] nThreads 线程数(包括当前线程), 0表示CPU核数
+@param[in] nBlockSize 分块大小, 小于64K时按64K
+@return 是否成功
+*/
+bool parallel_compress_data(const void *pInput,
+                            size_t nLength,
+                            std::vector<uint8_t> &output,
+                            TCompressFormat format = TCompressFormat::GZIP,
+                            int nLevel = 6,
+                            unsigned int nThreads = 0,
+                            size_t nBlockSize = 1024 * 1024);
+
+//----------------------------------------------------------------------
+
+//编码方式
+enum class TCompressCodec : uint8_t
+{
+    STORE = 0,  //不压缩
+    ZLIB = 1,   //zlib
+    GZIP = 2,   //gzip
+    BROTLI = 3, //brotli, 文本的压缩率明显高于zlib, 解压速度相近
+};
+
+/* 以下函数按编码压缩, 结果都可以用 decompress_data 解压.
+zlib、gzip输出标准的流, 本身可以识别; brotli和不压缩时数据前加8字节的帧头:
+2字节标识(0xB5 0x43) + 1字节编码 + 1字节保留(0) + 4字节原数据长度(小端),
+标识的第一个字节不可能是zlib或gzip流的开头
+*/
+
+/** 按指定编码压缩数据
+@param[in] pInput 原数据
+@param[in] nLength 原数据长度
+@param[out] output 压缩后数据
+@param[in] codec 编码
+@param[in] nLevel 压缩级别, -1表示默认. zlib、gzip为0~9, 默认6; brotli为0~11, 默认5; 不压缩时忽略
+@return 是否成功
+*/
+bool compress_data(const void *pInput,
+                   uint32_t nLength,
+                   std::vector<uint8_t> &output,
+                   TCompressCodec codec,
+                   int nLevel = -1);
+
+/** 按指定编码压缩数据
+@param[in] pInput 原数据
+@param[in] nLength 原数据长度
+@param[out] pOutput 输出缓冲区, 大小为 compress_bound 时一定足够
+@param[in,out] nOutLength in:输出缓冲区的大小，out:返回true时表示压缩后数据大小，否则保持不变
+@param[in] codec 编码
+@param[in] nLevel 同上
+@return 是否成功,输出空间不够也返回false
+*/
+bool compress_data(const void *pInput,
+                   uint32_t nLength,
+                   void *pOutput,
+                   uint32_t &nOutLength,
+                   TCompressCodec codec,
+                   int nLevel = -1);
+
+/** 按指定编码压缩nLength字节后数据大小的上限(包括帧头)
+@return 超出uint32_t时返回0
+*/
+uint32_t compress_bound(uint32_t nLength, TCompressCodec codec);
+
+/** 识别压缩数据的编码, 只检查开头的几个字节
+@param[in] pInput 数据
+@param[in] nLength 数据长度
+@param[out] codec 编码
+@return 不是可识别的数据返回false
+*/
+bool detect_compress_codec(const void *pInput, uint32_t nLength, TCompressCodec &codec);
+
 SHARELIB_END_NAMESPACE
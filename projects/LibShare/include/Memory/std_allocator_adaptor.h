@@ -12,7 +12,7 @@ SHARELIB_BEGIN_NAMESPACE
 /*!
  * \class IRealAlloc
  * \brief 实现的分配器传给std_allocator_adaptor的第二个模板参数,分配器必须提供如下几个接口
-          ATL中的分配器 IAtlMemMgr 就可以满足条件
+          ATL中的分配器 IAtlMemMgr 就可以满足条件, 通用的实现见 SlabAllocator
 */
 class IRealAlloc
 {
@@ -27,6 +27,8 @@ public:
  * \brief std_allocator_adaptor是符合C++标准的内存分配器的适配接口,
           _ValueType:要分配的实际数据类型,
           _RealAllocType:需要提供实际的内存分配器类型
+          用shared_ptr持有实际分配器, 每次复制、rebind都有原子操作; 分配器的生命周期由调用者管理时
+          用 std_allocator_ref_adaptor, 分配器全局唯一时用 std_allocator_singleton_adaptor
  */
 
 struct init_alloc_t
@@ -123,7 +125,7 @@ public:
     void deallocate(pointer pAddress, size_type /*uCount*/) { m_spAlloc->Free(pAddress); }
 
 private:
-    template<class _ValueType, class AllocType>
+    template<class _OtherType, class _OtherAlloc>
     friend class std_allocator_adaptor;
 
     std::shared_ptr<AllocType> m_spAlloc;
@@ -153,6 +155,196 @@ inline bool operator!=(const std_allocator_adaptor<_Ty, _RealAlloc> &_Left,
     return (!(_Left == _Right));
 }
 
+//-----------------------------------------
+/*!
+ * \class std_allocator_ref_adaptor
+ * \brief 持有实际分配器指针的适配器, 不负责分配器的生命周期, 调用者保证它比所有使用它的容器都长.
+          复制、rebind只复制指针, 没有std_allocator_adaptor中shared_ptr的原子操作和引用计数.
+          指向同一个分配器的适配器相等, 容器交换、赋值时适配器随数据一起传递.
+          没有可用的默认构造, 容器及 lockfree_queue 必须显式传入适配器, 如
+          lockfree_queue<T, Adaptor> queue(0, Adaptor(arena));
+ */
+template<class _ValueType, class _RealAllocType>
+class std_allocator_ref_adaptor
+{
+public:
+    using value_type = std::remove_const_t<_ValueType>;
+    using pointer = value_type *;
+    using const_pointer = const value_type *;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    using AllocType = _RealAllocType;
+
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template<class _Other>
+    struct rebind
+    {
+        typedef std_allocator_ref_adaptor<_Other, AllocType> other;
+    };
+
+    //默认构造只用于在使用处给出明确的编译错误, 容器的默认构造会用到它
+    template<class _Dummy = void>
+    std_allocator_ref_adaptor()
+        : m_pAlloc(nullptr)
+    {
+        static_assert(!std::is_same<_Dummy, _Dummy>::value,
+                      "std_allocator_ref_adaptor has no default allocator, "
+                      "pass an adaptor bound to an arena to the container constructor");
+    }
+
+    explicit std_allocator_ref_adaptor(AllocType &alloc) throw()
+        : m_pAlloc(&alloc)
+    {}
+
+    template<typename _Tp1>
+    std_allocator_ref_adaptor(const std_allocator_ref_adaptor<_Tp1, AllocType> &alloc2) throw()
+        : m_pAlloc(alloc2.m_pAlloc)
+    {}
+
+    AllocType &get_alloc() const { return *m_pAlloc; }
+
+    size_type max_size() const { return ((size_type)(-1) / sizeof(value_type)); }
+
+    pointer allocate(size_type nCount)
+    {
+        auto p = static_cast<pointer>(m_pAlloc->Allocate(nCount * sizeof(value_type)));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void deallocate(pointer pAddress, size_type /*uCount*/) { m_pAlloc->Free(pAddress); }
+
+    //lockfree_queue 等直接调用
+    template<class _Ty, class... _Types>
+    void construct(_Ty *pAddress, _Types &&... args)
+    {
+        ::new ((void *)pAddress) _Ty(std::forward<_Types>(args)...);
+    }
+
+    template<class _Ty>
+    void destroy(_Ty *pAddress)
+    {
+        pAddress->~_Ty();
+    }
+
+private:
+    template<class _OtherType, class _OtherAlloc>
+    friend class std_allocator_ref_adaptor;
+
+    AllocType *m_pAlloc;
+};
+
+template<class _Ty, class _Other, class _RealAlloc>
+inline bool operator==(const std_allocator_ref_adaptor<_Ty, _RealAlloc> &_Left,
+                       const std_allocator_ref_adaptor<_Other, _RealAlloc> &_Right)
+{
+    return (&_Left.get_alloc() == &_Right.get_alloc());
+}
+
+template<class _Ty, class _Other, class _RealAlloc>
+inline bool operator!=(const std_allocator_ref_adaptor<_Ty, _RealAlloc> &_Left,
+                       const std_allocator_ref_adaptor<_Other, _RealAlloc> &_Right)
+{
+    return (!(_Left == _Right));
+}
+
+//-----------------------------------------
+/** std_allocator_singleton_adaptor 使用的实际分配器, 每种类型一个, 与value_type无关,
+rebind前后使用同一个. 第一次使用时创建, 从不销毁, 因此静态对象析构时仍可以释放
+*/
+template<class _RealAllocType>
+struct std_allocator_singleton
+{
+    static _RealAllocType &get()
+    {
+        static _RealAllocType *s_pAlloc = new _RealAllocType;
+        return *s_pAlloc;
+    }
+};
+
+/*!
+ * \class std_allocator_singleton_adaptor
+ * \brief 无状态的适配器, 所有实例共用 std_allocator_singleton 中的实际分配器.
+          适配器本身不占空间, 复制、rebind没有任何开销.
+          接口都是静态函数的分配器(如 SlabAllocator)最适合这种方式
+ */
+template<class _ValueType, class _RealAllocType>
+class std_allocator_singleton_adaptor
+{
+public:
+    using value_type = std::remove_const_t<_ValueType>;
+    using pointer = value_type *;
+    using const_pointer = const value_type *;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    using AllocType = _RealAllocType;
+
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    template<class _Other>
+    struct rebind
+    {
+        typedef std_allocator_singleton_adaptor<_Other, AllocType> other;
+    };
+
+    std_allocator_singleton_adaptor() throw() {}
+
+    template<typename _Tp1>
+    std_allocator_singleton_adaptor(
+        const std_allocator_singleton_adaptor<_Tp1, AllocType> &) throw()
+    {}
+
+    static AllocType &get_alloc() { return std_allocator_singleton<AllocType>::get(); }
+
+    size_type max_size() const { return ((size_type)(-1) / sizeof(value_type)); }
+
+    pointer allocate(size_type nCount)
+    {
+        auto p = static_cast<pointer>(get_alloc().Allocate(nCount * sizeof(value_type)));
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void deallocate(pointer pAddress, size_type /*uCount*/) { get_alloc().Free(pAddress); }
+
+    //lockfree_queue 等直接调用
+    template<class _Ty, class... _Types>
+    void construct(_Ty *pAddress, _Types &&... args)
+    {
+        ::new ((void *)pAddress) _Ty(std::forward<_Types>(args)...);
+    }
+
+    template<class _Ty>
+    void destroy(_Ty *pAddress)
+    {
+        pAddress->~_Ty();
+    }
+};
+
+template<class _Ty, class _Other, class _RealAlloc>
+inline bool operator==(const std_allocator_singleton_adaptor<_Ty, _RealAlloc> &,
+                       const std_allocator_singleton_adaptor<_Other, _RealAlloc> &)
+{
+    return (true);
+}
+
+template<class _Ty, class _Other, class _RealAlloc>
+inline bool operator!=(const std_allocator_singleton_adaptor<_Ty, _RealAlloc> &,
+                       const std_allocator_singleton_adaptor<_Other, _RealAlloc> &)
+{
+    return (false);
+}
+
 /* C++11中的内存分配器只需要满足以下几个条件即可：
 1. 定义value_type类型别名；
 2. allocate 接口： pointer allocate (std::size_t)
@@ -212,12 +404,12 @@ struct alloc_wrapper : public _Alloc
 
     pointer address(reference _Val) const
     { // return address of mutable _Val
-        return (_STD addressof(_Val));
+        return (std::addressof(_Val));
     }
 
     const_pointer address(const_reference _Val) const
     { // return address of nonmutable _Val
-        return (_STD addressof(_Val));
+        return (std::addressof(_Val));
     }
 
     alloc_wrapper() throw()
@@ -289,7 +481,7 @@ struct alloc_wrapper : public _Alloc
     template<class _Ty, class... _Types>
     void construct(_Ty *_Ptr, _Types &&... _Args)
     { // construct _Ty(_Types...) at _Ptr
-        _Mytraits::construct(*this, _Ptr, _STD forward<_Types>(_Args)...);
+        _Mytraits::construct(*this, _Ptr, std::forward<_Types>(_Args)...);
     }
 
     template<class _Ty>
@@ -1,15 +1,79 @@
 ﻿#pragma once
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <type_traits>
 #include "MacroDefBase.h"
 
 SHARELIB_BEGIN_NAMESPACE
 
+/* lockfree_queue的内存布局策略
+_CacheLineSize: 生产者和消费者各自修改的数据之间至少间隔这么多字节，避免伪共享;
+                0表示紧凑布局，不填充. 开启了相邻缓存行预取的CPU上可以取128
+_PadFlags: 页内每个数据的写入标记是否也单独间隔_CacheLineSize字节，页会变大很多
+*/
+template<size_t _CacheLineSize, bool _PadFlags = false>
+struct lockfree_queue_layout
+{
+    static constexpr size_t CACHE_LINE_SIZE = _CacheLineSize;
+    static constexpr bool PAD_FLAGS = _PadFlags;
+};
+
+using lockfree_compact_layout = lockfree_queue_layout<0>;
+using lockfree_padded_layout = lockfree_queue_layout<64>;
+
+//填充_Size个字节，为0时是空结构体
+template<size_t _Size>
+struct cache_line_padding
+{
+    char m_padding[_Size];
+};
+
+template<>
+struct cache_line_padding<0>
+{};
+
+/* lockfree_queue的并发模式
+_SingleProducer: 只有一个线程写入. 写入索引用普通的读写代替原子的读改写，数据写完后才发布索引，不再需要写入标记
+_SingleConsumer: 只有一个线程读取. 读取索引用普通的读写代替CAS，不再等待其它读取者换页
+两者都为true时只用一个子队列，读写各自缓存对方的索引，只在缓存用完时才读取共享的索引
+_Waitable: 是否可以用push_wait/pop_wait挂起等待. 为false时push/pop不再检查等待者，
+           单写/单读时也省去每次写入/读取后的内存屏障
+*/
+template<bool _SingleProducer, bool _SingleConsumer, bool _Waitable = true>
+struct lockfree_queue_mode
+{
+    static constexpr bool SINGLE_PRODUCER = _SingleProducer;
+    static constexpr bool SINGLE_CONSUMER = _SingleConsumer;
+    static constexpr bool WAITABLE = _Waitable;
+};
+
+using lockfree_mpmc = lockfree_queue_mode<false, false>;
+using lockfree_mpsc = lockfree_queue_mode<false, true>;
+using lockfree_spsc = lockfree_queue_mode<true, true>;
+
+//不挂起等待的并发模式，如 lockfree_nowait<lockfree_spsc>
+template<class _Mode>
+using lockfree_nowait = lockfree_queue_mode<_Mode::SINGLE_PRODUCER, _Mode::SINGLE_CONSUMER, false>;
+
 /* 无锁并行队列，实测比boost的无锁队列快大约3倍
+可以指定容量上限(有界模式)，配合push_wait/pop_wait使用时，队列满/空时线程会挂起等待，而不是自旋。
+只有存在等待者时，push/pop才会加锁通知，不等待时的开销与无界模式基本相同。
+不需要等待时用 lockfree_nowait 的并发模式，push/pop不再检查等待者。
+读完的页不直接释放，而是放入所在子队列的页缓存中，供后续写入时复用，缓存上限见 set_page_cache_limit。
+第三个模板参数为内存布局策略，见 lockfree_queue_layout
+第四个模板参数为并发模式，见 lockfree_queue_mode，调用者必须保证实际的读写线程数不超出模式的限制
 */
-template<class _Value, class _Alloc = std::allocator<_Value>>
+template<class _Value,
+         class _Alloc = std::allocator<_Value>,
+         class _Layout = lockfree_compact_layout,
+         class _Mode = lockfree_mpmc>
 class lockfree_queue
 {
     SHARELIB_DISABLE_COPY_CLASS(lockfree_queue);
@@ -20,10 +84,17 @@ class lockfree_queue
     using storage_type =
         std::aligned_storage_t<sizeof(value_type), std::alignment_of<value_type>::value>;
 
+    static constexpr bool SINGLE_PRODUCER = _Mode::SINGLE_PRODUCER;
+    static constexpr bool SINGLE_CONSUMER = _Mode::SINGLE_CONSUMER;
+    static constexpr bool WAITABLE = _Mode::WAITABLE;
+
     enum CONSTANT_VALUE : size_t
     {
+        //子队列个数的位数，单读单写时只用一个子队列
+        SUBLIST_SHIFT = (SINGLE_PRODUCER && SINGLE_CONSUMER ? 0 : 3),
+
         //子队列个数
-        SUBLIST_COUNT = 8, //2的整倍数
+        SUBLIST_COUNT = (size_t)1 << SUBLIST_SHIFT,
 
         //每页的数据个数
         ITEMS_PER_PAGE = (sizeof(value_type) <= 4
@@ -42,25 +113,44 @@ class lockfree_queue
         SUBLIST_INDEX_MASK = (size_t)(~(SUBLIST_COUNT - 1)),
 
         //页内偏移 掩码
-        PAGE_OFFSET_MASK = (ITEMS_PER_PAGE - 1) << 3,
+        PAGE_OFFSET_MASK = (ITEMS_PER_PAGE - 1) << SUBLIST_SHIFT,
 
         //页索引 掩码
-        PAGE_INDEX_MASK = ~(PAGE_OFFSET_MASK | (SUBLIST_COUNT - 1))
+        PAGE_INDEX_MASK = ~(PAGE_OFFSET_MASK | (SUBLIST_COUNT - 1)),
+
+        //每个子队列最多缓存的空闲页数
+        PAGE_CACHE_SLOTS = 8,
+
+        //生产者和消费者数据之间的填充
+        LINE_PADDING = _Layout::CACHE_LINE_SIZE,
+
+        //写入标记之间的填充
+        FLAG_PADDING = (_Layout::PAD_FLAGS ? _Layout::CACHE_LINE_SIZE : 0),
+    };
+
+    //写入标记，不填充时大小与std::atomic<bool>相同
+    struct flag_slot : cache_line_padding<FLAG_PADDING>
+    {
+        std::atomic<bool> m_flag;
     };
 
     //获取页内偏移地址
-#define GET_PAGE_OFFSET(x) ((x & PAGE_OFFSET_MASK) >> 3)
+#define GET_PAGE_OFFSET(x) ((x & PAGE_OFFSET_MASK) >> SUBLIST_SHIFT)
 
     //页
     struct page
     {
-        page()
+        page() { reset(); }
+
+        //复用前恢复到刚构造的状态
+        void reset()
         {
             for (auto &item : m_flags) {
-                item = false;
+                item.m_flag.store(false, std::memory_order::memory_order_relaxed);
             }
+            m_pNext = nullptr;
         }
-        std::atomic<bool> m_flags[ITEMS_PER_PAGE];
+        flag_slot m_flags[ITEMS_PER_PAGE];
         page *m_pNext{nullptr};
         storage_type m_pData[ITEMS_PER_PAGE];
     };
@@ -68,15 +158,39 @@ class lockfree_queue
     //子队列
     struct sublist
     {
+        //消费者修改
         page *m_pHead{nullptr};
         std::atomic<size_t> m_popCount{0};
+        cache_line_padding<LINE_PADDING> m_popPadding;
+
+        //生产者修改
         page *m_pTail{nullptr};
         std::atomic<size_t> m_pushCount{0};
+        //空闲页缓存，每个槽位用一次原子交换转移所有权，不存在ABA问题
+        std::atomic<page *> m_pageCache[PAGE_CACHE_SLOTS]{};
+        cache_line_padding<LINE_PADDING> m_pushPadding;
+    };
+
+    //挂起等待的线程
+    struct waiter
+    {
+        std::atomic<size_t> m_count{0};
+        std::mutex m_lock;
+        std::condition_variable m_condition;
     };
 
 public:
     explicit lockfree_queue(const _Alloc &alloc = _Alloc{})
-        : m_alloc(alloc)
+        : lockfree_queue(0, alloc)
+    {}
+
+    /** 构造函数
+    @param[in] nCapacity 容量上限，0表示无上限
+    @param[in] alloc 内存分配器
+    */
+    explicit lockfree_queue(size_t nCapacity, const _Alloc &alloc = _Alloc{})
+        : m_nCapacity(nCapacity)
+        , m_alloc(alloc)
     {
         for (size_t i = 0; i < SUBLIST_COUNT; ++i) {
             m_sublists[i].m_pTail = m_sublists[i].m_pHead = alloc_page();
@@ -100,15 +214,181 @@ public:
                 pCur = pNext;
             }
             free_page(pCur);
+            for (auto &item : m_sublists[i].m_pageCache) {
+                if (page *pCached = item.exchange(nullptr)) {
+                    free_page(pCached);
+                }
+            }
         }
     }
 
     size_t count() { return m_pushIndex - m_popIndex; }
 
+    //容量上限，0表示无上限
+    size_t capacity() const { return m_nCapacity; }
+
+    /** 设置空闲页缓存的上限，超出上限的空闲页直接释放，多线程安全
+    @param[in] nPages 整个队列最多缓存的页数，平均分到各个子队列，最大 SUBLIST_COUNT * PAGE_CACHE_SLOTS
+    */
+    void set_page_cache_limit(size_t nPages)
+    {
+        size_t nPerSublist = (nPages + SUBLIST_COUNT - 1) / SUBLIST_COUNT;
+        m_nPageCacheLimit.store((std::min)(nPerSublist, (size_t)PAGE_CACHE_SLOTS),
+                                std::memory_order::memory_order_relaxed);
+    }
+
+    /** 添加数据，不检查容量上限，总是成功
+    */
     template<class... T>
     void push(T &&... data)
     {
-        size_t index = m_pushIndex++;
+        if (SINGLE_PRODUCER) {
+            size_t index = m_pushIndex.load(std::memory_order::memory_order_relaxed);
+            push_at(index, std::forward<T>(data)...);
+            m_pushIndex.store(index + 1, std::memory_order::memory_order_release);
+        } else {
+            push_at(m_pushIndex++, std::forward<T>(data)...);
+        }
+        notify_pop_waiter();
+    }
+
+    /** 批量添加数据，只用一次原子操作占用一段连续的索引，不检查容量上限，总是成功
+    @param[in] first,last 数据区间，至少是前向迭代器
+    */
+    template<class TForwardIter>
+    void push_bulk(TForwardIter first, TForwardIter last)
+    {
+        size_t nCount = (size_t)std::distance(first, last);
+        if (nCount == 0) {
+            return;
+        }
+        if (SINGLE_PRODUCER) {
+            size_t index = m_pushIndex.load(std::memory_order::memory_order_relaxed);
+            for (size_t i = 0; first != last; ++first, ++i) {
+                push_at(index + i, *first);
+            }
+            m_pushIndex.store(index + nCount, std::memory_order::memory_order_release);
+        } else {
+            size_t index = m_pushIndex.fetch_add(nCount);
+            for (; first != last; ++first) {
+                push_at(index++, *first);
+            }
+        }
+        notify_pop_waiter();
+    }
+
+    /** 添加数据，有界模式下队列已满时返回false，数据不会被移动
+    */
+    template<class... T>
+    bool try_push(T &&... data)
+    {
+        if (SINGLE_PRODUCER) {
+            size_t index = m_pushIndex.load(std::memory_order::memory_order_relaxed);
+            if (is_full(index)) {
+                return false;
+            }
+            push_at(index, std::forward<T>(data)...);
+            m_pushIndex.store(index + 1, std::memory_order::memory_order_release);
+        } else {
+            size_t index = m_pushIndex.load();
+            do {
+                if (is_full(index)) {
+                    return false;
+                }
+            } while (!m_pushIndex.compare_exchange_weak(index, index + 1));
+            push_at(index, std::forward<T>(data)...);
+        }
+        notify_pop_waiter();
+        return true;
+    }
+
+    /** 添加数据，有界模式下队列已满时挂起等待
+    @param[in] nMilliseconds 0表示不等待，<0表示永久等待，>0表示最多等待指定的时间(毫秒)
+    @param[in] data 数据
+    @return 返回true表示成功,false表示超时
+    */
+    template<class... T>
+    bool push_wait(int64_t nMilliseconds, T &&... data)
+    {
+        static_assert(WAITABLE, "push_wait requires a waitable lockfree_queue_mode");
+        return wait_until_success(
+            m_pushWaiter,
+            [&]() { return try_push(std::forward<T>(data)...); },
+            [this]() { return !is_full(m_pushIndex.load()); },
+            nMilliseconds);
+    }
+
+    /** 取出数据，队列为空时挂起等待
+    @param[out] data 数据
+    @param[in] nMilliseconds 0表示不等待，<0表示永久等待，>0表示最多等待指定的时间(毫秒)
+    @return 返回true表示成功,false表示超时
+    */
+    bool pop_wait(value_type &data, int64_t nMilliseconds = -1)
+    {
+        static_assert(WAITABLE, "pop_wait requires a waitable lockfree_queue_mode");
+        return wait_until_success(
+            m_popWaiter,
+            [&]() { return try_pop(data); },
+            [this]() { return count() > 0; },
+            nMilliseconds);
+    }
+
+    bool try_pop(value_type &data)
+    {
+        size_t index = 0;
+        if (claim_pop_index(index, 1) == 0) {
+            return false;
+        }
+        pop_at(index, data);
+        notify_push_waiter();
+        return true;
+    }
+
+    /** 批量取出数据，只用一次原子操作占用一段连续的索引
+    @param[out] outIter 输出迭代器，数据依次写入
+    @param[in] nMax 最多取出的个数
+    @return 实际取出的个数
+    */
+    template<class TOutIter>
+    size_t try_pop_bulk(TOutIter outIter, size_t nMax)
+    {
+        size_t index = 0;
+        size_t nCount = claim_pop_index(index, nMax);
+        for (size_t i = 0; i < nCount; ++i, ++outIter) {
+            pop_at(index + i, *outIter);
+        }
+        if (nCount > 0) {
+            notify_push_waiter();
+        }
+        return nCount;
+    }
+
+private:
+    /** 是否已达到容量上限
+    @param[in] index 当前的写入索引
+    */
+    bool is_full(size_t index)
+    {
+        if (m_nCapacity == 0) {
+            return false;
+        }
+        if (SINGLE_PRODUCER) {
+            //先用缓存的读取索引判断，看起来已满时再读取最新值
+            if (index - m_cachedPopIndex < m_nCapacity) {
+                return false;
+            }
+            m_cachedPopIndex = m_popIndex.load();
+            return index - m_cachedPopIndex >= m_nCapacity;
+        }
+        //index可能是旧值，小于读取索引，此时不算满，由后续的CAS失败重新读取
+        return (std::ptrdiff_t)(index - m_popIndex.load()) >= (std::ptrdiff_t)m_nCapacity;
+    }
+
+    /** 在已经占用的索引上写入数据
+    */
+    template<class... T>
+    void push_at(size_t index, T &&... data)
+    {
         //选择子队列
         sublist &curList = m_sublists[index & (SUBLIST_COUNT - 1)];
         size_t nPageIndex = index & PAGE_INDEX_MASK;
@@ -117,12 +397,13 @@ public:
         page *pCur = nullptr;
         if (!nPageOffset) {
             //页内第一个，预分配下一页
-            pCur = alloc_page();
+            pCur = acquire_page(curList);
         }
 
-        //如果需要换页，等待前一页处理完
+        //如果需要换页，等待前一页处理完。单写时按顺序写入，不需要等待
         size_t nSpinCount = 0;
-        while ((curList.m_pushCount.load(std::memory_order::memory_order_acquire) &
+        while (!SINGLE_PRODUCER &&
+               (curList.m_pushCount.load(std::memory_order::memory_order_acquire) &
                 PAGE_INDEX_MASK) != nPageIndex) {
             yield(nSpinCount++);
         }
@@ -136,69 +417,207 @@ public:
         if (nPageOffset == ITEMS_PER_PAGE - 1) {
             //只可能有一个线程执行到该分支，并且该线程是该页上最一个处理者，修改尾指针，换页
             nSpinCount = 0;
-            while (curList.m_pushCount.load(std::memory_order::memory_order_acquire) !=
-                   (index & SUBLIST_INDEX_MASK)) {
+            while (!SINGLE_PRODUCER &&
+                   curList.m_pushCount.load(std::memory_order::memory_order_acquire) !=
+                       (index & SUBLIST_INDEX_MASK)) {
                 yield(nSpinCount++);
             }
             curList.m_pTail = curList.m_pTail->m_pNext;
         }
-        curList.m_pushCount.fetch_add(SUBLIST_COUNT, std::memory_order::memory_order_release);
+        if (!SINGLE_PRODUCER) {
+            curList.m_pushCount.fetch_add(SUBLIST_COUNT, std::memory_order::memory_order_release);
+        }
 
-        //存储数据，写入标记
+        //存储数据，写入标记。单写时由调用者在写完之后发布写入索引
         ::new (pCur->m_pData + nPageOffset) value_type(std::forward<T>(data)...);
-        pCur->m_flags[nPageOffset].store(true, std::memory_order::memory_order_release);
+        if (!SINGLE_PRODUCER) {
+            pCur->m_flags[nPageOffset].m_flag.store(true, std::memory_order::memory_order_release);
+        }
     }
 
-    bool try_pop(value_type &data)
+    /** 占用一段连续的读取索引
+    @param[out] index 起始索引
+    @param[in] nMax 最多占用的个数
+    @return 实际占用的个数，0表示队列为空
+    */
+    size_t claim_pop_index(size_t &index, size_t nMax)
     {
-        size_t index = m_popIndex.load(std::memory_order::memory_order_acquire);
+        size_t nCount = 0;
+        if (SINGLE_CONSUMER) {
+            //先用缓存的写入索引，不够时再读取最新值
+            index = m_popIndex.load(std::memory_order::memory_order_relaxed);
+            if (m_cachedPushIndex - index < nMax) {
+                m_cachedPushIndex = m_pushIndex.load(std::memory_order::memory_order_acquire);
+            }
+            nCount = (std::min)(m_cachedPushIndex - index, nMax);
+            if (nCount != 0) {
+                m_popIndex.store(index + nCount, std::memory_order::memory_order_release);
+            }
+            return nCount;
+        }
+        index = m_popIndex.load(std::memory_order::memory_order_acquire);
         do {
-            if (index == m_pushIndex.load(std::memory_order::memory_order_acquire)) {
-                return false;
+            nCount = (std::min)(m_pushIndex.load(std::memory_order::memory_order_acquire) - index,
+                                nMax);
+            if (nCount == 0) {
+                return 0;
             }
-        } while (!m_popIndex.compare_exchange_weak(index, index + 1));
+        } while (!m_popIndex.compare_exchange_weak(index, index + nCount));
+        return nCount;
+    }
+
+    /** 在已经占用的索引上取出数据
+    @param[in] index 读取索引
+    @param[out] target 数据移动赋值给target
+    */
+    template<class TTarget>
+    void pop_at(size_t index, TTarget &&target)
+    {
         //选择子队列
         sublist &curList = m_sublists[index & (SUBLIST_COUNT - 1)];
         size_t nPageIndex = index & PAGE_INDEX_MASK;
         size_t nPageOffset = GET_PAGE_OFFSET(index);
 
-        //如果需要换页，等待前一页处理完
+        //如果需要换页，等待前一页处理完。单读时按顺序读取，不需要等待
         size_t nSpinCount = 0;
-        while ((curList.m_popCount.load(std::memory_order::memory_order_acquire) &
+        while (!SINGLE_CONSUMER &&
+               (curList.m_popCount.load(std::memory_order::memory_order_acquire) &
                 PAGE_INDEX_MASK) != nPageIndex) {
             yield(nSpinCount++);
         }
 
         //头指针一定有数据
         page *pCur = curList.m_pHead;
-        //等待对应位置上的数据写入完毕
+        //等待对应位置上的数据写入完毕。单写时索引发布之前数据已经写完
         nSpinCount = 0;
-        while (!pCur->m_flags[nPageOffset].load(std::memory_order::memory_order_acquire)) {
+        while (!SINGLE_PRODUCER &&
+               !pCur->m_flags[nPageOffset].m_flag.load(std::memory_order::memory_order_acquire)) {
             yield(nSpinCount++);
         }
 
-        data = std::move(*(value_type *)(pCur->m_pData + nPageOffset));
+        target = std::move(*(value_type *)(pCur->m_pData + nPageOffset));
         ((value_type *)(pCur->m_pData + nPageOffset))->~value_type();
 
         if (nPageOffset == ITEMS_PER_PAGE - 1) {
             //最后一个处理者，换页，释放空闲页
             nSpinCount = 0;
-            while (curList.m_popCount.load(std::memory_order::memory_order_acquire) !=
-                   (index & SUBLIST_INDEX_MASK)) {
+            while (!SINGLE_CONSUMER &&
+                   curList.m_popCount.load(std::memory_order::memory_order_acquire) !=
+                       (index & SUBLIST_INDEX_MASK)) {
                 yield(nSpinCount++);
             }
             curList.m_pHead = curList.m_pHead->m_pNext;
-            curList.m_popCount.fetch_add(SUBLIST_COUNT, std::memory_order::memory_order_release);
-            free_page(pCur);
-        } else {
+            if (!SINGLE_CONSUMER) {
+                curList.m_popCount.fetch_add(SUBLIST_COUNT,
+                                             std::memory_order::memory_order_release);
+            }
+            retire_page(curList, pCur);
+        } else if (!SINGLE_CONSUMER) {
             curList.m_popCount.fetch_add(SUBLIST_COUNT, std::memory_order::memory_order_release);
         }
-        return true;
     }
 
 #undef GET_PAGE_OFFSET
 
-private:
+    /** 反复尝试操作，失败时挂起等待，直到成功或超时
+    @param[in] w 等待者
+    @param[in] op 操作，调用原型： bool op();
+    @param[in] ready 判断是否可以再次尝试，调用原型： bool ready();
+    @param[in] nMilliseconds 0表示不等待，<0表示永久等待，>0表示最多等待指定的时间(毫秒)
+    */
+    template<class TOp, class TReady>
+    static bool wait_until_success(waiter &w, TOp &&op, TReady &&ready, int64_t nMilliseconds)
+    {
+        if (op()) {
+            return true;
+        }
+        if (nMilliseconds == 0) {
+            return false;
+        }
+        using namespace std::chrono;
+        auto endTime = steady_clock::now() + milliseconds(nMilliseconds);
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(w.m_lock);
+                //先增加等待计数再检查条件，与notify中先修改索引再检查等待计数相对应，不会丢失通知
+                ++w.m_count;
+                if (nMilliseconds < 0) {
+                    w.m_condition.wait(lock, ready);
+                } else if (!w.m_condition.wait_until(lock, endTime, ready)) {
+                    --w.m_count;
+                    return false;
+                }
+                --w.m_count;
+            }
+            if (op()) {
+                return true;
+            }
+        }
+    }
+
+    //唤醒等待者，没有等待者时不加锁
+    static void notify(waiter &w)
+    {
+        if (w.m_count.load() > 0) {
+            std::lock_guard<std::mutex> lock(w.m_lock);
+            w.m_condition.notify_all();
+        }
+    }
+
+    //写入之后唤醒读取者，不可等待的模式下没有读取者会挂起
+    void notify_pop_waiter()
+    {
+        if (!WAITABLE) {
+            return;
+        }
+        if (SINGLE_PRODUCER) {
+            //单写时索引只是普通的store，需要内存屏障保证先写索引再读等待计数
+            std::atomic_thread_fence(std::memory_order::memory_order_seq_cst);
+        }
+        notify(m_popWaiter);
+    }
+
+    //读取之后唤醒写入者，无界模式下写入者不会等待
+    void notify_push_waiter()
+    {
+        if (!WAITABLE || m_nCapacity == 0) {
+            return;
+        }
+        if (SINGLE_CONSUMER) {
+            std::atomic_thread_fence(std::memory_order::memory_order_seq_cst);
+        }
+        notify(m_pushWaiter);
+    }
+
+    //优先从子队列的缓存中取空闲页
+    page *acquire_page(sublist &curList)
+    {
+        for (auto &item : curList.m_pageCache) {
+            if (item.load(std::memory_order::memory_order_relaxed)) {
+                page *pCached = item.exchange(nullptr, std::memory_order::memory_order_acquire);
+                if (pCached) {
+                    pCached->reset();
+                    return pCached;
+                }
+            }
+        }
+        return alloc_page();
+    }
+
+    //空闲页放回子队列的缓存，缓存已满时释放
+    void retire_page(sublist &curList, page *pNode)
+    {
+        size_t nLimit = m_nPageCacheLimit.load(std::memory_order::memory_order_relaxed);
+        for (size_t i = 0; i < nLimit; ++i) {
+            page *pEmpty = nullptr;
+            if (curList.m_pageCache[i].compare_exchange_strong(
+                    pEmpty, pNode, std::memory_order::memory_order_release)) {
+                return;
+            }
+        }
+        free_page(pNode);
+    }
+
     page *alloc_page()
     {
         page *pNew = m_alloc.allocate(1);
@@ -222,7 +641,17 @@ private:
 private:
     sublist m_sublists[SUBLIST_COUNT];
     std::atomic<size_t> m_pushIndex{0};
+    //单写时写入者缓存的读取索引
+    size_t m_cachedPopIndex{0};
+    cache_line_padding<LINE_PADDING> m_pushIndexPadding;
     std::atomic<size_t> m_popIndex{0};
+    //单读时读取者缓存的写入索引
+    size_t m_cachedPushIndex{0};
+    cache_line_padding<LINE_PADDING> m_popIndexPadding;
+    const size_t m_nCapacity;
+    std::atomic<size_t> m_nPageCacheLimit{PAGE_CACHE_SLOTS};
+    waiter m_pushWaiter;
+    waiter m_popWaiter;
 
     typename _Alloc::template rebind<page>::other m_alloc;
 };
@@ -0,0 +1,332 @@
+﻿#include "targetver.h"
+#include "IOCP/IOCPThreadPool.h"
+#ifndef _WIN32
+#    include <atomic>
+#    include <cassert>
+#    include <cerrno>
+#    include <chrono>
+#    include <condition_variable>
+#    include <exception>
+#    include <memory>
+#    include <mutex>
+#    include <pthread.h>
+#    include <unistd.h>
+#    include "LinuxIOEngine.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+//工作线程栈大小
+static const size_t STACK_SIZE = 1024 * 1024 * 3;
+
+static inline bool IsIOCPQuitKey(TPFOnIOCompleted pfCallback)
+{
+    return pfCallback == nullptr;
+}
+
+/* 与windows的实现相同: 完成队列代替IOCP，工作线程的增减规则不变;
+IO由 LinuxIOEngine 在自己的线程中等待完成，完成后放入完成队列
+*/
+struct IOCPThreadPool::IOCPContex
+{
+    IOCPContex()
+        : m_dwMaxWaitNum(0)
+        , m_dwCurrNum(0)
+        , m_dwBusyNum(0)
+        , m_dwTimerOut(10000)
+    {}
+
+    ~IOCPContex()
+    {
+        //先停止IO线程，之后不会再有完成包
+        m_spEngine.reset();
+    }
+
+    /** 初始化IO及完成队列
+    @param[in] dwNumOfMax 最大线程数
+    @param[in] backend IO的实现方式
+    @return 是否成功
+    */
+    bool InitContext(DWORD dwNumOfMax, TIOBackend backend)
+    {
+        if (dwNumOfMax != 0) {
+            m_dwMaxWaitNum = dwNumOfMax;
+        } else {
+            long nProcessors = ::sysconf(_SC_NPROCESSORS_ONLN);
+            m_dwMaxWaitNum = (DWORD)(nProcessors > 0 ? nProcessors : 1) * 2;
+        }
+
+        if (backend != TIOBackend::EPOLL) {
+            m_spEngine = CreateUringIOEngine(m_port);
+        }
+        if (!m_spEngine && backend != TIOBackend::IO_URING) {
+            m_spEngine = CreateEpollIOEngine(m_port);
+        }
+        return m_spEngine && m_spEngine->Start();
+    }
+
+    /** 往线程池中添加线程
+    */
+    bool AddThread()
+    {
+        pthread_attr_t attr;
+        if (::pthread_attr_init(&attr) != 0) {
+            return false;
+        }
+        ::pthread_attr_setstacksize(&attr, STACK_SIZE);
+        ::pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        //由启动者增加计数，避免启动者退出、但新线程还没有执行增加计数的代码导致计数错误
+        ++m_dwCurrNum;
+        pthread_t thread;
+        bool bOK = (::pthread_create(&thread, &attr, IOCPWorkThread, this) == 0);
+        ::pthread_attr_destroy(&attr);
+        if (!bOK) {
+            --m_dwCurrNum;
+        }
+        return bOK;
+    }
+
+    /** 往线程池中投递退出信号，使线程池退出
+    */
+    void PostIOCPQuitKey()
+    {
+        TCompletionPacket packet{};
+        m_port.Post(packet);
+    }
+
+    //最大等待线程数
+    std::atomic<DWORD> m_dwMaxWaitNum;
+
+    //当前线程数
+    std::atomic<DWORD> m_dwCurrNum;
+
+    //正在工作的线程数
+    std::atomic<DWORD> m_dwBusyNum;
+
+    //线程锁
+    std::mutex m_threadLock;
+
+    //当前时间
+    std::chrono::time_point<std::chrono::system_clock> m_timeCur;
+
+    //完成队列
+    LinuxCompletionPort m_port;
+
+    //IO的实现
+    std::unique_ptr<LinuxIOEngine> m_spEngine;
+
+    //超时时间
+    std::atomic<DWORD> m_dwTimerOut;
+
+    //退出事件
+    std::condition_variable m_quitEvent;
+};
+
+IOCPThreadPool::IOCPThreadPool()
+    : m_pIOCPContex(nullptr)
+{}
+
+IOCPThreadPool::~IOCPThreadPool()
+{
+    if (m_pIOCPContex) {
+        CloseIOCPThreadPool();
+    }
+}
+
+bool IOCPThreadPool::CreateIOCPThreadPool(DWORD dwNumOfRun /*= 0*/, DWORD dwNumOfMax /*= 0*/)
+{
+    return CreateIOCPThreadPool(dwNumOfRun, dwNumOfMax, TIOBackend::AUTO);
+}
+
+bool IOCPThreadPool::CreateIOCPThreadPool(DWORD /*dwNumOfRun*/,
+                                          DWORD dwNumOfMax,
+                                          TIOBackend backend)
+{
+    if (m_pIOCPContex) {
+        return true;
+    }
+
+    std::unique_ptr<IOCPContex> spIocpContex;
+    try {
+        spIocpContex.reset(new IOCPContex);
+    } catch (...) {
+        return false;
+    }
+    if (!spIocpContex->InitContext(dwNumOfMax, backend) || !spIocpContex->AddThread()) {
+        return false;
+    }
+    m_pIOCPContex = spIocpContex.release();
+    return true;
+}
+
+void IOCPThreadPool::CloseIOCPThreadPool()
+{
+    if (m_pIOCPContex == nullptr) {
+        return;
+    }
+
+    //先停止IO线程，再按windows的方式让工作线程依次退出
+    m_pIOCPContex->m_spEngine->Stop();
+    m_pIOCPContex->PostIOCPQuitKey();
+
+    {
+        std::unique_lock<decltype(m_pIOCPContex->m_threadLock)> lock(m_pIOCPContex->m_threadLock);
+        m_pIOCPContex->m_quitEvent.wait(lock, [this]() { return m_pIOCPContex->m_dwCurrNum == 0; });
+    }
+    delete m_pIOCPContex;
+    m_pIOCPContex = nullptr;
+}
+
+IOCPThreadPool::operator bool() const
+{
+    return !this->operator!();
+}
+
+bool IOCPThreadPool::operator!() const
+{
+    return m_pIOCPContex == nullptr;
+}
+
+void IOCPThreadPool::SetExpiryTime(DWORD dwSeconds)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr) {
+        return;
+    }
+    if (dwSeconds > 0) {
+        m_pIOCPContex->m_dwTimerOut = dwSeconds * 1000;
+    } else {
+        m_pIOCPContex->m_dwTimerOut = INFINITE;
+    }
+}
+
+bool IOCPThreadPool::BindDeviceToIOCPThreadPool(int fd, TPFOnIOCompleted pfOnIOCompleted)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr) {
+        return false;
+    }
+    if (fd < 0 || IsIOCPQuitKey(pfOnIOCompleted)) {
+        return false;
+    }
+    return m_pIOCPContex->m_spEngine->Bind(fd, pfOnIOCompleted);
+}
+
+void IOCPThreadPool::UnbindDevice(int fd)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr) {
+        return;
+    }
+    m_pIOCPContex->m_spEngine->Unbind(fd);
+}
+
+bool IOCPThreadPool::AsyncRead(int fd, void *pBuffer, DWORD dwBytes, LPOVERLAPPED pOverlapped)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr || pOverlapped == nullptr) {
+        return false;
+    }
+    return m_pIOCPContex->m_spEngine->Submit(fd, false, pBuffer, dwBytes, pOverlapped);
+}
+
+bool IOCPThreadPool::AsyncWrite(int fd,
+                                const void *pBuffer,
+                                DWORD dwBytes,
+                                LPOVERLAPPED pOverlapped)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr || pOverlapped == nullptr) {
+        return false;
+    }
+    return m_pIOCPContex->m_spEngine->Submit(
+        fd, true, const_cast<void *>(pBuffer), dwBytes, pOverlapped);
+}
+
+TIOBackend IOCPThreadPool::GetIOBackend() const
+{
+    if (m_pIOCPContex == nullptr) {
+        return TIOBackend::AUTO;
+    }
+    return m_pIOCPContex->m_spEngine->GetBackend();
+}
+
+bool IOCPThreadPool::AsyncCall(TPFIOCPAsyncCallBack pfOnIOCompleted,
+                               DWORD dwNumberOfBytesTransferred,
+                               void *pVoid)
+{
+    assert(m_pIOCPContex);
+    if (m_pIOCPContex == nullptr) {
+        return false;
+    }
+    if (IsIOCPQuitKey((TPFOnIOCompleted)pfOnIOCompleted)) {
+        return false;
+    }
+
+    TCompletionPacket packet;
+    packet.m_pfCallback = (TPFOnIOCompleted)pfOnIOCompleted;
+    packet.m_dwErrno = ERROR_SUCCESS;
+    packet.m_dwBytes = dwNumberOfBytesTransferred;
+    packet.m_pOverlapped = (LPOVERLAPPED)pVoid;
+    m_pIOCPContex->m_port.Post(packet);
+    return true;
+}
+
+void *IOCPThreadPool::IOCPWorkThread(void *pVoid)
+{
+    IOCPContex *pIOCPContext = (IOCPContex *)(pVoid);
+
+    TCompletionPacket packet{};
+    for (;;) {
+        if (pIOCPContext->m_port.Get(packet, pIOCPContext->m_dwTimerOut)) {
+            if (IsIOCPQuitKey(packet.m_pfCallback)) {
+                pIOCPContext->PostIOCPQuitKey();
+                break;
+            }
+
+            /* 满足以下条件时增加线程池中线程的个数:
+            1.线程池中线程总数小于等于正在工作中的线程数；2.线程池中线程总数小于最大值
+            */
+            if ((pIOCPContext->m_dwCurrNum <= ++pIOCPContext->m_dwBusyNum) &&
+                (pIOCPContext->m_dwCurrNum < pIOCPContext->m_dwMaxWaitNum)) {
+                pIOCPContext->AddThread();
+            }
+
+            //调用回调函数
+            try {
+                packet.m_pfCallback(packet.m_dwErrno, packet.m_dwBytes, packet.m_pOverlapped);
+            } catch (...) {
+                assert(!"TPFOnIOCompleted抛出了未知异常！");
+            }
+
+            --pIOCPContext->m_dwBusyNum;
+        } else {
+            std::unique_lock<decltype(pIOCPContext->m_threadLock)> tryLock{
+                pIOCPContext->m_threadLock, std::try_to_lock_t()};
+            if (tryLock) {
+                /* 满足这两个条件的时候, 每隔 m_dwTimerOut 时间减少一个线程。
+                1.当前线程池中总线程数大于正在工作线程数的2倍；2.当前线程池中总线程数大于2。
+                */
+                if ((pIOCPContext->m_dwBusyNum * 2 < pIOCPContext->m_dwCurrNum) &&
+                    (pIOCPContext->m_dwCurrNum > 2)) {
+                    using namespace std::chrono;
+                    if ((pIOCPContext->m_timeCur.time_since_epoch().count() == 0) ||
+                        (duration_cast<milliseconds>(system_clock::now() - pIOCPContext->m_timeCur)
+                             .count() >= pIOCPContext->m_dwTimerOut - 100)) {
+                        pIOCPContext->m_timeCur = system_clock::now();
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    std::unique_lock<decltype(pIOCPContext->m_threadLock)> lock(pIOCPContext->m_threadLock);
+    if (--pIOCPContext->m_dwCurrNum == 0) {
+        pIOCPContext->m_quitEvent.notify_all();
+    }
+    return nullptr;
+}
+
+SHARELIB_END_NAMESPACE
+
+#endif
@@ -0,0 +1,795 @@
+﻿#include "targetver.h"
+#include "LinuxIOEngine.h"
+#ifndef _WIN32
+#    include <algorithm>
+#    include <cassert>
+#    include <cerrno>
+#    include <chrono>
+#    include <cstring>
+#    include <new>
+#    include <thread>
+#    include <unordered_map>
+#    include <vector>
+#    include <fcntl.h>
+#    include <linux/io_uring.h>
+#    include <sched.h>
+#    include <sys/epoll.h>
+#    include <sys/eventfd.h>
+#    include <sys/mman.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+
+SHARELIB_BEGIN_NAMESPACE
+
+void LinuxCompletionPort::Post(const TCompletionPacket &packet)
+{
+    Post(&packet, 1);
+}
+
+void LinuxCompletionPort::Post(const TCompletionPacket *pPackets, size_t nCount)
+{
+    if (nCount == 0) {
+        return;
+    }
+    size_t nWaiters = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_packets.insert(m_packets.end(), pPackets, pPackets + nCount);
+        nWaiters = m_nWaiters;
+    }
+    //每个完成包只唤醒一个线程
+    for (size_t i = (std::min)(nWaiters, nCount); i > 0; --i) {
+        m_notEmpty.notify_one();
+    }
+}
+
+bool LinuxCompletionPort::Get(TCompletionPacket &packet, DWORD dwMilliseconds)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_packets.empty()) {
+        auto &&pred = [this]() { return !m_packets.empty(); };
+        ++m_nWaiters;
+        if (dwMilliseconds == INFINITE) {
+            m_notEmpty.wait(lock, pred);
+        } else {
+            m_notEmpty.wait_for(lock, std::chrono::milliseconds(dwMilliseconds), pred);
+        }
+        --m_nWaiters;
+        if (m_packets.empty()) {
+            return false;
+        }
+    }
+    packet = m_packets.front();
+    m_packets.pop_front();
+    return true;
+}
+
+//----------------------------------------------------------------------
+
+namespace {
+
+//设置完成包，字节数同时写入OVERLAPPED
+void SetCompletion(TCompletionPacket &packet,
+                   LPOVERLAPPED pOverlapped,
+                   DWORD dwErrno,
+                   DWORD dwBytes)
+{
+    pOverlapped->InternalHigh = dwBytes;
+    packet.m_pfCallback = (TPFOnIOCompleted)pOverlapped->Internal;
+    packet.m_dwErrno = dwErrno;
+    packet.m_dwBytes = dwBytes;
+    packet.m_pOverlapped = pOverlapped;
+}
+
+bool IsSocket(int fd)
+{
+    struct stat st;
+    return ::fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+//----------------------------------------------------------------------
+
+//io_uring的user_data，其它值是OVERLAPPED的指针
+const uint64_t URING_QUIT_DATA = 0;
+const uint64_t URING_IGNORE_DATA = 1;
+
+//提交队列的大小，完成队列是它的2倍，完成队列满时内核暂存(IORING_FEAT_NODROP)
+const unsigned URING_ENTRIES = 1024;
+
+template<class T>
+T LoadAcquire(const T *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template<class T>
+void StoreRelease(T *p, T value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \class UringIOEngine
+ * \brief 直接使用io_uring的系统调用，不依赖liburing
+ 提交时加锁写入提交队列并立即提交，IO线程等待完成队列，取出后放入线程池的完成队列
+ */
+class UringIOEngine : public LinuxIOEngine
+{
+public:
+    explicit UringIOEngine(LinuxCompletionPort &port)
+        : m_port(port)
+    {}
+
+    ~UringIOEngine() override
+    {
+        Stop();
+        if (m_pSqes) {
+            ::munmap(m_pSqes, m_nSqesSize);
+        }
+        if (m_pCqRing && m_pCqRing != m_pSqRing) {
+            ::munmap(m_pCqRing, m_nCqRingSize);
+        }
+        if (m_pSqRing) {
+            ::munmap(m_pSqRing, m_nSqRingSize);
+        }
+        if (m_nRingFd >= 0) {
+            ::close(m_nRingFd);
+        }
+    }
+
+    //创建io_uring，内核版本不够时返回false
+    bool Init()
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_nRingFd = (int)::syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+        if (m_nRingFd < 0) {
+            return false;
+        }
+        //IORING_OP_READ、IORING_OP_SEND等与IORING_FEAT_RW_CUR_POS同在5.6加入
+        const unsigned nNeedFeatures = IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+        if ((params.features & nNeedFeatures) != nNeedFeatures) {
+            return false;
+        }
+
+        m_nSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_nCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool bSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (bSingleMap) {
+            m_nSqRingSize = m_nCqRingSize = (std::max)(m_nSqRingSize, m_nCqRingSize);
+        }
+        m_pSqRing = MapRing(m_nSqRingSize, IORING_OFF_SQ_RING);
+        if (!m_pSqRing) {
+            return false;
+        }
+        m_pCqRing = bSingleMap ? m_pSqRing : MapRing(m_nCqRingSize, IORING_OFF_CQ_RING);
+        if (!m_pCqRing) {
+            return false;
+        }
+        m_nSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_pSqes = (io_uring_sqe *)MapRing(m_nSqesSize, IORING_OFF_SQES);
+        if (!m_pSqes) {
+            return false;
+        }
+
+        char *pSq = (char *)m_pSqRing;
+        m_pSqHead = (unsigned *)(pSq + params.sq_off.head);
+        m_pSqTail = (unsigned *)(pSq + params.sq_off.tail);
+        m_nSqMask = *(unsigned *)(pSq + params.sq_off.ring_mask);
+        m_nSqEntries = *(unsigned *)(pSq + params.sq_off.ring_entries);
+        m_pSqArray = (unsigned *)(pSq + params.sq_off.array);
+        char *pCq = (char *)m_pCqRing;
+        m_pCqHead = (unsigned *)(pCq + params.cq_off.head);
+        m_pCqTail = (unsigned *)(pCq + params.cq_off.tail);
+        m_nCqMask = *(unsigned *)(pCq + params.cq_off.ring_mask);
+        m_pCqes = (io_uring_cqe *)(pCq + params.cq_off.cqes);
+        return true;
+    }
+
+    TIOBackend GetBackend() const override
+    {
+        return TIOBackend::IO_URING;
+    }
+
+    bool Start() override
+    {
+        try {
+            m_thread = std::thread(&UringIOEngine::Run, this);
+        } catch (...) {
+            return false;
+        }
+        return true;
+    }
+
+    void Stop() override
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            //IO线程收到这个NOP的完成后退出。提交队列满时先放开锁，让其它线程完成提交
+            std::unique_lock<std::mutex> lock(m_lock);
+            for (;;) {
+                io_uring_sqe *pSqe = GetSqe();
+                if (pSqe) {
+                    pSqe->opcode = IORING_OP_NOP;
+                    pSqe->user_data = URING_QUIT_DATA;
+                    if (CommitSqe(lock)) {
+                        break;
+                    }
+                }
+                lock.unlock();
+                ::sched_yield();
+                lock.lock();
+            }
+        }
+        m_thread.join();
+    }
+
+    bool Bind(int fd, TPFOnIOCompleted pfOnIOCompleted) override
+    {
+        TDevice device;
+        device.m_pfCallback = pfOnIOCompleted;
+        device.m_bSocket = IsSocket(fd);
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_devices[fd] = device;
+        return true;
+    }
+
+    void Unbind(int fd) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (m_devices.erase(fd) == 0) {
+            return;
+        }
+#    ifdef IORING_ASYNC_CANCEL_ALL
+        //取消该fd所有未完成的IO，内核不支持时完成包的结果为-EINVAL，忽略
+        io_uring_sqe *pSqe = GetSqe();
+        if (pSqe) {
+            pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+            pSqe->fd = fd;
+            pSqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            pSqe->user_data = URING_IGNORE_DATA;
+            CommitSqe(lock);
+        }
+#    endif
+    }
+
+    bool Submit(int fd,
+                bool bWrite,
+                void *pBuffer,
+                DWORD dwBytes,
+                LPOVERLAPPED pOverlapped) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        auto it = m_devices.find(fd);
+        if (it == m_devices.end()) {
+            errno = EBADF;
+            return false;
+        }
+        io_uring_sqe *pSqe = GetSqe();
+        if (!pSqe) {
+            errno = EBUSY;
+            return false;
+        }
+        pOverlapped->Internal = (uintptr_t)it->second.m_pfCallback;
+        pOverlapped->InternalHigh = 0;
+        if (it->second.m_bSocket) {
+            pSqe->opcode = bWrite ? IORING_OP_SEND : IORING_OP_RECV;
+            pSqe->msg_flags = bWrite ? MSG_NOSIGNAL : 0;
+        } else {
+            //管道等不能定位的设备内核忽略偏移
+            pSqe->opcode = bWrite ? IORING_OP_WRITE : IORING_OP_READ;
+            pSqe->off = ((uint64_t)pOverlapped->OffsetHigh << 32) | pOverlapped->Offset;
+        }
+        pSqe->fd = fd;
+        pSqe->addr = (uint64_t)(uintptr_t)pBuffer;
+        pSqe->len = dwBytes;
+        pSqe->user_data = (uint64_t)(uintptr_t)pOverlapped;
+        return CommitSqe(lock);
+    }
+
+private:
+    struct TDevice
+    {
+        TPFOnIOCompleted m_pfCallback = nullptr;
+        bool m_bSocket = false; //socket用send、recv，写入时不产生SIGPIPE
+    };
+
+    void *MapRing(size_t nSize, off_t nOffset)
+    {
+        void *p = ::mmap(
+            nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRingFd, nOffset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    //取一个空闲的提交项，需要加锁
+    io_uring_sqe *GetSqe()
+    {
+        unsigned nTail = *m_pSqTail;
+        if (nTail - LoadAcquire(m_pSqHead) >= m_nSqEntries) {
+            return nullptr;
+        }
+        io_uring_sqe *pSqe = &m_pSqes[nTail & m_nSqMask];
+        std::memset(pSqe, 0, sizeof(*pSqe));
+        return pSqe;
+    }
+
+    /** 提交GetSqe取出的一项，lock 必须锁定 m_lock。
+    完成队列积压时内核暂不接收，先放开锁等IO线程取走完成项，其它线程可以继续提交，
+    谁先调用 io_uring_enter 谁就把之前积压的提交项一起提交。
+    出错时如果这一项还在队列末尾则撤回，返回false，不会再执行
+    */
+    bool CommitSqe(std::unique_lock<std::mutex> &lock)
+    {
+        unsigned nTail = *m_pSqTail;
+        m_pSqArray[nTail & m_nSqMask] = nTail & m_nSqMask;
+        StoreRelease(m_pSqTail, nTail + 1);
+        for (;;) {
+            unsigned nHead = LoadAcquire(m_pSqHead);
+            if ((int)(nHead - nTail) > 0) {
+                //已被内核取走，可能是其它线程提交的
+                return true;
+            }
+            unsigned nPending = *m_pSqTail - nHead;
+            long nResult =
+                ::syscall(__NR_io_uring_enter, m_nRingFd, nPending, 0, 0, nullptr, 0);
+            if (nResult > 0 || (nResult < 0 && errno == EINTR)) {
+                continue;
+            }
+            if (nResult == 0 || errno == EAGAIN || errno == EBUSY) {
+                lock.unlock();
+                ::sched_yield();
+                lock.lock();
+                continue;
+            }
+            if (LoadAcquire(m_pSqHead) == nTail && *m_pSqTail == nTail + 1) {
+                StoreRelease(m_pSqTail, nTail);
+                return false;
+            }
+            //后面还有其它线程的提交项，撤回不了，由它们重试时一起提交
+            return true;
+        }
+    }
+
+    void Run()
+    {
+        std::vector<TCompletionPacket> packets;
+        bool bQuit = false;
+        while (!bQuit) {
+            long nResult =
+                ::syscall(__NR_io_uring_enter, m_nRingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (nResult < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                assert(!"io_uring_enter调用错误");
+                break;
+            }
+
+            packets.clear();
+            unsigned nHead = *m_pCqHead;
+            unsigned nTail = LoadAcquire(m_pCqTail);
+            for (; nHead != nTail; ++nHead) {
+                const io_uring_cqe &cqe = m_pCqes[nHead & m_nCqMask];
+                if (cqe.user_data == URING_QUIT_DATA) {
+                    bQuit = true;
+                    continue;
+                }
+                if (cqe.user_data == URING_IGNORE_DATA) {
+                    continue;
+                }
+                TCompletionPacket packet;
+                LPOVERLAPPED pOverlapped = (LPOVERLAPPED)(uintptr_t)cqe.user_data;
+                if (cqe.res < 0) {
+                    SetCompletion(packet, pOverlapped, (DWORD)-cqe.res, 0);
+                } else {
+                    SetCompletion(packet, pOverlapped, ERROR_SUCCESS, (DWORD)cqe.res);
+                }
+                packets.push_back(packet);
+            }
+            StoreRelease(m_pCqHead, nHead);
+            m_port.Post(packets.data(), packets.size());
+        }
+    }
+
+    LinuxCompletionPort &m_port;
+    int m_nRingFd = -1;
+
+    void *m_pSqRing = nullptr;
+    size_t m_nSqRingSize = 0;
+    void *m_pCqRing = nullptr;
+    size_t m_nCqRingSize = 0;
+    io_uring_sqe *m_pSqes = nullptr;
+    size_t m_nSqesSize = 0;
+
+    unsigned *m_pSqHead = nullptr;
+    unsigned *m_pSqTail = nullptr;
+    unsigned *m_pSqArray = nullptr;
+    unsigned m_nSqMask = 0;
+    unsigned m_nSqEntries = 0;
+    unsigned *m_pCqHead = nullptr;
+    unsigned *m_pCqTail = nullptr;
+    io_uring_cqe *m_pCqes = nullptr;
+    unsigned m_nCqMask = 0;
+
+    //提交队列及m_devices的锁
+    std::mutex m_lock;
+    std::unordered_map<int, TDevice> m_devices;
+    std::thread m_thread;
+};
+
+//----------------------------------------------------------------------
+
+//epoll方式下普通文件的读写，在线程池中执行后调用回调
+struct TFileIOJob
+{
+    int m_fd;
+    bool m_bWrite;
+    void *m_pBuffer;
+    DWORD m_dwBytes;
+    LPOVERLAPPED m_pOverlapped;
+};
+
+void RunFileIOJob(DWORD /*dwErrno*/, DWORD /*dwNumberOfBytesTransferred*/, LPOVERLAPPED pVoid)
+{
+    std::unique_ptr<TFileIOJob> spJob((TFileIOJob *)pVoid);
+    LPOVERLAPPED pOverlapped = spJob->m_pOverlapped;
+    off_t nOffset = (off_t)(((uint64_t)pOverlapped->OffsetHigh << 32) | pOverlapped->Offset);
+    ssize_t nResult = 0;
+    do {
+        nResult = spJob->m_bWrite
+                      ? ::pwrite(spJob->m_fd, spJob->m_pBuffer, spJob->m_dwBytes, nOffset)
+                      : ::pread(spJob->m_fd, spJob->m_pBuffer, spJob->m_dwBytes, nOffset);
+    } while (nResult < 0 && errno == EINTR);
+
+    TCompletionPacket packet;
+    if (nResult < 0) {
+        SetCompletion(packet, pOverlapped, (DWORD)errno, 0);
+    } else {
+        SetCompletion(packet, pOverlapped, ERROR_SUCCESS, (DWORD)nResult);
+    }
+    spJob.reset();
+    packet.m_pfCallback(packet.m_dwErrno, packet.m_dwBytes, packet.m_pOverlapped);
+}
+
+/*!
+ * \class EpollIOEngine
+ * \brief epoll模拟proactor
+ socket、管道等设置为非阻塞，提交时先尝试读写，不能完成时排队，等待可读写后由IO线程读写;
+ epoll不支持普通文件，普通文件在线程池中用pread、pwrite读写
+ */
+class EpollIOEngine : public LinuxIOEngine
+{
+public:
+    explicit EpollIOEngine(LinuxCompletionPort &port)
+        : m_port(port)
+    {}
+
+    ~EpollIOEngine() override
+    {
+        Stop();
+        if (m_nEventFd >= 0) {
+            ::close(m_nEventFd);
+        }
+        if (m_nEpollFd >= 0) {
+            ::close(m_nEpollFd);
+        }
+    }
+
+    bool Init()
+    {
+        m_nEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        m_nEventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (m_nEpollFd < 0 || m_nEventFd < 0) {
+            return false;
+        }
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = m_nEventFd;
+        return ::epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, m_nEventFd, &ev) == 0;
+    }
+
+    TIOBackend GetBackend() const override
+    {
+        return TIOBackend::EPOLL;
+    }
+
+    bool Start() override
+    {
+        try {
+            m_thread = std::thread(&EpollIOEngine::Run, this);
+        } catch (...) {
+            return false;
+        }
+        return true;
+    }
+
+    void Stop() override
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        uint64_t nValue = 1;
+        while (::write(m_nEventFd, &nValue, sizeof(nValue)) < 0 && errno == EINTR) {
+            ;
+        }
+        m_thread.join();
+    }
+
+    bool Bind(int fd, TPFOnIOCompleted pfOnIOCompleted) override
+    {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            return false;
+        }
+        bool bPollable = !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode);
+        if (bPollable) {
+            int nFlags = ::fcntl(fd, F_GETFL);
+            if (nFlags < 0 || ::fcntl(fd, F_SETFL, nFlags | O_NONBLOCK) < 0) {
+                return false;
+            }
+        }
+
+        std::vector<TCompletionPacket> packets;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            //原来的fd已经关闭，未完成的IO不会再完成
+            TDevice &device = m_devices[fd];
+            CancelPending(device, ECANCELED, packets);
+            device.m_pfCallback = pfOnIOCompleted;
+            device.m_bPollable = bPollable;
+            device.m_bSocket = S_ISSOCK(st.st_mode);
+            device.m_bRegistered = false;
+        }
+        m_port.Post(packets.data(), packets.size());
+        return true;
+    }
+
+    void Unbind(int fd) override
+    {
+        std::vector<TCompletionPacket> packets;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto it = m_devices.find(fd);
+            if (it == m_devices.end()) {
+                return;
+            }
+            if (it->second.m_bRegistered) {
+                ::epoll_ctl(m_nEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            CancelPending(it->second, ECANCELED, packets);
+            m_devices.erase(it);
+        }
+        m_port.Post(packets.data(), packets.size());
+    }
+
+    bool Submit(int fd,
+                bool bWrite,
+                void *pBuffer,
+                DWORD dwBytes,
+                LPOVERLAPPED pOverlapped) override
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        auto it = m_devices.find(fd);
+        if (it == m_devices.end()) {
+            errno = EBADF;
+            return false;
+        }
+        TDevice &device = it->second;
+        pOverlapped->Internal = (uintptr_t)device.m_pfCallback;
+        pOverlapped->InternalHigh = 0;
+
+        if (!device.m_bPollable) {
+            lock.unlock();
+            TFileIOJob *pJob =
+                new (std::nothrow) TFileIOJob{fd, bWrite, pBuffer, dwBytes, pOverlapped};
+            if (!pJob) {
+                errno = ENOMEM;
+                return false;
+            }
+            TCompletionPacket packet;
+            packet.m_pfCallback = RunFileIOJob;
+            packet.m_dwErrno = ERROR_SUCCESS;
+            packet.m_dwBytes = 0;
+            packet.m_pOverlapped = (LPOVERLAPPED)pJob;
+            m_port.Post(packet);
+            return true;
+        }
+
+        //前面没有排队的IO时直接读写，与IOCP一样，立即完成的IO也通过完成队列回调
+        TRequest request{bWrite, pBuffer, dwBytes, pOverlapped};
+        std::deque<TRequest> &requests = bWrite ? device.m_writes : device.m_reads;
+        if (requests.empty()) {
+            TCompletionPacket packet;
+            if (TryIO(fd, device, request, packet)) {
+                lock.unlock();
+                m_port.Post(packet);
+                return true;
+            }
+        }
+        requests.push_back(request);
+        if (!Arm(fd, device)) {
+            int nError = errno;
+            requests.pop_back();
+            errno = nError;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct TRequest
+    {
+        bool m_bWrite;
+        void *m_pBuffer;
+        DWORD m_dwBytes;
+        LPOVERLAPPED m_pOverlapped;
+    };
+
+    struct TDevice
+    {
+        TPFOnIOCompleted m_pfCallback = nullptr;
+        bool m_bPollable = false;   //socket、管道等可以用epoll等待的设备
+        bool m_bSocket = false;     //socket用send，不产生SIGPIPE
+        bool m_bRegistered = false; //已加入epoll
+        std::deque<TRequest> m_reads;
+        std::deque<TRequest> m_writes;
+    };
+
+    //非阻塞读写，需要等待时返回false
+    static bool TryIO(int fd,
+                      const TDevice &device,
+                      const TRequest &request,
+                      TCompletionPacket &packet)
+    {
+        ssize_t nResult = 0;
+        do {
+            if (request.m_bWrite) {
+                nResult = device.m_bSocket
+                              ? ::send(fd, request.m_pBuffer, request.m_dwBytes, MSG_NOSIGNAL)
+                              : ::write(fd, request.m_pBuffer, request.m_dwBytes);
+            } else {
+                nResult = ::read(fd, request.m_pBuffer, request.m_dwBytes);
+            }
+        } while (nResult < 0 && errno == EINTR);
+
+        if (nResult >= 0) {
+            SetCompletion(packet, request.m_pOverlapped, ERROR_SUCCESS, (DWORD)nResult);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        } else {
+            SetCompletion(packet, request.m_pOverlapped, (DWORD)errno, 0);
+        }
+        return true;
+    }
+
+    //按排队的IO设置等待的事件，EPOLLONESHOT，每次事件后重新设置
+    bool Arm(int fd, TDevice &device)
+    {
+        epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLONESHOT;
+        if (!device.m_reads.empty()) {
+            ev.events |= EPOLLIN;
+        }
+        if (!device.m_writes.empty()) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.fd = fd;
+        if (ev.events == EPOLLONESHOT) {
+            return true;
+        }
+        if (device.m_bRegistered) {
+            return ::epoll_ctl(m_nEpollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+        }
+        if (::epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, fd, &ev) != 0 &&
+            (errno != EEXIST || ::epoll_ctl(m_nEpollFd, EPOLL_CTL_MOD, fd, &ev) != 0)) {
+            return false;
+        }
+        device.m_bRegistered = true;
+        return true;
+    }
+
+    //排队的IO全部以错误完成
+    static void CancelPending(TDevice &device, int nError, std::vector<TCompletionPacket> &packets)
+    {
+        for (auto *pRequests : {&device.m_reads, &device.m_writes}) {
+            for (auto &request : *pRequests) {
+                TCompletionPacket packet;
+                SetCompletion(packet, request.m_pOverlapped, (DWORD)nError, 0);
+                packets.push_back(packet);
+            }
+            pRequests->clear();
+        }
+    }
+
+    //依次完成排队的IO，直到需要再次等待
+    static void ProcessPending(int fd,
+                               TDevice &device,
+                               std::deque<TRequest> &requests,
+                               std::vector<TCompletionPacket> &packets)
+    {
+        while (!requests.empty()) {
+            TCompletionPacket packet;
+            if (!TryIO(fd, device, requests.front(), packet)) {
+                break;
+            }
+            packets.push_back(packet);
+            requests.pop_front();
+        }
+    }
+
+    void Run()
+    {
+        const int MAX_EVENTS = 64;
+        epoll_event events[MAX_EVENTS];
+        std::vector<TCompletionPacket> packets;
+        bool bQuit = false;
+        while (!bQuit) {
+            int nCount = ::epoll_wait(m_nEpollFd, events, MAX_EVENTS, -1);
+            if (nCount < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                assert(!"epoll_wait调用错误");
+                break;
+            }
+
+            packets.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                for (int i = 0; i < nCount; ++i) {
+                    int fd = events[i].data.fd;
+                    if (fd == m_nEventFd) {
+                        bQuit = true;
+                        continue;
+                    }
+                    auto it = m_devices.find(fd);
+                    if (it == m_devices.end()) {
+                        continue;
+                    }
+                    TDevice &device = it->second;
+                    ProcessPending(fd, device, device.m_reads, packets);
+                    ProcessPending(fd, device, device.m_writes, packets);
+                    if (!Arm(fd, device)) {
+                        CancelPending(device, errno, packets);
+                    }
+                }
+            }
+            m_port.Post(packets.data(), packets.size());
+        }
+    }
+
+    LinuxCompletionPort &m_port;
+    int m_nEpollFd = -1;
+    int m_nEventFd = -1; //通知IO线程退出
+
+    std::mutex m_lock;
+    std::unordered_map<int, TDevice> m_devices;
+    std::thread m_thread;
+};
+
+} // namespace
+
+std::unique_ptr<LinuxIOEngine> CreateUringIOEngine(LinuxCompletionPort &port)
+{
+    std::unique_ptr<UringIOEngine> spEngine(new (std::nothrow) UringIOEngine(port));
+    if (!spEngine || !spEngine->Init()) {
+        return nullptr;
+    }
+    return spEngine;
+}
+
+std::unique_ptr<LinuxIOEngine> CreateEpollIOEngine(LinuxCompletionPort &port)
+{
+    std::unique_ptr<EpollIOEngine> spEngine(new (std::nothrow) EpollIOEngine(port));
+    if (!spEngine || !spEngine->Init()) {
+        return nullptr;
+    }
+    return spEngine;
+}
+
+SHARELIB_END_NAMESPACE
+
+#endif
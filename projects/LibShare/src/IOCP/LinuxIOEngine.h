@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#ifndef _WIN32
+#    include <condition_variable>
+#    include <cstddef>
+#    include <deque>
+#    include <memory>
+#    include <mutex>
+#    include "IOCP/IOCPThreadPool.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+//完成包，对应GetQueuedCompletionStatus的输出，m_pfCallback为空表示退出
+struct TCompletionPacket
+{
+    TPFOnIOCompleted m_pfCallback;
+    DWORD m_dwErrno;
+    DWORD m_dwBytes;
+    LPOVERLAPPED m_pOverlapped;
+};
+
+/*!
+ * \class LinuxCompletionPort
+ * \brief 完成队列，代替IOCP，多线程安全
+ IO线程把完成的IO放入队列，线程池的工作线程取出后调用回调
+ */
+class LinuxCompletionPort
+{
+    SHARELIB_DISABLE_COPY_CLASS(LinuxCompletionPort);
+
+public:
+    LinuxCompletionPort() = default;
+
+    void Post(const TCompletionPacket &packet);
+
+    //一次放入多个，只加锁一次
+    void Post(const TCompletionPacket *pPackets, size_t nCount);
+
+    /** 取出一个完成包
+    @param[out] packet 完成包
+    @param[in] dwMilliseconds 等待时间，INFINITE表示一直等待
+    @return 超时返回false
+    */
+    bool Get(TCompletionPacket &packet, DWORD dwMilliseconds);
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_notEmpty;
+    std::deque<TCompletionPacket> m_packets;
+    size_t m_nWaiters = 0; //正在等待的线程数，没有等待的线程时不用notify
+};
+
+/*!
+ * \class LinuxIOEngine
+ * \brief 异步IO的实现，IO完成后放入完成队列，多线程安全
+ 回调函数保存在OVERLAPPED的Internal中，完成时字节数写入InternalHigh
+ */
+class LinuxIOEngine
+{
+public:
+    virtual ~LinuxIOEngine() {}
+
+    //实现方式
+    virtual TIOBackend GetBackend() const = 0;
+
+    //启动IO线程
+    virtual bool Start() = 0;
+
+    //停止IO线程，未完成的IO不再通知
+    virtual void Stop() = 0;
+
+    virtual bool Bind(int fd, TPFOnIOCompleted pfOnIOCompleted) = 0;
+
+    virtual void Unbind(int fd) = 0;
+
+    /** 提交读写，失败时设置errno
+    */
+    virtual bool Submit(int fd,
+                        bool bWrite,
+                        void *pBuffer,
+                        DWORD dwBytes,
+                        LPOVERLAPPED pOverlapped) = 0;
+};
+
+/** 创建io_uring的实现，内核不支持时返回空
+*/
+std::unique_ptr<LinuxIOEngine> CreateUringIOEngine(LinuxCompletionPort &port);
+
+/** 创建epoll的实现，失败时返回空
+*/
+std::unique_ptr<LinuxIOEngine> CreateEpollIOEngine(LinuxCompletionPort &port);
+
+SHARELIB_END_NAMESPACE
+
+#endif
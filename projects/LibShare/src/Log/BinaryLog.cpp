@@ -0,0 +1,435 @@
+﻿#ifndef _CRT_SECURE_NO_WARNINGS
+#    define _CRT_SECURE_NO_WARNINGS
+#endif
+#include "Log/BinaryLog.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <boost/date_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+SHARELIB_BEGIN_NAMESPACE
+
+namespace {
+
+struct TSiteRegistry
+{
+    std::mutex m_lock;
+    //deque扩展时已有元素不移动
+    std::deque<TBinaryLogSite> m_sites;
+};
+
+//不析构，进程退出时写文件线程可能还在查询
+TSiteRegistry &GetSiteRegistry()
+{
+    static TSiteRegistry *s_pRegistry = new TSiteRegistry;
+    return *s_pRegistry;
+}
+
+//一个已解码的参数
+struct TArg
+{
+    char m_tag = 0;
+    int64_t m_nInt = 0;
+    uint64_t m_nUint = 0;
+    double m_fDouble = 0;
+    const char *m_pStr = nullptr;
+    uint32_t m_nLength = 0;
+
+    long long AsSigned() const
+    {
+        switch (m_tag) {
+        case BINARY_LOG_ARG_INT:
+            return (long long)m_nInt;
+        case BINARY_LOG_ARG_DOUBLE:
+            return (long long)m_fDouble;
+        case BINARY_LOG_ARG_STRING:
+            return 0;
+        default:
+            return (long long)m_nUint;
+        }
+    }
+
+    unsigned long long AsUnsigned() const { return (unsigned long long)AsSigned(); }
+
+    double AsDouble() const
+    {
+        switch (m_tag) {
+        case BINARY_LOG_ARG_DOUBLE:
+            return m_fDouble;
+        case BINARY_LOG_ARG_INT:
+            return (double)m_nInt;
+        case BINARY_LOG_ARG_STRING:
+            return 0;
+        default:
+            return (double)m_nUint;
+        }
+    }
+};
+
+//按顺序读取参数
+class ArgReader
+{
+public:
+    ArgReader(const char *pArgs, size_t nArgBytes)
+        : m_pCur(pArgs)
+        , m_pEnd(pArgs + nArgBytes)
+    {}
+
+    //没有参数或数据错误时返回false
+    bool Next(TArg &arg)
+    {
+        if (m_pCur >= m_pEnd) {
+            return false;
+        }
+        arg.m_tag = *m_pCur++;
+        switch (arg.m_tag) {
+        case BINARY_LOG_ARG_INT:
+            return Read(&arg.m_nInt, sizeof(arg.m_nInt));
+        case BINARY_LOG_ARG_UINT:
+        case BINARY_LOG_ARG_POINTER:
+            return Read(&arg.m_nUint, sizeof(arg.m_nUint));
+        case BINARY_LOG_ARG_DOUBLE:
+            return Read(&arg.m_fDouble, sizeof(arg.m_fDouble));
+        case BINARY_LOG_ARG_STRING:
+            if (!Read(&arg.m_nLength, sizeof(arg.m_nLength)) ||
+                (size_t)(m_pEnd - m_pCur) < arg.m_nLength) {
+                m_pCur = m_pEnd;
+                return false;
+            }
+            arg.m_pStr = m_pCur;
+            m_pCur += arg.m_nLength;
+            return true;
+        default:
+            m_pCur = m_pEnd;
+            return false;
+        }
+    }
+
+private:
+    bool Read(void *pValue, size_t nSize)
+    {
+        if ((size_t)(m_pEnd - m_pCur) < nSize) {
+            m_pCur = m_pEnd;
+            return false;
+        }
+        std::memcpy(pValue, m_pCur, nSize);
+        m_pCur += nSize;
+        return true;
+    }
+
+    const char *m_pCur;
+    const char *m_pEnd;
+};
+
+//格式化后追加，不截断
+void AppendPrintf(std::string &strText, const char *pFmt, ...)
+{
+    char szBuff[128];
+    va_list vaParam;
+    va_start(vaParam, pFmt);
+    va_list vaCopy;
+    va_copy(vaCopy, vaParam);
+    int nWritten = std::vsnprintf(szBuff, sizeof(szBuff), pFmt, vaParam);
+    va_end(vaParam);
+    if (nWritten > 0 && (size_t)nWritten < sizeof(szBuff)) {
+        strText.append(szBuff, (size_t)nWritten);
+    } else if (nWritten > 0) {
+        size_t nOldSize = strText.size();
+        strText.resize(nOldSize + (size_t)nWritten + 1);
+        std::vsnprintf(&strText[nOldSize], (size_t)nWritten + 1, pFmt, vaCopy);
+        strText.resize(nOldSize + (size_t)nWritten);
+    }
+    va_end(vaCopy);
+}
+
+/** 按一个格式说明输出参数
+@param[in] strSpec '%'及标志、宽度、精度，不含长度修饰符及转换字符
+@param[in] conversion 转换字符
+*/
+void AppendArg(std::string &strSpec, char conversion, const TArg &arg, std::string &strText)
+{
+    switch (conversion) {
+    case 'd':
+    case 'i':
+        strSpec += "lld";
+        AppendPrintf(strText, strSpec.c_str(), arg.AsSigned());
+        break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        strSpec += "ll";
+        strSpec += conversion;
+        AppendPrintf(strText, strSpec.c_str(), arg.AsUnsigned());
+        break;
+    case 'c':
+        strSpec += 'c';
+        AppendPrintf(strText, strSpec.c_str(), (int)arg.AsSigned());
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        strSpec += conversion;
+        AppendPrintf(strText, strSpec.c_str(), arg.AsDouble());
+        break;
+    case 'p':
+        strSpec += 'p';
+        AppendPrintf(strText, strSpec.c_str(), (void *)(uintptr_t)arg.AsUnsigned());
+        break;
+    case 's':
+        if (arg.m_tag == BINARY_LOG_ARG_STRING) {
+            strSpec += 's';
+            AppendPrintf(
+                strText, strSpec.c_str(), std::string(arg.m_pStr, arg.m_nLength).c_str());
+        } else {
+            //参数不是字符串时按数值输出
+            std::string strValue;
+            if (arg.m_tag == BINARY_LOG_ARG_DOUBLE) {
+                AppendPrintf(strValue, "%g", arg.m_fDouble);
+            } else if (arg.m_tag == BINARY_LOG_ARG_INT) {
+                AppendPrintf(strValue, "%lld", arg.AsSigned());
+            } else {
+                AppendPrintf(strValue, "%llu", arg.AsUnsigned());
+            }
+            strSpec += 's';
+            AppendPrintf(strText, strSpec.c_str(), strValue.c_str());
+        }
+        break;
+    default:
+        //不支持的转换，原样输出
+        strText += strSpec;
+        strText += conversion;
+        break;
+    }
+}
+
+//按格式串输出全部参数
+void FormatArgs(const char *pFormat, const char *pArgs, size_t nArgBytes, std::string &strText)
+{
+    ArgReader reader{pArgs, nArgBytes};
+    std::string strSpec;
+    const char *p = pFormat;
+    while (*p) {
+        const char *pPercent = std::strchr(p, '%');
+        if (!pPercent) {
+            strText += p;
+            break;
+        }
+        strText.append(p, pPercent);
+        if (pPercent[1] == '%') {
+            strText += '%';
+            p = pPercent + 2;
+            continue;
+        }
+
+        const char *q = pPercent + 1;
+        q += std::strspn(q, "-+ #0");
+        q += std::strspn(q, "0123456789");
+        if (*q == '.') {
+            ++q;
+            q += std::strspn(q, "0123456789");
+        }
+        strSpec.assign(pPercent, q);
+        q += std::strspn(q, "hlLqjzt");
+        if (*q == '\0') {
+            strText += pPercent;
+            break;
+        }
+        p = q + 1;
+
+        TArg arg;
+        if (!reader.Next(arg)) {
+            //参数不足，原样输出格式说明
+            strText.append(pPercent, p);
+            continue;
+        }
+        AppendArg(strSpec, *q, arg, strText);
+    }
+}
+
+template<class... TArgs>
+void AppendRecord(std::string &strData,
+                  uint32_t nSiteId,
+                  uint64_t nTimestamp,
+                  const TArgs &... args)
+{
+    size_t nArgBytes = 0;
+    (void)std::initializer_list<int>{(nArgBytes += binary_log_detail::ArgSize(args), 0)...};
+    TBinaryLogHeader header{(uint32_t)(sizeof(header) + nArgBytes), nSiteId, nTimestamp};
+    size_t nOldSize = strData.size();
+    strData.resize(nOldSize + header.m_nSize);
+    char *pDst = &strData[nOldSize];
+    std::memcpy(pDst, &header, sizeof(header));
+    pDst += sizeof(header);
+    (void)std::initializer_list<int>{(binary_log_detail::EncodeArg(pDst, args), 0)...};
+}
+
+} // namespace
+
+uint32_t RegisterBinaryLogSite(const char *pFormat, const char *pFile, uint32_t nLine)
+{
+    TSiteRegistry &registry = GetSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.m_lock);
+    TBinaryLogSite site;
+    site.m_pFormat = pFormat ? pFormat : "";
+    site.m_pFile = pFile ? pFile : "";
+    site.m_nLine = nLine;
+    registry.m_sites.push_back(site);
+    return (uint32_t)(registry.m_sites.size() - 1);
+}
+
+bool GetBinaryLogSite(uint32_t nSiteId, TBinaryLogSite &site)
+{
+    TSiteRegistry &registry = GetSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.m_lock);
+    if (nSiteId >= registry.m_sites.size()) {
+        return false;
+    }
+    site = registry.m_sites[nSiteId];
+    return true;
+}
+
+const TBinaryLogClock &GetBinaryLogClock()
+{
+    static const TBinaryLogClock s_clock = []() {
+        TBinaryLogClock clock;
+        clock.m_nSteadyNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+        clock.m_nSystemUs = (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+        return clock;
+    }();
+    return s_clock;
+}
+
+void RenderBinaryLog(const TBinaryLogHeader &header,
+                     const char *pFormat,
+                     const char *pArgs,
+                     size_t nArgBytes,
+                     const TBinaryLogClock &clock,
+                     std::string &strText)
+{
+    int64_t nSystemUs =
+        clock.m_nSystemUs + ((int64_t)header.m_nTimestamp - (int64_t)clock.m_nSteadyNs) / 1000;
+    int64_t nSecond = nSystemUs / 1000000;
+    int64_t nMicrosecond = nSystemUs % 1000000;
+    if (nMicrosecond < 0) {
+        --nSecond;
+        nMicrosecond += 1000000;
+    }
+
+    //转换本地时间较慢，同一秒内的记录只转换一次
+    static thread_local int64_t s_nCachedSecond = INT64_MIN;
+    static thread_local long long s_nCachedDaySeconds = 0;
+    if (nSecond != s_nCachedSecond) {
+        using TLocalAdjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
+        auto localTime =
+            TLocalAdjustor::utc_to_local(boost::posix_time::from_time_t((std::time_t)nSecond));
+        s_nCachedDaySeconds = (long long)localTime.time_of_day().total_seconds();
+        s_nCachedSecond = nSecond;
+    }
+    AppendPrintf(strText,
+                 "[%02lld:%02lld:%02lld.%06lld]",
+                 s_nCachedDaySeconds / 3600,
+                 s_nCachedDaySeconds / 60 % 60,
+                 s_nCachedDaySeconds % 60,
+                 (long long)nMicrosecond);
+    FormatArgs(pFormat, pArgs, nArgBytes, strText);
+}
+
+void AppendBinaryLogPreamble(std::string &strData)
+{
+    const TBinaryLogClock &clock = GetBinaryLogClock();
+    AppendRecord(strData,
+                 BINARY_LOG_SITE_HEADER,
+                 clock.m_nSteadyNs,
+                 BINARY_LOG_MAGIC,
+                 (long long)clock.m_nSystemUs);
+}
+
+void AppendBinaryLogSiteDefine(uint32_t nSiteId, std::string &strData)
+{
+    TBinaryLogSite site;
+    if (GetBinaryLogSite(nSiteId, site)) {
+        AppendRecord(strData,
+                     BINARY_LOG_SITE_DEFINE,
+                     0,
+                     nSiteId,
+                     site.m_nLine,
+                     site.m_pFormat,
+                     site.m_pFile);
+    }
+}
+
+bool BinaryLogDecoder::Decode(const char *pData, size_t nSize, std::string &strText)
+{
+    m_pending.append(pData, nSize);
+    size_t nOffset = 0;
+    bool bResult = true;
+    while (m_pending.size() - nOffset >= sizeof(TBinaryLogHeader)) {
+        TBinaryLogHeader header;
+        std::memcpy(&header, m_pending.data() + nOffset, sizeof(header));
+        if (header.m_nSize < sizeof(header)) {
+            bResult = false;
+            break;
+        }
+        if (m_pending.size() - nOffset < header.m_nSize) {
+            break;
+        }
+        const char *pArgs = m_pending.data() + nOffset + sizeof(header);
+        size_t nArgBytes = header.m_nSize - sizeof(header);
+        nOffset += header.m_nSize;
+
+        ArgReader reader{pArgs, nArgBytes};
+        if (header.m_nSiteId == BINARY_LOG_SITE_HEADER) {
+            TArg magic;
+            TArg systemUs;
+            if (!reader.Next(magic) || magic.m_tag != BINARY_LOG_ARG_STRING ||
+                std::string(magic.m_pStr, magic.m_nLength) != BINARY_LOG_MAGIC ||
+                !reader.Next(systemUs)) {
+                bResult = false;
+                break;
+            }
+            //新的进程开始写入，格式串编号重新分配
+            m_clock.m_nSteadyNs = header.m_nTimestamp;
+            m_clock.m_nSystemUs = systemUs.AsSigned();
+            m_sites.clear();
+        } else if (header.m_nSiteId == BINARY_LOG_SITE_DEFINE) {
+            TArg id;
+            TArg line;
+            TArg format;
+            TArg file;
+            if (!reader.Next(id) || !reader.Next(line) || !reader.Next(format) ||
+                !reader.Next(file) || format.m_tag != BINARY_LOG_ARG_STRING ||
+                file.m_tag != BINARY_LOG_ARG_STRING) {
+                bResult = false;
+                break;
+            }
+            m_sites[(uint32_t)id.AsUnsigned()] =
+                std::make_pair(std::string(format.m_pStr, format.m_nLength),
+                               std::string(file.m_pStr, file.m_nLength));
+        } else {
+            auto it = m_sites.find(header.m_nSiteId);
+            if (it == m_sites.end()) {
+                AppendPrintf(strText, "[unknown format site %u]\n", header.m_nSiteId);
+            } else {
+                RenderBinaryLog(
+                    header, it->second.first.c_str(), pArgs, nArgBytes, m_clock, strText);
+            }
+        }
+    }
+    m_pending.erase(0, nOffset);
+    return bResult;
+}
+
+SHARELIB_END_NAMESPACE
@@ -8,16 +8,19 @@
 #endif
 
 #include "Log/BoostLog.h"
+#include <climits>
+#include <cstdio>
+#include <cstring>
 #include <locale>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 #include <boost/date_time.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/common.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
-#define BOOST_THREAD_USES_DATETIME
 #include <boost/log/sinks.hpp>
 #include <boost/log/sources/severity_channel_logger.hpp>
 #include <boost/log/utility/setup.hpp>
@@ -36,17 +39,232 @@ static const char NAMED_SCOPE_ATTR[] = "NAMED_SCOPE_ATTR";
 
 namespace default_names = boost::log::aux::default_attribute_names;
 
-template<typename Stream>
-void DefaultFormater(const boost::log::record_view &view, Stream &stream)
+namespace detail {
+std::atomic<int> g_minLogLevel{(int)LogLevel::debug};
+} // namespace detail
+
+namespace {
+
+//SetGlobalLogLevel 及 SetEnableLog 的设置，合并后写入 g_minLogLevel
+struct TGlobalLevelState
 {
-    stream << '['
-           << boost::log::extract<boost::log::attributes::local_clock::value_type>(
-                  default_names::timestamp(), view)
-           << ']';
+    std::mutex m_lock;
+    LogLevel m_level = LogLevel::debug;
+    bool m_bEnable = true;
+};
+
+TGlobalLevelState &GetGlobalLevelState()
+{
+    static TGlobalLevelState s_state;
+    return s_state;
+}
+
+void UpdateMinLogLevel(TGlobalLevelState &state)
+{
+    detail::g_minLogLevel.store(state.m_bEnable ? (int)state.m_level : INT_MAX,
+                                std::memory_order_relaxed);
+}
+
+//channel名字到编号的映射，只增不减. 故意不析构，静态对象析构时仍然可以写日志
+struct TChannelRegistry
+{
+    std::mutex m_lock;
+    std::unordered_map<std::string, uint32_t> m_ids;
+
+    TChannelRegistry()
+    {
+        m_ids.emplace(std::string(), 0);
+    }
+};
+
+TChannelRegistry &GetChannelRegistry()
+{
+    static TChannelRegistry *s_pRegistry = new TChannelRegistry();
+    return *s_pRegistry;
+}
+
+//sink接受的channel编号集合，构造后不再修改，过滤时不加锁
+class TChannelSet
+{
+public:
+    explicit TChannelSet(const std::vector<TLogChannel> &channels)
+    {
+        for (auto &channel : channels) {
+            size_t nWord = channel.m_nId / 64;
+            if (nWord >= m_bits.size()) {
+                m_bits.resize(nWord + 1, 0);
+            }
+            m_bits[nWord] |= (uint64_t)1 << (channel.m_nId % 64);
+        }
+    }
+
+    //集合为空表示接受所有channel
+    bool IsAll() const
+    {
+        return m_bits.empty();
+    }
+
+    bool Test(uint32_t nId) const
+    {
+        size_t nWord = nId / 64;
+        return nWord < m_bits.size() && ((m_bits[nWord] >> (nId % 64)) & 1) != 0;
+    }
+
+private:
+    std::vector<uint64_t> m_bits;
+};
+
+//时间戳的缓存，分钟不变时只格式化秒及小数部分. 每个线程一份，格式化线程可以有多个
+struct TTimestampCache
+{
+    int64_t m_nMinute = INT64_MIN;
+
+    //"2020-01-02 03:04:"
+    char m_prefix[32] = {};
+    size_t m_nPrefixSize = 0;
+};
+
+inline int64_t FloorDivide(int64_t nValue, int64_t nDivisor)
+{
+    int64_t nResult = nValue / nDivisor;
+    return (nValue % nDivisor < 0) ? nResult - 1 : nResult;
+}
+
+inline void AppendDigits(char *&pDst, uint64_t nValue, int nDigits)
+{
+    for (int i = nDigits - 1; i >= 0; --i) {
+        pDst[i] = (char)('0' + nValue % 10);
+        nValue /= 10;
+    }
+    pDst += nDigits;
+}
+
+/** 与 InitLog 中设置的iso extended格式相同，如"2020-01-02 03:04:05.123456"，小数为0时不输出
+@param[out] pBuffer 至少64字节
+@return 输出的长度，特殊值(not_a_date_time等)返回0
+*/
+size_t FormatTimestamp(const boost::posix_time::ptime &time, char *pBuffer)
+{
+    if (time.is_special()) {
+        return 0;
+    }
+    static const boost::posix_time::ptime s_epoch(boost::gregorian::date(1970, 1, 1));
+    const int64_t nTicksPerSecond = boost::posix_time::time_duration::ticks_per_second();
+    int64_t nTicks = (time - s_epoch).ticks();
+    int64_t nSeconds = FloorDivide(nTicks, nTicksPerSecond);
+    int64_t nFraction = nTicks - nSeconds * nTicksPerSecond;
+    int64_t nMinute = FloorDivide(nSeconds, 60);
+
+    thread_local TTimestampCache t_cache;
+    if (t_cache.m_nMinute != nMinute) {
+        auto ymd = time.date().year_month_day();
+        auto timeOfDay = time.time_of_day();
+        int nSize = std::snprintf(t_cache.m_prefix,
+                                  sizeof(t_cache.m_prefix),
+                                  "%04d-%02d-%02d %02d:%02d:",
+                                  (int)ymd.year,
+                                  (int)ymd.month,
+                                  (int)ymd.day,
+                                  (int)timeOfDay.hours(),
+                                  (int)timeOfDay.minutes());
+        if (nSize <= 0 || (size_t)nSize >= sizeof(t_cache.m_prefix)) {
+            return 0;
+        }
+        t_cache.m_nPrefixSize = (size_t)nSize;
+        t_cache.m_nMinute = nMinute;
+    }
+
+    char *pDst = pBuffer;
+    std::memcpy(pDst, t_cache.m_prefix, t_cache.m_nPrefixSize);
+    pDst += t_cache.m_nPrefixSize;
+    AppendDigits(pDst, (uint64_t)(nSeconds - nMinute * 60), 2);
+    if (nFraction != 0) {
+        *pDst++ = '.';
+        AppendDigits(pDst,
+                     (uint64_t)nFraction,
+                     (int)boost::posix_time::time_duration::num_fractional_digits());
+    }
+    return (size_t)(pDst - pBuffer);
+}
+
+/** __FILE__ 的文件名部分，指向原字符串. 按地址缓存，每个scope的位置只查找一次
+*/
+const char *GetFileBaseName(const char *pFile)
+{
+    struct TEntry
+    {
+        const char *m_pFile;
+        const char *m_pBaseName;
+    };
+    thread_local TEntry t_entries[64] = {};
+    TEntry &entry = t_entries[((uintptr_t)pFile >> 4) % 64];
+    if (entry.m_pFile != pFile) {
+        const char *pBaseName = pFile;
+        for (const char *p = pFile; *p; ++p) {
+            if (*p == '/' || *p == '\\') {
+                pBaseName = p + 1;
+            }
+        }
+        entry.m_pFile = pFile;
+        entry.m_pBaseName = pBaseName;
+    }
+    return entry.m_pBaseName;
+}
+
+//异步文件日志的前端
+using TAsyncFileSink = SimpleAsyncSink<boost::log::sinks::text_file_backend>;
+
+//回滚的文件已经按 target_file_name 改名，交给 LogArchiver 压缩及删除，不再移动
+class TArchiveFileCollector : public boost::log::sinks::file::collector
+{
+public:
+    TArchiveFileCollector(const TLogArchiveOptions &options, const TRotatedFileName &fileName)
+        : m_archiver(options, fileName)
+    {}
+
+    void store_file(const boost::filesystem::path &src_path) override
+    {
+        m_archiver.Submit(src_path.string());
+    }
+
+    //文件名中没有计数，不需要返回已有文件的个数
+    uintmax_t scan_for_files(boost::log::sinks::file::scan_method,
+                             const boost::filesystem::path &,
+                             unsigned int *counter) override
+    {
+        if (counter) {
+            *counter = 0;
+        }
+        m_archiver.Scan();
+        return 0;
+    }
+
+private:
+    LogArchiver m_archiver;
+};
+
+} // namespace
 
-    auto &&channel = boost::log::extract<std::string>(default_names::channel(), view);
+void DefaultFormater(const boost::log::record_view &view, boost::log::formatting_ostream &stream)
+{
+    //按名字查找属性名需要加锁，只查一次
+    static const boost::log::attribute_name s_scopeAttrName(NAMED_SCOPE_ATTR);
+
+    auto &&timestamp = boost::log::extract<boost::log::attributes::local_clock::value_type>(
+        default_names::timestamp(), view);
+    char timeBuffer[64];
+    size_t nTimeSize = timestamp ? FormatTimestamp(timestamp.get(), timeBuffer) : 0;
+    if (nTimeSize != 0) {
+        stream << '[';
+        stream.write(timeBuffer, (std::streamsize)nTimeSize);
+        stream << ']';
+    } else {
+        stream << '[' << timestamp << ']';
+    }
+
+    auto &&channel = boost::log::extract<TLogChannel>(default_names::channel(), view);
     if (channel) {
-        stream << '[' << channel.get() << ']';
+        stream << '[' << channel.get().m_pName << ']';
     }
 
     stream << '['
@@ -60,14 +278,11 @@ void DefaultFormater(const boost::log::record_view &view, Stream &stream)
     }
 
     auto &&scopeValue = boost::log::extract<boost::log::attributes::named_scope::value_type>(
-        NAMED_SCOPE_ATTR, view);
+        s_scopeAttrName, view);
     if (scopeValue && !scopeValue.get_ptr()->empty()) {
-        stream << '['
-               << boost::filesystem::path(scopeValue.get_ptr()->back().file_name.str())
-                      .filename()
-                      .string()
-               << '(' << scopeValue.get_ptr()->back().line << "),"
-               << scopeValue.get_ptr()->back().scope_name << ']';
+        auto &scope = scopeValue.get_ptr()->back();
+        stream << '[' << GetFileBaseName(scope.file_name.c_str()) << '(' << scope.line << "),"
+               << scope.scope_name << ']';
     }
 
     stream << boost::log::extract(boost::log::expressions::smessage, view);
@@ -115,6 +330,10 @@ void RemoveAllLogs()
 
 void SetEnableLog(bool is_enable)
 {
+    auto &state = GetGlobalLevelState();
+    std::lock_guard<std::mutex> lock(state.m_lock);
+    state.m_bEnable = is_enable;
+    UpdateMinLogLevel(state);
     boost::log::core::get()->set_logging_enabled(is_enable);
 }
 
@@ -138,13 +357,31 @@ const char *ToString(LogLevel level)
 
 void SetGlobalLogLevel(LogLevel level)
 {
-    boost::log::core::get()->set_filter(
-        [level](const boost::log::attribute_value_set &attrs) -> bool {
-            auto &&value = attrs[default_names::severity()];
-            if (value)
-                return value.extract<LogLevel>() >= level;
-            return true;
-        });
+    auto &state = GetGlobalLevelState();
+    std::lock_guard<std::mutex> lock(state.m_lock);
+    state.m_level = level;
+    UpdateMinLogLevel(state);
+}
+
+TLogChannel InternLogChannel(const char *pName)
+{
+    if (!pName || !*pName) {
+        return TLogChannel{};
+    }
+    return InternLogChannel(std::string(pName));
+}
+
+TLogChannel InternLogChannel(const std::string &name)
+{
+    auto &registry = GetChannelRegistry();
+    std::lock_guard<std::mutex> lock(registry.m_lock);
+    auto it = registry.m_ids.emplace(name, (uint32_t)registry.m_ids.size()).first;
+
+    //unordered_map的结点不会移动，名字的地址一直有效
+    TLogChannel channel;
+    channel.m_nId = it->second;
+    channel.m_pName = it->first.c_str();
+    return channel;
 }
 
 boost::shared_ptr<boost::log::sinks::sink> AddFileLog(const FileLogParam &param)
@@ -182,56 +419,65 @@ boost::shared_ptr<boost::log::sinks::sink> AddFileLog(const FileLogParam &param)
         // 日志收集
         auto log_dir = param.full_path_;
         log_dir.remove_filename();
-        auto spFileCollector = boost::log::sinks::file::make_collector(
-            boost::log::keywords::target = log_dir,
-            boost::log::keywords::max_size = param.max_backup_size_);
-        sp_backend->set_file_collector(spFileCollector);
+        if (param.archive_options_.IsEnabled()) {
+            //与 ROTATION_PATTERN 对应
+            TRotatedFileName file_name;
+            file_name.m_strDir = log_dir.string();
+            file_name.m_strPrefix = param.full_path_.stem().string() + "_";
+            file_name.m_strTimeMask = "########_######";
+            file_name.m_strSuffix = param.full_path_.extension().string();
+            sp_backend->set_file_collector(
+                boost::make_shared<TArchiveFileCollector>(param.archive_options_, file_name));
+        } else {
+            auto spFileCollector = boost::log::sinks::file::make_collector(
+                boost::log::keywords::target = log_dir,
+                boost::log::keywords::max_size = param.max_backup_size_);
+            sp_backend->set_file_collector(spFileCollector);
+        }
         sp_backend->scan_for_files();
     }
 
     boost::shared_ptr<boost::log::sinks::sink> sp_sink;
     {
-        // filter
-        auto filter = param.channel_filter_;
+        // filter, channel预先转换为编号
+        std::vector<TLogChannel> channels;
+        if (!param.channel_filter_.empty()) {
+            channels.push_back(InternLogChannel(param.channel_filter_));
+        }
+        for (auto &name : param.channel_filters_) {
+            if (!name.empty()) {
+                channels.push_back(InternLogChannel(name));
+            }
+        }
+        TChannelSet channel_set(channels);
         auto level = param.level_;
-        auto &&channel_filter = [filter,
+        auto &&channel_filter = [channel_set,
                                  level](const boost::log::attribute_value_set &attrs) -> bool {
-            auto &&severity = attrs[default_names::severity()];
+            auto &&severity = boost::log::extract<LogLevel>(default_names::severity(), attrs);
             assert(severity);
-            if (severity) {
-                if (severity.extract<LogLevel>() >= level) {
-                    if (filter.empty()) {
-                        return true;
-                    } else {
-                        auto &&channel = attrs[default_names::channel()];
-                        assert(channel);
-                        if (channel) {
-                            auto &&channel_value = channel.extract<std::string>();
-                            return channel_value == filter;
-                        }
-                    }
-                }
+            if (!severity || severity.get() < level) {
+                return false;
+            }
+            if (channel_set.IsAll()) {
+                return true;
             }
-            return false;
+            auto &&channel = boost::log::extract<TLogChannel>(default_names::channel(), attrs);
+            assert(channel);
+            return channel && channel_set.Test(channel.get().m_nId);
         };
 
         // frontend
         if (param.is_async_) {
-            using TSinkFrontend =
-                SimpleAsyncSink<TSinkBackend,
-                                boost::log::sinks::bounded_fifo_queue<
-                                    500000,
-                                    boost::log::sinks::drop_on_overflow // 日志最大数量，超出丢掉
-                                    >>;
-            auto sp_frontend = boost::make_shared<TSinkFrontend>(sp_backend);
+            using TSinkFrontend = TAsyncFileSink;
+            auto sp_frontend = boost::make_shared<TSinkFrontend>(sp_backend, param.async_options_);
             sp_sink = sp_frontend;
-            sp_frontend->set_formatter(&DefaultFormater<TSinkFrontend::stream_type>);
+            sp_frontend->set_formatter(&DefaultFormater);
             sp_frontend->set_filter(channel_filter);
         } else {
             using TSinkFrontend = boost::log::sinks::synchronous_sink<TSinkBackend>;
             auto sp_frontend = boost::make_shared<TSinkFrontend>(sp_backend);
             sp_sink = sp_frontend;
-            sp_frontend->set_formatter(&DefaultFormater<TSinkFrontend::stream_type>);
+            sp_frontend->set_formatter(&DefaultFormater);
             sp_frontend->set_filter(channel_filter);
         }
     }
@@ -242,6 +488,17 @@ boost::shared_ptr<boost::log::sinks::sink> AddFileLog(const FileLogParam &param)
     return sp_sink;
 }
 
+bool GetFileLogStats(const boost::shared_ptr<boost::log::sinks::sink> &sp_log,
+                     TAsyncSinkStats &stats)
+{
+    auto sp_async = boost::dynamic_pointer_cast<TAsyncFileSink>(sp_log);
+    if (!sp_async) {
+        return false;
+    }
+    stats = sp_async->get_stats();
+    return true;
+}
+
 void RemoveFileLog(boost::shared_ptr<boost::log::sinks::sink> sp_log)
 {
     boost::log::core::get()->remove_sink(sp_log);
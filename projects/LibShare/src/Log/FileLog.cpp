@@ -3,32 +3,68 @@
 #    define _CRT_SECURE_NO_WARNINGS
 #endif
 #include "Log/FileLog.h"
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <locale>
 #include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include <boost/date_time.hpp>
 #include <boost/dll.hpp>
-#include <atlmem.h>
-#include <process.h>
-#include <shellapi.h>
-#include <strsafe.h>
-#include <windows.h>
+#include "Log/BinaryLog.h"
+#include "LogBufferArena.h"
 #include "LogFileManager.h"
-#include "Other/VersionTime.h"
+#include "MappedLogFile.h"
 #include "Thread/lockfree_queue.h"
+#include "Thread/thread_lock.h"
+
+#ifdef _WIN32
+#    include <shellapi.h>
+#    include <windows.h>
+#    include "Other/VersionTime.h"
+#else
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
 
 SHARELIB_BEGIN_NAMESPACE
 
 static bool g_bOneLogPerProcess = false;
+static bool g_bMappedLogFile = false;
+static TLogArchiveOptions g_archiveOptions;
 
 void SetGlobalOneLogPerProcess(bool bOneLogPerProcess)
 {
     g_bOneLogPerProcess = bOneLogPerProcess;
 }
 
+void SetGlobalMappedLogFile(bool bMappedFile)
+{
+    g_bMappedLogFile = bMappedFile;
+}
+
+void SetGlobalLogArchiveOptions(const TLogArchiveOptions &options)
+{
+    g_archiveOptions = options;
+}
+
+//当前线程的系统线程号
+static unsigned int GetThreadIdNumber()
+{
+#ifdef _WIN32
+    return ::GetCurrentThreadId();
+#else
+    static thread_local unsigned int s_nTid = (unsigned int)::syscall(SYS_gettid);
+    return s_nTid;
+#endif
+}
+
 struct LogBuffer
 {
     char *m_pBuffer = nullptr;
@@ -39,6 +75,7 @@ struct LogBuffer
 enum class OP_TYPE
 {
     WRITE_LOG,
+    WRITE_BINARY, //二进制日志，缓冲区以TBinaryLogHeader开头
     DELETE_TODAY_BEFORE,
     DELETE_ALL,
     QUIT_LOG,
@@ -52,16 +89,20 @@ struct _LogCache
 
 struct FileLog::TImpl
 {
-    TImpl()
-        : m_memPool(0, 0){};
-
-    ~TImpl()
+    enum : size_t
     {
-        if (m_hThread) {
-            ::CloseHandle(m_hThread);
-            m_hThread = nullptr;
-        }
-    }
+        //写文件线程一次最多取出的日志个数
+        WRITE_BATCH_COUNT = 64,
+
+        //持续有日志时，写入这么多字节后落盘一次
+        FLUSH_BYTES = 4 * 1024 * 1024,
+
+        //持续有日志时，最长的落盘间隔(毫秒)
+        FLUSH_INTERVAL_MS = 1000,
+    };
+
+    TImpl()
+        : m_threadExit(true, false){};
 
     void AddRef() { ++m_refCount; }
 
@@ -76,8 +117,19 @@ struct FileLog::TImpl
     {
         if (!m_bInitOK) {
             std::call_once(m_initFlag, [this]() {
-                m_bInitOK = m_logFileManager.SetLogPathAndName(
-                    m_paramPath.c_str(), m_paramName.c_str(), m_bOneLogPerProcess);
+                if (m_bMappedFile) {
+                    //映射模式没有写文件线程，在这里写入开头信息
+                    m_mappedFile.SetArchiveOptions(m_archiveOptions);
+                    m_bInitOK = m_mappedFile.SetLogPathAndName(
+                        m_paramPath.c_str(), m_paramName.c_str(), m_bOneLogPerProcess);
+                    if (m_bInitOK) {
+                        WriteStartInfo();
+                    }
+                } else {
+                    m_logFileManager.SetArchiveOptions(m_archiveOptions);
+                    m_bInitOK = m_logFileManager.SetLogPathAndName(
+                        m_paramPath.c_str(), m_paramName.c_str(), m_bOneLogPerProcess);
+                }
             });
         }
         return m_bInitOK;
@@ -89,60 +141,66 @@ struct FileLog::TImpl
             return false;
         }
         std::lock_guard<decltype(m_handleLock)> lock(m_handleLock);
-        if (NULL == m_hThread) {
-            m_hThread = (HANDLE)_beginthreadex(NULL, 0, TImpl::ThreadFunc, this, 0, NULL);
-            if (NULL == m_hThread) {
-                char *pszErrMsg = NULL;
-                ::FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |
-                                     FORMAT_MESSAGE_IGNORE_INSERTS,
-                                 NULL,
-                                 GetLastError(),
-                                 0,
-                                 (LPSTR)(&pszErrMsg),
-                                 0,
-                                 NULL);
-                std::string strCombMsg = std::string("创建日志线程失败，原因：") +
-                                         std::string(pszErrMsg);
-                ::LocalFree(pszErrMsg);
+        if (!m_bThreadStarted.load()) {
+            //线程结束时释放引用
+            AddRef();
+            try {
+                //分离线程，进程退出时不等待
+                std::thread(TImpl::ThreadFunc, this).detach();
+            } catch (const std::system_error &e) {
+                Release();
+                std::string strCombMsg = std::string("创建日志线程失败，原因：") + e.what();
                 m_logFileManager.Write(strCombMsg.c_str(), strCombMsg.size());
                 return false;
-            } else {
-                AddRef();
             }
+            m_bThreadStarted.store(true);
         }
         return true;
     }
 
+    //缓冲区由FileLogOstream按tellp确定有效长度，不需要清零
     LogBuffer GetLogBuffer(size_t nSize)
     {
         LogBuffer buffer;
-        char *p = (char *)m_memPool.Allocate(nSize);
-        if (p) {
-            buffer.m_pBuffer = p;
-            buffer.m_nBufSize = nSize;
-            std::memset(p, 0, nSize);
-        }
+        buffer.m_pBuffer = LogBufferArena::Allocate(nSize, buffer.m_nBufSize);
         return buffer;
     }
 
-    bool WriteLog(const LogBuffer &log)
+    bool WriteLog(const LogBuffer &log, OP_TYPE opType = OP_TYPE::WRITE_LOG)
     {
         if (!Init()) {
             return false;
         }
         if ((NULL == log.m_pBuffer) || (0 == log.m_nLoglength)) {
-            if (NULL != log.m_pBuffer) {
-                m_memPool.Free(log.m_pBuffer);
-            }
+            LogBufferArena::Free(log.m_pBuffer);
             return true;
         }
+        if (m_bMappedFile) {
+            bool bResult = false;
+            if (opType == OP_TYPE::WRITE_BINARY) {
+                //映射模式没有写文件线程，只能在当前线程转换成文本
+                static thread_local std::string s_strText;
+                TBinaryLogSite site;
+                s_strText.clear();
+                if (GetBinaryLogSite(reinterpret_cast<TBinaryLogHeader *>(log.m_pBuffer)->m_nSiteId,
+                                     site)) {
+                    RenderBinary(log, site, s_strText);
+                }
+                bResult = m_mappedFile.Write(s_strText.c_str(), s_strText.size());
+            } else {
+                bResult = m_mappedFile.Write(log.m_pBuffer, log.m_nLoglength);
+            }
+            LogBufferArena::Free(log.m_pBuffer);
+            return bResult;
+        }
 
-        if (!m_hThread && !Start()) {
+        if (!m_bThreadStarted.load() && !Start()) {
             assert(!"日志线程启动失败");
             return false;
         }
 
         _LogCache temp;
+        temp.m_opType = opType;
         temp.m_log = log;
         m_logQueue.push(temp);
         return true;
@@ -150,126 +208,316 @@ struct FileLog::TImpl
 
     void Stop()
     {
-        if (m_hThread && ::WaitForSingleObject(m_hThread, 0) == WAIT_OBJECT_0) {
-            Release();
-        } else if (m_hThread) {
+        if (m_bMappedFile) {
+            if (m_bInitOK) {
+                m_mappedFile.Write("[log end]\n");
+            }
+        } else if (m_bThreadStarted.load()) {
+            //进程退出时线程可能已被系统结束，最多等待200毫秒，此时不再释放线程持有的引用
             _LogCache temp;
             temp.m_opType = OP_TYPE::QUIT_LOG;
             m_logQueue.push(temp);
-            ::WaitForSingleObject(m_hThread, 200);
+            m_threadExit.Wait(200);
         }
     }
 
-    static unsigned int __stdcall ThreadFunc(void *pVoid)
+    //写入一段文本，非映射模式下只能在写文件线程调用
+    void WriteText(const std::string &strText)
     {
-        TImpl *pThis = static_cast<TImpl *>(pVoid);
+        if (m_bMappedFile) {
+            m_mappedFile.Write(strText.c_str(), strText.size());
+        } else {
+            m_logFileManager.Write(strText.c_str(), strText.size());
+        }
+    }
+
+    //写入模块路径及版本号
+    void WriteModuleInfo(const char *pTitle, const boost::filesystem::path &modulePath)
+    {
+        std::string strInfo = pTitle + modulePath.string();
+#ifdef _WIN32
         auto &cvtFacet = std::use_facet<boost::filesystem::path::codecvt_type>(std::locale());
         std::wstring_convert<std::remove_reference_t<decltype(cvtFacet)>> cvt(&cvtFacet);
-        _LogCache oneLog;
-
-        {
-            {
-                SYSTEMTIME sysTime{};
-                ::GetLocalTime(&sysTime);
-
-                char szBuff[50]{};
-                ::StringCbPrintfA(szBuff,
-                                  sizeof(szBuff),
-                                  "[log start][%I64u][%02hu:%02hu:%02hu.%03hu]\n",
-                                  std::chrono::duration_cast<std::chrono::milliseconds>(
-                                      std::chrono::high_resolution_clock::now().time_since_epoch())
-                                      .count(),
-                                  sysTime.wHour,
-                                  sysTime.wMinute,
-                                  sysTime.wSecond,
-                                  sysTime.wMilliseconds);
-                pThis->m_logFileManager.Write(szBuff);
-            }
+        auto strVer = GetModuleVersion(modulePath.wstring().c_str());
+        if (!strVer.empty()) {
+            strInfo += ", version:";
+            strInfo += cvt.to_bytes(strVer);
+        }
+#endif
+        strInfo += '\n';
+        WriteText(strInfo);
+    }
+
+    //写入开始时间及模块信息
+    void WriteStartInfo()
+    {
+        auto &&timeOfDay = boost::posix_time::microsec_clock::local_time().time_of_day();
+        char szBuff[64]{};
+        std::snprintf(
+            szBuff,
+            sizeof(szBuff),
+            "[log start][%llu][%02lld:%02lld:%02lld.%03lld]\n",
+            (unsigned long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now().time_since_epoch())
+                .count(),
+            (long long)timeOfDay.hours(),
+            (long long)timeOfDay.minutes(),
+            (long long)timeOfDay.seconds(),
+            (long long)(timeOfDay.total_milliseconds() % 1000));
+        WriteText(szBuff);
+
+        boost::system::error_code ec;
+        auto programPath = boost::dll::program_location(ec);
+        if (!ec) {
+            WriteModuleInfo("exe: ", programPath);
+        }
+
+        auto modulePath = boost::dll::this_line_location(ec);
+        if (!ec && programPath != modulePath) {
+            WriteModuleInfo("module: ", modulePath);
+        }
+    }
+
+    const std::string &GetLogFullPath() const
+    {
+        return m_bMappedFile ? m_mappedFile.GetLogFullPath() : m_logFileManager.GetLogFullPath();
+    }
+
+    //把一条二进制日志转换成文本
+    static void RenderBinary(const LogBuffer &log, const TBinaryLogSite &site, std::string &strText)
+    {
+        TBinaryLogHeader header;
+        std::memcpy(&header, log.m_pBuffer, sizeof(header));
+        RenderBinaryLog(header,
+                        site.m_pFormat,
+                        log.m_pBuffer + sizeof(header),
+                        log.m_nLoglength - sizeof(header),
+                        GetBinaryLogClock(),
+                        strText);
+    }
+
+    //写文件线程转换二进制日志，缓存查询过的格式串
+    void RenderBinary(const LogBuffer &log, std::string &strText)
+    {
+        uint32_t nSiteId = reinterpret_cast<TBinaryLogHeader *>(log.m_pBuffer)->m_nSiteId;
+        if (nSiteId >= m_binarySites.size()) {
+            m_binarySites.resize(nSiteId + 1);
+        }
+        TBinaryLogSite &site = m_binarySites[nSiteId];
+        if (site.m_pFormat || GetBinaryLogSite(nSiteId, site)) {
+            RenderBinary(log, site, strText);
+        }
+    }
+
+    //原样写入二进制日志，格式串第一次出现时先写入其定义，只在写文件线程调用
+    void AppendRawBinary(const LogBuffer &log)
+    {
+        if (!m_bBinaryFileOpened) {
+            //文件名为文本日志的名字加"_bin"，进程号已包含在文本日志的名字中
+            m_bBinaryFileOpened = true;
+            std::string strName =
+                boost::filesystem::path(m_logFileManager.GetLogFullPath()).stem().string();
+            strName += "_bin";
+            m_binaryFileManager.SetArchiveOptions(m_archiveOptions);
+            m_binaryFileManager.SetLogPathAndName(m_paramPath.c_str(), strName.c_str(), false);
+        }
+        if (m_nBinaryGeneration != m_binaryFileManager.GetFileGeneration()) {
+            //回滚或清空后是新文件，重新写入文件头及格式串定义，每个文件都能单独解码
+            m_nBinaryGeneration = m_binaryFileManager.GetFileGeneration();
+            m_binaryDefined.clear();
+        }
+        if (m_binaryDefined.empty()) {
+            AppendBinaryLogPreamble(m_binaryText);
+        }
+        uint32_t nSiteId = reinterpret_cast<TBinaryLogHeader *>(log.m_pBuffer)->m_nSiteId;
+        if (nSiteId >= m_binaryDefined.size()) {
+            m_binaryDefined.resize(nSiteId + 1, false);
+        }
+        if (!m_binaryDefined[nSiteId]) {
+            m_binaryDefined[nSiteId] = true;
+            AppendBinaryLogSiteDefine(nSiteId, m_binaryText);
+        }
+        m_binaryText.append(log.m_pBuffer, log.m_nLoglength);
+    }
 
-            boost::system::error_code ec;
-            auto programPath = boost::dll::program_location(ec);
-            if (!ec) {
-                pThis->m_logFileManager.Write("exe: ");
-                pThis->m_logFileManager.Write(programPath.string().c_str());
-                auto strVer = GetModuleVersion(programPath.wstring().c_str());
-                if (!strVer.empty()) {
-                    pThis->m_logFileManager.Write(", version:");
-                    pThis->m_logFileManager.Write(cvt.to_bytes(strVer).c_str());
+    /** 一次写入连续的多条日志，并归还缓冲区
+    @return 写入的字节数
+    */
+    size_t WriteLogs(_LogCache *pLogs, size_t nCount)
+    {
+        //先转换全部二进制日志，m_renderText不再扩展后才能取指针
+        size_t renderEnd[WRITE_BATCH_COUNT];
+        m_renderText.clear();
+        for (size_t i = 0; i < nCount; ++i) {
+            if (pLogs[i].m_opType == OP_TYPE::WRITE_BINARY) {
+                if (m_bBinaryRaw) {
+                    AppendRawBinary(pLogs[i].m_log);
+                } else {
+                    RenderBinary(pLogs[i].m_log, m_renderText);
                 }
-                pThis->m_logFileManager.Write("\n");
             }
+            renderEnd[i] = m_renderText.size();
+        }
 
-            auto modulePath = boost::dll::this_line_location(ec);
-            if (!ec && programPath != modulePath) {
-                pThis->m_logFileManager.Write("module: ");
-                pThis->m_logFileManager.Write(modulePath.string().c_str());
-                auto strVer = GetModuleVersion(modulePath.wstring().c_str());
-                if (!strVer.empty()) {
-                    pThis->m_logFileManager.Write(", version:");
-                    pThis->m_logFileManager.Write(cvt.to_bytes(strVer).c_str());
-                }
-                pThis->m_logFileManager.Write("\n");
+        TLogSlice slices[WRITE_BATCH_COUNT];
+        size_t nSlices = 0;
+        size_t nBytes = 0;
+        for (size_t i = 0; i < nCount; ++i) {
+            TLogSlice &slice = slices[nSlices];
+            if (pLogs[i].m_opType == OP_TYPE::WRITE_LOG) {
+                slice.m_pData = pLogs[i].m_log.m_pBuffer;
+                slice.m_nSize = pLogs[i].m_log.m_nLoglength;
+            } else {
+                size_t nBegin = (i == 0) ? 0 : renderEnd[i - 1];
+                slice.m_pData = m_renderText.data() + nBegin;
+                slice.m_nSize = renderEnd[i] - nBegin;
+            }
+            if (slice.m_nSize > 0) {
+                nBytes += slice.m_nSize;
+                ++nSlices;
             }
         }
-        for (;;) {
-            if (!pThis->m_logQueue.try_pop(oneLog)) {
-                //缓冲区已空
-                pThis->m_logFileManager.Flush();
-                while (!pThis->m_logQueue.try_pop(oneLog)) {
-                    ::Sleep(30);
-                }
+        if (nSlices > 0) {
+            m_logFileManager.Write(slices, nSlices);
+        }
+        if (!m_binaryText.empty()) {
+            nBytes += m_binaryText.size();
+            m_binaryFileManager.Write(m_binaryText.data(), m_binaryText.size());
+            m_binaryText.clear();
+        }
+        for (size_t i = 0; i < nCount; ++i) {
+            LogBufferArena::Free(pLogs[i].m_log.m_pBuffer);
+        }
+        return nBytes;
+    }
+
+    //两个日志文件都落盘
+    void Flush()
+    {
+        m_logFileManager.Flush();
+        if (m_bBinaryFileOpened) {
+            m_binaryFileManager.Flush();
+        }
+    }
+
+    /** 执行删除日志操作。二进制文件与文本日志在同一文件夹下，一起删除，两个当前文件都保留；
+    二进制文件被清空后，下次写入时重新写入文件头及格式串定义
+    */
+    void DeleteLogFile(bool bDeleteAll)
+    {
+        m_logFileManager.DeleteLogFile(bDeleteAll,
+                                       m_bBinaryFileOpened ? &m_binaryFileManager : nullptr);
+    }
+
+    static void ThreadFunc(TImpl *pThis)
+    {
+        _LogCache logs[WRITE_BATCH_COUNT];
+        pThis->WriteStartInfo();
+
+        size_t nUnflushedBytes = 0;
+        auto lastFlushTime = std::chrono::steady_clock::now();
+        bool bQuit = false;
+        while (!bQuit) {
+            size_t nCount = pThis->m_logQueue.try_pop_bulk(logs, WRITE_BATCH_COUNT);
+            if (nCount == 0) {
+                //缓冲区已空，落盘后挂起等待新日志
+                pThis->Flush();
+                nUnflushedBytes = 0;
+                pThis->m_logQueue.pop_wait(logs[0]);
+                lastFlushTime = std::chrono::steady_clock::now();
+                nCount = 1 + pThis->m_logQueue.try_pop_bulk(logs + 1, WRITE_BATCH_COUNT - 1);
             }
 
-            if (oneLog.m_opType == OP_TYPE::WRITE_LOG) {
-                if (0 != oneLog.m_log.m_nLoglength) {
-                    pThis->m_logFileManager.Write(oneLog.m_log.m_pBuffer,
-                                                  oneLog.m_log.m_nLoglength);
+            //连续的日志一次写入，遇到其它操作时先写入前面的日志，保持顺序
+            size_t nRunStart = 0;
+            for (size_t i = 0; i < nCount; ++i) {
+                if (logs[i].m_opType == OP_TYPE::WRITE_LOG ||
+                    logs[i].m_opType == OP_TYPE::WRITE_BINARY) {
+                    continue;
                 }
-                pThis->m_memPool.Free(oneLog.m_log.m_pBuffer);
-            } else if (oneLog.m_opType == OP_TYPE::QUIT_LOG) {
-                break;
-            } else {
-                pThis->m_logFileManager.DeleteLogFile(oneLog.m_opType == OP_TYPE::DELETE_ALL);
+                nUnflushedBytes += pThis->WriteLogs(logs + nRunStart, i - nRunStart);
+                nRunStart = i + 1;
+                if (logs[i].m_opType == OP_TYPE::QUIT_LOG) {
+                    bQuit = true;
+                } else {
+                    pThis->DeleteLogFile(logs[i].m_opType == OP_TYPE::DELETE_ALL);
+                }
+            }
+            nUnflushedBytes += pThis->WriteLogs(logs + nRunStart, nCount - nRunStart);
+
+            //持续有日志时队列不会变空，按大小和时间落盘
+            auto curTime = std::chrono::steady_clock::now();
+            if (nUnflushedBytes >= FLUSH_BYTES ||
+                curTime - lastFlushTime >= std::chrono::milliseconds(FLUSH_INTERVAL_MS)) {
+                pThis->Flush();
+                nUnflushedBytes = 0;
+                lastFlushTime = curTime;
             }
         }
 
         pThis->m_logFileManager.Write("[log end]\n");
+        pThis->m_threadExit.SetEvent();
         pThis->Release();
-        return 0;
     }
 
     std::atomic<size_t> m_refCount{0};
-    std::string m_paramPath;          //路径参数
-    std::string m_paramName;          //名字参数
-    bool m_bOneLogPerProcess = false; //进程模型参数
+    std::string m_paramPath;             //路径参数
+    std::string m_paramName;             //名字参数
+    bool m_bOneLogPerProcess = false;    //进程模型参数
+    bool m_bMappedFile = false;          //映射模式参数
+    bool m_bBinaryRaw = false;           //二进制日志原样写入参数
+    TLogArchiveOptions m_archiveOptions; //回滚文件的压缩及保留参数
     LogFileManager m_logFileManager;
-    lockfree_queue<_LogCache> m_logQueue;
-    ATL::CWin32Heap m_memPool;
-    bool m_bInitOK = false;
+    //以下只在写文件线程使用
+    LogFileManager m_binaryFileManager;
+    bool m_bBinaryFileOpened = false;
+    std::string m_renderText;
+    std::string m_binaryText;
+    //已查询的格式串，按编号索引
+    std::vector<TBinaryLogSite> m_binarySites;
+    //当前二进制文件中已写入定义的格式串，为空表示还没有写入文件头
+    std::vector<bool> m_binaryDefined;
+    //m_binaryDefined 对应的二进制文件序号
+    uint64_t m_nBinaryGeneration = 0;
+    //映射模式下直接写入，不使用队列及写文件线程
+    MappedLogFile m_mappedFile;
+    //只有写文件线程读取
+    lockfree_queue<_LogCache, std::allocator<_LogCache>, lockfree_compact_layout, lockfree_mpsc>
+        m_logQueue;
+    std::atomic<bool> m_bInitOK{false};
     std::once_flag m_initFlag;
-    HANDLE m_hThread = nullptr;
+    std::atomic<bool> m_bThreadStarted{false};
+    //写文件线程退出
+    EventLock m_threadExit;
     std::mutex m_handleLock;
 };
 
 //--------------------------------------------------------------------------------------
 
+//全局日志，第一次使用时构造
+static FileLog *GetGlobalLog()
+{
+    static FileLog *s_pGlobalLog = nullptr;
+    static std::once_flag s_globalInitFlag;
+    if (!s_pGlobalLog) {
+        std::call_once(s_globalInitFlag, []() {
+            static FileLog s_log{nullptr, nullptr, g_bOneLogPerProcess, g_bMappedLogFile};
+            s_log.SetArchiveOptions(g_archiveOptions);
+            s_pGlobalLog = &s_log;
+        });
+    }
+    return s_pGlobalLog;
+}
+
 FileLogOstream::FileLogOstream(FileLog *pLog,
                                size_t bufLen,
                                bool bTime /*= false*/,
                                int nLine /*= 0*/)
-    : m_pLog(pLog)
-    , std::ostream(&m_buf)
+    : std::ostream(&m_buf)
+    , m_pLog(pLog)
 {
     if (!m_pLog) {
-        static FileLog *s_pGlobalLog = nullptr;
-        static std::once_flag s_globalInitFlag;
-        if (!s_pGlobalLog) {
-            std::call_once(s_globalInitFlag, []() {
-                static FileLog s_log{nullptr, nullptr, g_bOneLogPerProcess};
-                s_pGlobalLog = &s_log;
-            });
-        }
-        m_pLog = s_pGlobalLog;
+        m_pLog = GetGlobalLog();
     }
     if (!m_pLog) {
         return;
@@ -295,21 +543,21 @@ FileLogOstream::FileLogOstream(FileLog *pLog,
         //}
     }
     if (bTime) {
-        Printf("[%I64u]",
-               std::chrono::duration_cast<std::chrono::milliseconds>(
+        Printf("[%llu]",
+               (unsigned long long)std::chrono::duration_cast<std::chrono::milliseconds>(
                    std::chrono::high_resolution_clock::now().time_since_epoch())
                    .count());
     } else {
         //用<<输出time_of_day速度较慢
         auto &&timeOfDay = boost::posix_time::microsec_clock::local_time().time_of_day();
-        Printf("[%02I64d:%02I64d:%02I64d.%06I64d]",
-               timeOfDay.hours(),
-               timeOfDay.minutes(),
-               timeOfDay.seconds(),
-               timeOfDay.fractional_seconds());
+        Printf("[%02lld:%02lld:%02lld.%06lld]",
+               (long long)timeOfDay.hours(),
+               (long long)timeOfDay.minutes(),
+               (long long)timeOfDay.seconds(),
+               (long long)timeOfDay.fractional_seconds());
     }
     if (nLine > 0) {
-        Printf("[Tid:%u][L:%u]", ::GetCurrentThreadId(), nLine);
+        Printf("[Tid:%u][L:%u]", GetThreadIdNumber(), nLine);
     }
 }
 
@@ -329,25 +577,57 @@ FileLogOstream &FileLogOstream::Printf(const char *pFmt, ...)
     if (m_pLog && m_buf.get_buffer() && (m_buf.get_buffer_size() > tellp())) {
         va_list vaParam;
         va_start(vaParam, pFmt);
-        char *pEnd = nullptr;
-        ::StringCchVPrintfExA(m_buf.get_buffer() + (std::streamoff)tellp(),
-                              (size_t)(m_buf.get_buffer_size() - tellp()),
-                              &pEnd,
-                              nullptr,
-                              0,
-                              pFmt,
-                              vaParam);
-        seekp(pEnd - m_buf.get_buffer());
+        std::streamoff nPos = (std::streamoff)tellp();
+        size_t nLeft = (size_t)(m_buf.get_buffer_size() - nPos);
+        int nWritten = std::vsnprintf(m_buf.get_buffer() + nPos, nLeft, pFmt, vaParam);
         va_end(vaParam);
+        if (nWritten > 0) {
+            //空间不足时被截断，末尾保留'\0'
+            seekp(nPos + (std::streamoff)(std::min)((size_t)nWritten, nLeft - 1));
+        }
     }
     return *this;
 }
 
 //---------------------------------------------------------------------------
 
+BinaryLogRecord::BinaryLogRecord(FileLog *pLog, uint32_t nSiteId, size_t nArgBytes)
+    : m_pLog(pLog ? pLog : GetGlobalLog())
+{
+    if (!m_pLog) {
+        return;
+    }
+    TBinaryLogHeader header;
+    header.m_nSize = (uint32_t)(sizeof(header) + nArgBytes);
+    header.m_nSiteId = nSiteId;
+    header.m_nTimestamp = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch())
+                              .count();
+    size_t nRealSize = 0;
+    m_pBuffer = LogBufferArena::Allocate(header.m_nSize, nRealSize);
+    if (m_pBuffer) {
+        std::memcpy(m_pBuffer, &header, sizeof(header));
+        m_pArgs = m_pBuffer + sizeof(header);
+        m_nSize = header.m_nSize;
+    }
+}
+
+BinaryLogRecord::~BinaryLogRecord()
+{
+    if (m_pBuffer) {
+        LogBuffer logbuf;
+        logbuf.m_pBuffer = m_pBuffer;
+        logbuf.m_nLoglength = m_nSize;
+        m_pLog->m_pImpl->WriteLog(logbuf, OP_TYPE::WRITE_BINARY);
+    }
+}
+
+//---------------------------------------------------------------------------
+
 FileLog::FileLog(const char *pPath /*= nullptr*/,
                  const char *pName /*= nullptr*/,
-                 bool bOneLogPerProcess /*= false*/)
+                 bool bOneLogPerProcess /*= false*/,
+                 bool bMappedFile /*= false*/)
 {
     m_pImpl = new TImpl;
     m_pImpl->AddRef();
@@ -359,6 +639,7 @@ FileLog::FileLog(const char *pPath /*= nullptr*/,
         m_pImpl->m_paramName = pName;
     }
     m_pImpl->m_bOneLogPerProcess = bOneLogPerProcess;
+    m_pImpl->m_bMappedFile = bMappedFile;
 }
 
 FileLog::~FileLog()
@@ -367,10 +648,22 @@ FileLog::~FileLog()
     m_pImpl->Release();
 }
 
+void FileLog::SetBinaryLogRaw(bool bRaw)
+{
+    m_pImpl->m_bBinaryRaw = bRaw;
+}
+
+void FileLog::SetArchiveOptions(const TLogArchiveOptions &options)
+{
+    m_pImpl->m_archiveOptions = options;
+}
+
 void FileLog::DeleteLogFile(bool bDeleteAll)
 {
     if (m_pImpl->Init()) {
-        if (!m_pImpl->m_hThread && !m_pImpl->Start()) {
+        if (m_pImpl->m_bMappedFile) {
+            m_pImpl->m_mappedFile.DeleteLogFile(bDeleteAll);
+        } else if (!m_pImpl->m_bThreadStarted.load() && !m_pImpl->Start()) {
             return;
         } else {
             _LogCache oneLog;
@@ -385,21 +678,26 @@ void FileLog::DeleteLogFile(bool bDeleteAll)
     }
 }
 
+//非windows平台一般没有桌面环境，不打开
 void FileLog::ShowLogDir()
 {
+#ifdef _WIN32
     if (m_pImpl->Init()) {
-        std::string strLogPath = m_pImpl->m_logFileManager.GetLogFullPath();
+        std::string strLogPath = m_pImpl->GetLogFullPath();
         std::string::size_type uPos = strLogPath.find_last_of('\\');
         ::ShellExecuteA(NULL, "open", strLogPath.substr(0, uPos).c_str(), NULL, NULL, SW_SHOW);
     }
+#endif
 }
 
 void FileLog::ShowLogFile()
 {
+#ifdef _WIN32
     if (m_pImpl->Init()) {
         ::ShellExecuteA(
-            NULL, "open", m_pImpl->m_logFileManager.GetLogFullPath().c_str(), NULL, NULL, SW_SHOW);
+            NULL, "open", m_pImpl->GetLogFullPath().c_str(), NULL, NULL, SW_SHOW);
     }
+#endif
 }
 
 SHARELIB_END_NAMESPACE
@@ -0,0 +1,364 @@
+﻿#include "targetver.h"
+#ifndef _CRT_SECURE_NO_WARNINGS
+#    define _CRT_SECURE_NO_WARNINGS
+#endif
+#include "Log/LogArchiver.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "Memory/compress_utility.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+//压缩时每次读入的字节数
+const size_t READ_CHUNK_SIZE = 256 * 1024;
+
+//压缩后文件名增加的后缀
+const char GZIP_SUFFIX[] = ".gz";
+
+//压缩过程中使用的临时文件后缀，写完后才改名
+const char TEMP_SUFFIX[] = ".tmp";
+
+//一个回滚文件
+struct TRotatedFile
+{
+    fs::path m_path;
+    uintmax_t m_nSize;
+    std::time_t m_nTime;
+};
+
+} // namespace
+
+struct LogArchiver::TImpl
+{
+    TImpl(const TLogArchiveOptions &options, const TRotatedFileName &fileName)
+        : m_options(options)
+        , m_fileName(fileName)
+        , m_compressor(TCompressFormat::GZIP, (std::min)((std::max)(options.m_nLevel, 1), 9))
+    {}
+
+    //加锁后调用，启动失败时放弃已提交的任务，文件保持不压缩
+    void StartThread()
+    {
+        if (m_thread.joinable()) {
+            return;
+        }
+        try {
+            m_thread = std::thread(&TImpl::Run, this);
+        } catch (...) {
+            m_files.clear();
+            m_bScan = false;
+        }
+    }
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        for (;;) {
+            m_wakeup.wait(lock, [this]() { return m_bStop || m_bScan || !m_files.empty(); });
+            if (!m_bScan && m_files.empty()) {
+                break;
+            }
+            bool bScan = m_bScan;
+            m_bScan = false;
+            std::deque<std::string> files;
+            files.swap(m_files);
+            m_bBusy = true;
+            lock.unlock();
+
+            if (m_options.m_bCompress) {
+                if (bScan) {
+                    AddUncompressedFiles(files);
+                }
+                for (auto &strFile : files) {
+                    CompressFile(strFile);
+                }
+            }
+            //连续提交的文件处理完后只执行一次保留策略
+            ApplyRetention();
+
+            lock.lock();
+            m_bBusy = false;
+            m_idle.notify_all();
+        }
+    }
+
+    //文件名是否符合回滚文件的格式
+    bool MatchName(const std::string &strName, bool &bCompressed) const
+    {
+        const std::string &strPrefix = m_fileName.m_strPrefix;
+        const std::string &strMask = m_fileName.m_strTimeMask;
+        const std::string &strSuffix = m_fileName.m_strSuffix;
+        const size_t nGzipLength = sizeof(GZIP_SUFFIX) - 1;
+        size_t nEnd = strName.size();
+        bCompressed = (nEnd > nGzipLength &&
+                       strName.compare(nEnd - nGzipLength, nGzipLength, GZIP_SUFFIX) == 0);
+        if (bCompressed) {
+            nEnd -= nGzipLength;
+        }
+        size_t nPos = strPrefix.size() + strMask.size();
+        if (nEnd < nPos + strSuffix.size() ||
+            strName.compare(0, strPrefix.size(), strPrefix) != 0 ||
+            strName.compare(nEnd - strSuffix.size(), strSuffix.size(), strSuffix) != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < strMask.size(); ++i) {
+            char c = strName[strPrefix.size() + i];
+            if (strMask[i] == '#' ? (c < '0' || c > '9') : (c != strMask[i])) {
+                return false;
+            }
+        }
+
+        //时间与结尾之间只能是"_序号"
+        nEnd -= strSuffix.size();
+        if (nPos == nEnd) {
+            return true;
+        }
+        if (!m_fileName.m_bAllowCounter || strName[nPos] != '_' || nPos + 1 == nEnd) {
+            return false;
+        }
+        for (++nPos; nPos < nEnd; ++nPos) {
+            if (strName[nPos] < '0' || strName[nPos] > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //检查一个文件，符合格式时加入列表
+    void AddRotatedFile(const fs::path &path,
+                        bool bWantCompressed,
+                        bool bWantPlain,
+                        std::vector<TRotatedFile> &files) const
+    {
+        bool bCompressed = false;
+        if (!MatchName(path.filename().string(), bCompressed) ||
+            !(bCompressed ? bWantCompressed : bWantPlain)) {
+            return;
+        }
+        boost::system::error_code ec;
+        if (!fs::is_regular_file(path, ec)) {
+            return;
+        }
+        TRotatedFile file;
+        file.m_path = path;
+        file.m_nSize = fs::file_size(path, ec);
+        if (ec) {
+            return;
+        }
+        file.m_nTime = fs::last_write_time(path, ec);
+        if (ec) {
+            return;
+        }
+        files.push_back(file);
+    }
+
+    //列出所有的回滚文件
+    std::vector<TRotatedFile> ListRotatedFiles(bool bWantCompressed, bool bWantPlain) const
+    {
+        std::vector<TRotatedFile> files;
+        fs::path root = m_fileName.m_strDir.empty() ? fs::path(".") : fs::path(m_fileName.m_strDir);
+        boost::system::error_code ec;
+        if (m_fileName.m_bRecursive) {
+            for (fs::recursive_directory_iterator it(root, ec), itEnd; !ec && it != itEnd;
+                 it.increment(ec)) {
+                AddRotatedFile(it->path(), bWantCompressed, bWantPlain, files);
+            }
+        } else {
+            for (fs::directory_iterator it(root, ec), itEnd; !ec && it != itEnd;
+                 it.increment(ec)) {
+                AddRotatedFile(it->path(), bWantCompressed, bWantPlain, files);
+            }
+        }
+        return files;
+    }
+
+    //上次退出时没有压缩的回滚文件
+    void AddUncompressedFiles(std::deque<std::string> &files) const
+    {
+        for (auto &file : ListRotatedFiles(false, true)) {
+            std::string strFile = file.m_path.string();
+            if (std::find(files.begin(), files.end(), strFile) == files.end()) {
+                files.push_back(strFile);
+            }
+        }
+    }
+
+    /** 流式压缩为 strFile + ".gz"，成功后删除原文件，压缩后的文件保留原文件的修改时间。
+    先写入临时文件，进程退出时不会留下不完整的".gz"文件
+    */
+    bool CompressFile(const std::string &strFile)
+    {
+        std::string strTarget = strFile + GZIP_SUFFIX;
+        std::string strTemp = strTarget + TEMP_SUFFIX;
+        std::FILE *pInput = std::fopen(strFile.c_str(), "rb");
+        if (!pInput) {
+            return false;
+        }
+        std::FILE *pOutput = std::fopen(strTemp.c_str(), "wb");
+        if (!pOutput) {
+            std::fclose(pInput);
+            return false;
+        }
+
+        m_readBuffer.resize(READ_CHUNK_SIZE);
+        bool bOK = m_compressor.IsValid();
+        while (bOK) {
+            size_t nRead = std::fread(m_readBuffer.data(), 1, m_readBuffer.size(), pInput);
+            bool bEnd = (nRead < m_readBuffer.size());
+            if (bEnd && std::ferror(pInput)) {
+                bOK = false;
+                break;
+            }
+            m_outputBuffer.clear();
+            bOK = m_compressor.Push(m_readBuffer.data(), nRead, m_outputBuffer, bEnd) &&
+                  (m_outputBuffer.empty() ||
+                   std::fwrite(m_outputBuffer.data(), 1, m_outputBuffer.size(), pOutput) ==
+                       m_outputBuffer.size());
+            if (bEnd) {
+                break;
+            }
+        }
+        if (!bOK) {
+            m_compressor.Reset();
+        }
+        std::fclose(pInput);
+        bOK = (std::fclose(pOutput) == 0) && bOK;
+
+        boost::system::error_code ec;
+        if (bOK) {
+            fs::rename(strTemp, strTarget, ec);
+            bOK = !ec;
+        }
+        if (!bOK) {
+            fs::remove(strTemp, ec);
+            return false;
+        }
+        std::time_t nTime = fs::last_write_time(strFile, ec);
+        if (!ec) {
+            fs::last_write_time(strTarget, nTime, ec);
+        }
+        fs::remove(strFile, ec);
+        return true;
+    }
+
+    //从新到旧保留，第一个超出个数、时间或总大小的文件及比它旧的文件都删除，保留的文件没有间断
+    void ApplyRetention()
+    {
+        if (m_options.m_nMaxFiles == 0 && m_options.m_nMaxAgeSeconds == 0 &&
+            m_options.m_nMaxTotalBytes == 0) {
+            return;
+        }
+        std::vector<TRotatedFile> files = ListRotatedFiles(true, true);
+        std::sort(files.begin(), files.end(), [](const TRotatedFile &a, const TRotatedFile &b) {
+            if (a.m_nTime != b.m_nTime) {
+                return a.m_nTime > b.m_nTime;
+            }
+            //同一秒内的回滚文件按序号排序，"_10"比"_9"新
+            const std::string &strA = a.m_path.string();
+            const std::string &strB = b.m_path.string();
+            if (strA.size() != strB.size()) {
+                return strA.size() > strB.size();
+            }
+            return strA > strB;
+        });
+
+        std::time_t nNow = std::time(nullptr);
+        size_t nKeptFiles = 0;
+        uintmax_t nKeptBytes = 0;
+        bool bKeep = true;
+        fs::path root = m_fileName.m_strDir.empty() ? fs::path(".") : fs::path(m_fileName.m_strDir);
+        for (auto &file : files) {
+            bKeep = bKeep && (m_options.m_nMaxFiles == 0 || nKeptFiles < m_options.m_nMaxFiles) &&
+                    (m_options.m_nMaxTotalBytes == 0 ||
+                     nKeptBytes + file.m_nSize <= m_options.m_nMaxTotalBytes) &&
+                    (m_options.m_nMaxAgeSeconds == 0 || nNow <= file.m_nTime ||
+                     (uint64_t)(nNow - file.m_nTime) <= m_options.m_nMaxAgeSeconds);
+            if (bKeep) {
+                ++nKeptFiles;
+                nKeptBytes += file.m_nSize;
+                continue;
+            }
+            boost::system::error_code ec;
+            fs::remove(file.m_path, ec);
+            //子文件夹空了一并删除，非空时remove失败
+            fs::path parent = file.m_path.parent_path();
+            if (m_fileName.m_bRecursive && parent != root) {
+                fs::remove(parent, ec);
+            }
+        }
+    }
+
+    const TLogArchiveOptions m_options;
+    const TRotatedFileName m_fileName;
+
+    std::mutex m_lock;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_idle;
+    std::deque<std::string> m_files; //已提交还没有处理的文件
+    bool m_bScan = false;
+    bool m_bBusy = false;
+    bool m_bStop = false;
+    std::thread m_thread;
+
+    //以下只在后台线程使用
+    Compressor m_compressor;
+    std::vector<char> m_readBuffer;
+    std::vector<uint8_t> m_outputBuffer;
+};
+
+LogArchiver::LogArchiver(const TLogArchiveOptions &options, const TRotatedFileName &fileName)
+    : m_spImpl(new TImpl(options, fileName))
+{}
+
+LogArchiver::~LogArchiver()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_spImpl->m_lock);
+        m_spImpl->m_bStop = true;
+    }
+    m_spImpl->m_wakeup.notify_one();
+    if (m_spImpl->m_thread.joinable()) {
+        m_spImpl->m_thread.join();
+    }
+}
+
+void LogArchiver::Submit(const std::string &strFile)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_spImpl->m_lock);
+        m_spImpl->m_files.push_back(strFile);
+        m_spImpl->StartThread();
+    }
+    m_spImpl->m_wakeup.notify_one();
+}
+
+void LogArchiver::Scan()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_spImpl->m_lock);
+        m_spImpl->m_bScan = true;
+        m_spImpl->StartThread();
+    }
+    m_spImpl->m_wakeup.notify_one();
+}
+
+void LogArchiver::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_spImpl->m_lock);
+    m_spImpl->m_idle.wait(lock, [this]() {
+        return m_spImpl->m_files.empty() && !m_spImpl->m_bScan && !m_spImpl->m_bBusy;
+    });
+}
+
+SHARELIB_END_NAMESPACE
@@ -0,0 +1,180 @@
+﻿#include "LogBufferArena.h"
+#include <mutex>
+#include <new>
+#include <vector>
+
+SHARELIB_BEGIN_NAMESPACE
+
+//线程局部变量只保存指针，析构时把arena交给全局的空闲列表
+struct LogBufferArena::TThreadHolder
+{
+    ~TThreadHolder()
+    {
+        if (m_pArena) {
+            LogBufferArena::Orphan(m_pArena);
+            m_pArena = nullptr;
+        }
+    }
+
+    LogBufferArena *m_pArena = nullptr;
+};
+
+namespace {
+
+struct TOrphanList
+{
+    std::mutex m_lock;
+    std::vector<LogBufferArena *> m_arenas;
+};
+
+//不析构，进程退出时写文件线程可能还在归还缓冲区
+TOrphanList &GetOrphanList()
+{
+    static TOrphanList *s_pList = new TOrphanList;
+    return *s_pList;
+}
+
+} // namespace
+
+char *LogBufferArena::Allocate(size_t nSize, size_t &nRealSize)
+{
+    nRealSize = 0;
+    if (nSize == 0) {
+        return nullptr;
+    }
+    size_t nClass = 0;
+    while (nClass < CLASS_COUNT && ((size_t)1 << (nClass + MIN_CLASS_SHIFT)) < nSize) {
+        ++nClass;
+    }
+
+    TBlockHeader *pBlock = nullptr;
+    if (nClass == LARGE_CLASS) {
+        pBlock = NewBlock(LARGE_CLASS, nSize);
+    } else {
+        nSize = (size_t)1 << (nClass + MIN_CLASS_SHIFT);
+        LogBufferArena *pArena = Current();
+        TFreeList &freeList = pArena->m_freeLists[nClass];
+        if (!freeList.m_pHead &&
+            pArena->m_pRemoteFree.load(std::memory_order::memory_order_relaxed)) {
+            pArena->Reclaim();
+        }
+        if (freeList.m_pHead) {
+            pBlock = freeList.m_pHead;
+            freeList.m_pHead = pBlock->m_pNext;
+            --freeList.m_nCount;
+        } else {
+            pBlock = NewBlock(nClass, nSize);
+            if (pBlock) {
+                pBlock->m_pOwner = pArena;
+            }
+        }
+    }
+    if (!pBlock) {
+        return nullptr;
+    }
+    nRealSize = nSize;
+    return reinterpret_cast<char *>(pBlock + 1);
+}
+
+void LogBufferArena::Free(char *pBuffer)
+{
+    if (!pBuffer) {
+        return;
+    }
+    TBlockHeader *pBlock = reinterpret_cast<TBlockHeader *>(pBuffer) - 1;
+    if (pBlock->m_nClass == LARGE_CLASS) {
+        ::operator delete(pBlock);
+        return;
+    }
+
+    LogBufferArena *pOwner = pBlock->m_pOwner;
+    if (pOwner == Current()) {
+        pOwner->CacheBlock(pBlock);
+        return;
+    }
+    pBlock->m_pNext = pOwner->m_pRemoteFree.load(std::memory_order::memory_order_relaxed);
+    while (!pOwner->m_pRemoteFree.compare_exchange_weak(pBlock->m_pNext,
+                                                        pBlock,
+                                                        std::memory_order::memory_order_release,
+                                                        std::memory_order::memory_order_relaxed)) {
+    }
+}
+
+LogBufferArena *LogBufferArena::Current()
+{
+    static thread_local TThreadHolder s_holder;
+    if (!s_holder.m_pArena) {
+        TOrphanList &orphans = GetOrphanList();
+        {
+            std::lock_guard<std::mutex> lock(orphans.m_lock);
+            if (!orphans.m_arenas.empty()) {
+                s_holder.m_pArena = orphans.m_arenas.back();
+                orphans.m_arenas.pop_back();
+            }
+        }
+        if (!s_holder.m_pArena) {
+            s_holder.m_pArena = new LogBufferArena;
+        }
+    }
+    return s_holder.m_pArena;
+}
+
+void LogBufferArena::Orphan(LogBufferArena *pArena)
+{
+    //缓存的缓冲区先还给系统堆，回收链表留给下一个使用者
+    pArena->ReleaseCache();
+    TOrphanList &orphans = GetOrphanList();
+    std::lock_guard<std::mutex> lock(orphans.m_lock);
+    orphans.m_arenas.push_back(pArena);
+}
+
+void LogBufferArena::Reclaim()
+{
+    TBlockHeader *pBlock =
+        m_pRemoteFree.exchange(nullptr, std::memory_order::memory_order_acquire);
+    while (pBlock) {
+        TBlockHeader *pNext = pBlock->m_pNext;
+        CacheBlock(pBlock);
+        pBlock = pNext;
+    }
+}
+
+void LogBufferArena::CacheBlock(TBlockHeader *pBlock)
+{
+    TFreeList &freeList = m_freeLists[pBlock->m_nClass];
+    size_t nMaxCount = MAX_CACHED_BYTES >> (pBlock->m_nClass + MIN_CLASS_SHIFT);
+    if (freeList.m_nCount >= nMaxCount) {
+        ::operator delete(pBlock);
+        return;
+    }
+    pBlock->m_pNext = freeList.m_pHead;
+    freeList.m_pHead = pBlock;
+    ++freeList.m_nCount;
+}
+
+void LogBufferArena::ReleaseCache()
+{
+    for (auto &freeList : m_freeLists) {
+        while (freeList.m_pHead) {
+            TBlockHeader *pNext = freeList.m_pHead->m_pNext;
+            ::operator delete(freeList.m_pHead);
+            freeList.m_pHead = pNext;
+        }
+        freeList.m_nCount = 0;
+    }
+}
+
+LogBufferArena::TBlockHeader *LogBufferArena::NewBlock(size_t nClass, size_t nSize)
+{
+    void *p = ::operator new(sizeof(TBlockHeader) + nSize, std::nothrow);
+    if (!p) {
+        return nullptr;
+    }
+    TBlockHeader *pBlock = static_cast<TBlockHeader *>(p);
+    pBlock->m_pNext = nullptr;
+    pBlock->m_pOwner = nullptr;
+    pBlock->m_nClass = nClass;
+    return pBlock;
+}
+
+SHARELIB_END_NAMESPACE
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "MacroDefBase.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+/*!
+ * \class LogBufferArena
+ * \brief 日志缓冲区的线程局部分配器
+ 写日志的线程只从自己的arena分配，不加锁；写文件线程用完后归还到所属arena的回收链表，
+ 所属线程下次分配时一次取回，多出缓存上限的部分才还给系统堆。
+ 线程退出后arena留给新线程复用，从不释放，保证写文件线程归还时arena一定有效
+ */
+class LogBufferArena
+{
+    SHARELIB_DISABLE_COPY_CLASS(LogBufferArena);
+
+public:
+    /** 分配缓冲区，内容未初始化
+    @param[in] nSize 需要的大小
+    @param[out] nRealSize 实际可用的大小，不小于nSize
+    @return 失败返回nullptr
+    */
+    static char *Allocate(size_t nSize, size_t &nRealSize);
+
+    /** 归还缓冲区，可以在任意线程调用
+    */
+    static void Free(char *pBuffer);
+
+private:
+    enum CONSTANT_VALUE : size_t
+    {
+        //最小的缓冲区为256字节，按2的整数次幂分级
+        MIN_CLASS_SHIFT = 8,
+
+        //分级个数，最大64K，更大的直接从系统堆分配
+        CLASS_COUNT = 9,
+
+        //每一级最多缓存的字节数
+        MAX_CACHED_BYTES = 256 * 1024,
+
+        //直接从系统堆分配的缓冲区的分级
+        LARGE_CLASS = CLASS_COUNT,
+    };
+
+    //缓冲区头部，紧挨在返回给调用者的地址之前
+    struct TBlockHeader
+    {
+        TBlockHeader *m_pNext;
+        LogBufferArena *m_pOwner;
+        size_t m_nClass;
+    };
+
+    struct TFreeList
+    {
+        TBlockHeader *m_pHead = nullptr;
+        size_t m_nCount = 0;
+    };
+
+    struct TThreadHolder;
+
+    LogBufferArena() = default;
+
+    //当前线程的arena，没有则复用退出线程留下的，再没有则新建
+    static LogBufferArena *Current();
+
+    //线程退出时放入全局的空闲列表
+    static void Orphan(LogBufferArena *pArena);
+
+    //取回其它线程归还的缓冲区
+    void Reclaim();
+
+    //放入本线程的缓存，超出上限时还给系统堆
+    void CacheBlock(TBlockHeader *pBlock);
+
+    //释放所有缓存的缓冲区
+    void ReleaseCache();
+
+    static TBlockHeader *NewBlock(size_t nClass, size_t nSize);
+
+    TFreeList m_freeLists[CLASS_COUNT];
+
+    //其它线程归还的缓冲区，多个线程压入，所属线程整体取出，没有ABA问题
+    std::atomic<TBlockHeader *> m_pRemoteFree{nullptr};
+};
+
+SHARELIB_END_NAMESPACE
@@ -4,27 +4,42 @@
 #endif
 #include "LogFileManager.h"
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
-#include <atlbase.h>
-#include <atlconv.h>
-#include <strsafe.h>
-#include "Other/TraversalTree.h"
+#include <ctime>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/dll/runtime_symbol_info.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef _WIN32
+#    include <fcntl.h>
+#    include <io.h>
+#    include <share.h>
+#    include <sys/stat.h>
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/uio.h>
+#    include <unistd.h>
+#endif
 
 SHARELIB_BEGIN_NAMESPACE
 
+namespace fs = boost::filesystem;
+
 LogFileManager::LogFileManager()
 {
     m_bRunOK = false;
     m_bNeedFlush = false;
-    m_pFile = nullptr;
+    m_nFile = -1;
+    m_nFileSize = 0;
+    m_nFileGeneration = 0;
+    m_nLastRotatedCounter = 0;
 }
 
 LogFileManager::~LogFileManager()
 {
-    if (m_pFile) {
-        std::fclose(m_pFile);
-        m_pFile = nullptr;
-    }
+    CloseFile();
 }
 
 const char *LogFileManager::GetErrMsg()
@@ -32,194 +47,328 @@ const char *LogFileManager::GetErrMsg()
     return m_strErrorMsg.c_str();
 }
 
-static HMODULE GetThisModule()
+//当前本地时间
+static std::tm GetLocalTm()
 {
-    HMODULE hModule = nullptr;
-    ::GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCWSTR)&GetThisModule, &hModule);
-    return hModule;
+    return boost::posix_time::to_tm(boost::posix_time::second_clock::local_time());
+}
+
+//日期格式的文件夹名
+static std::string GetDateDirName(const std::tm &date)
+{
+    char szDate[32]{};
+    std::snprintf(szDate,
+                  sizeof(szDate),
+                  "%4d%02d%02d",
+                  date.tm_year + 1900,
+                  date.tm_mon + 1,
+                  date.tm_mday);
+    return szDate;
+}
+
+static unsigned long GetProcessIdNumber()
+{
+#ifdef _WIN32
+    return ::GetCurrentProcessId();
+#else
+    return (unsigned long)::getpid();
+#endif
 }
 
 bool LogFileManager::SetLogPathAndName(const char *pPath,
                                        const char *pName,
                                        bool bOneLogPerProcess /*= false*/)
 {
-    {
-        char szModleFullPath[MAX_PATH + 20]{};
-        ::GetModuleFileNameA(GetThisModule(), szModleFullPath, MAX_PATH);
-        //查找可执行文件名的开始位置
-        char *pModuleName = std::strrchr(szModleFullPath, '\\');
-        if (!pModuleName) {
-            return false;
-        }
-        ++pModuleName;
+    if (!InitLogPath(pPath, pName, bOneLogPerProcess) || !OpenFile(false)) {
+        return false;
+    }
+    m_bRunOK = true;
+    return true;
+}
+
+void LogFileManager::SetArchiveOptions(const TLogArchiveOptions &options)
+{
+    m_archiveOptions = options;
+}
 
-        //查找可执行文件后缀的开始位置
-        char *pDot = std::strrchr(szModleFullPath, '.');
-        if (!pDot) {
+bool LogFileManager::InitLogPath(const char *pPath, const char *pName, bool bOneLogPerProcess)
+{
+    {
+        boost::system::error_code ec;
+        fs::path modulePath = boost::dll::this_line_location(ec);
+        if (ec || !modulePath.has_filename()) {
             return false;
         }
 
-        if ((nullptr == pPath) || (0 == std::strlen(pPath)) || std::strlen(pPath) > MAX_PATH) {
-            m_strFilePath.assign(szModleFullPath, pModuleName);
+        fs::path logPath;
+        if ((nullptr == pPath) || (0 == std::strlen(pPath))) {
+            logPath = modulePath.parent_path();
         } else {
-            m_strFilePath = pPath;
-            if (m_strFilePath.back() != '\\') {
-                m_strFilePath += '\\';
-            }
+            logPath = pPath;
         }
         //记录文件名
-        m_strFilePath += "log\\";
+        m_strFilePath = (logPath / "log").string() + (char)fs::path::preferred_separator;
         if (pName == nullptr || std::strlen(pName) == 0) {
-            m_strFileName.assign(pModuleName, pDot);
+            m_strFileName = modulePath.stem().string();
         } else {
             m_strFileName = pName;
         }
         if (bOneLogPerProcess) {
-            m_strFileName += std::string("_") + std::to_string(::GetCurrentProcessId());
+            m_strFileName += std::string("_") + std::to_string(GetProcessIdNumber());
         }
     }
 
     {
         //创建日志文件夹
-        if (!::CreateDirectoryA(m_strFilePath.c_str(), nullptr)) {
-            DWORD dwErr = ::GetLastError();
-            if (ERROR_ALREADY_EXISTS != dwErr) {
-                return false;
-            }
-        }
-
-        char szDate[20]{};
-        SYSTEMTIME date{};
-        ::GetLocalTime(&date);
-        ::StringCbPrintfA(
-            szDate, sizeof(szDate), "%4u%02u%02u", date.wYear, date.wMonth, date.wDay);
-        if (!::CreateDirectoryA((m_strFilePath + szDate).c_str(), nullptr)) {
-            DWORD dwErr = ::GetLastError();
-            if (ERROR_ALREADY_EXISTS != dwErr) {
-                return false;
-            }
+        std::string strDate = GetDateDirName(GetLocalTm());
+        boost::system::error_code ec;
+        fs::create_directories(m_strFilePath + strDate, ec);
+        if (ec) {
+            m_strErrorMsg = ec.message();
+            return false;
         }
-        m_strFileFullName = m_strFilePath + szDate + "\\" + m_strFileName + ".log";
+        m_strFileFullName = m_strFilePath + strDate + (char)fs::path::preferred_separator +
+                            m_strFileName + ".log";
     }
 
-    if (m_pFile) {
-        std::clearerr(m_pFile);
-        std::fclose(m_pFile);
-        m_pFile = nullptr;
-    }
-    m_pFile = std::fopen(m_strFileFullName.c_str(), "abcS");
-    //fopen_s这种方式打开的文件不能共享读
-    if (!m_pFile) {
-        return false;
+    {
+        //回滚文件的后台处理
+        m_spArchiver.reset();
+        if (m_archiveOptions.IsEnabled()) {
+            //回滚文件在日期文件夹下，名字为 日志名_时分秒.log 或 日志名_时分秒_序号.log
+            TRotatedFileName fileName;
+            fileName.m_strDir = m_strFilePath;
+            fileName.m_bRecursive = true;
+            fileName.m_strPrefix = m_strFileName + "_";
+            fileName.m_strTimeMask = "######";
+            fileName.m_bAllowCounter = true;
+            fileName.m_strSuffix = ".log";
+            m_spArchiver.reset(new LogArchiver(m_archiveOptions, fileName));
+            //上次没有处理完的回滚文件
+            m_spArchiver->Scan();
+        }
     }
-    m_bRunOK = true;
     return true;
 }
 
 bool LogFileManager::Write(const char *pkszMsg, size_t uiCount)
+{
+    TLogSlice slice{pkszMsg, uiCount ? uiCount : std::strlen(pkszMsg)};
+    return Write(&slice, 1);
+}
+
+bool LogFileManager::Write(const TLogSlice *pSlices, size_t nCount)
 {
     if (!m_bRunOK) {
         return false;
     }
 
     //写入内容
-    if (!uiCount) {
-        std::fwrite(pkszMsg, std::strlen(pkszMsg), 1, m_pFile);
-    } else {
-        std::fwrite(pkszMsg, uiCount, 1, m_pFile);
+    if (!WriteAll(pSlices, nCount)) {
+        return false;
     }
     m_bNeedFlush = true;
-    if (std::ftell(m_pFile) < MAX_LOG_FILE_SIZE) {
+    if (m_nFileSize < MAX_LOG_FILE_SIZE) {
         return true;
     }
+    return RotateFile();
+}
+
+bool LogFileManager::OpenFile(bool bTruncate)
+{
+    CloseFile();
+#ifdef _WIN32
+    //允许其它进程共享读
+    int nFlags = _O_WRONLY | _O_CREAT | _O_BINARY | _O_SEQUENTIAL |
+                 (bTruncate ? _O_TRUNC : _O_APPEND);
+    if (::_sopen_s(&m_nFile,
+                   m_strFileFullName.c_str(),
+                   nFlags,
+                   _SH_DENYNO,
+                   _S_IREAD | _S_IWRITE) != 0) {
+        m_nFile = -1;
+    }
+#else
+    int nFlags = O_WRONLY | O_CREAT | O_CLOEXEC | (bTruncate ? O_TRUNC : O_APPEND);
+    m_nFile = ::open(m_strFileFullName.c_str(), nFlags, 0644);
+#endif
+    if (m_nFile < 0) {
+        SetSystemError(errno);
+        return false;
+    }
+#ifdef _WIN32
+    m_nFileSize = ::_lseeki64(m_nFile, 0, SEEK_END);
+#else
+    m_nFileSize = (int64_t)::lseek(m_nFile, 0, SEEK_END);
+#endif
+    if (m_nFileSize < 0) {
+        m_nFileSize = 0;
+    }
+    ++m_nFileGeneration;
+    return true;
+}
+
+void LogFileManager::CloseFile()
+{
+    if (m_nFile >= 0) {
+#ifdef _WIN32
+        ::_close(m_nFile);
+#else
+        ::close(m_nFile);
+#endif
+        m_nFile = -1;
+    }
+}
+
+bool LogFileManager::WriteAll(const TLogSlice *pSlices, size_t nCount)
+{
+#ifdef _WIN32
+    m_gatherBuffer.clear();
+    for (size_t i = 0; i < nCount; ++i) {
+        m_gatherBuffer.insert(
+            m_gatherBuffer.end(), pSlices[i].m_pData, pSlices[i].m_pData + pSlices[i].m_nSize);
+    }
+    const char *pData = m_gatherBuffer.data();
+    size_t nLeft = m_gatherBuffer.size();
+    while (nLeft > 0) {
+        //_write单次最多写入INT_MAX字节
+        unsigned int nOnce = (unsigned int)(std::min)(nLeft, (size_t)0x40000000);
+        int nWritten = ::_write(m_nFile, pData, nOnce);
+        if (nWritten < 0) {
+            SetSystemError(errno);
+            return false;
+        }
+        pData += nWritten;
+        nLeft -= (size_t)nWritten;
+        m_nFileSize += nWritten;
+    }
+#else
+    enum
+    {
+        //单次writev的最大段数，不超过IOV_MAX
+        GATHER_COUNT = 64
+    };
+    iovec vecs[GATHER_COUNT];
+    size_t nNext = 0;
+    while (nNext < nCount) {
+        int nVecs = 0;
+        for (; nNext < nCount && nVecs < GATHER_COUNT; ++nNext) {
+            if (pSlices[nNext].m_nSize != 0) {
+                vecs[nVecs].iov_base = const_cast<char *>(pSlices[nNext].m_pData);
+                vecs[nVecs].iov_len = pSlices[nNext].m_nSize;
+                ++nVecs;
+            }
+        }
 
+        iovec *pVec = vecs;
+        while (nVecs > 0) {
+            ssize_t nWritten = ::writev(m_nFile, pVec, nVecs);
+            if (nWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                SetSystemError(errno);
+                return false;
+            }
+            m_nFileSize += nWritten;
+            //部分写入时跳过已写完的段，继续写剩余部分
+            while (nVecs > 0 && (size_t)nWritten >= pVec->iov_len) {
+                nWritten -= (ssize_t)pVec->iov_len;
+                ++pVec;
+                --nVecs;
+            }
+            if (nVecs > 0) {
+                pVec->iov_base = static_cast<char *>(pVec->iov_base) + nWritten;
+                pVec->iov_len -= (size_t)nWritten;
+            }
+        }
+    }
+#endif
+    return true;
+}
+
+bool LogFileManager::RotateFile()
+{
     //关闭当前文件
     m_bRunOK = false;
-    std::clearerr(m_pFile);
-    std::fclose(m_pFile);
-    m_pFile = nullptr;
+    CloseFile();
+
+    //打开新文件准备输入
+    if (!MoveCurrentFile() || !OpenFile(false)) {
+        return false;
+    }
+    m_bRunOK = true;
+    return true;
+}
 
+bool LogFileManager::MoveCurrentFile()
+{
     //创建文件夹
-    char szDate[20]{};
-    SYSTEMTIME curTime{};
-    ::GetLocalTime(&curTime);
-    ::StringCbPrintfA(
-        szDate, sizeof(szDate), "%4u%02u%02u", curTime.wYear, curTime.wMonth, curTime.wDay);
-    if (!::CreateDirectoryA((m_strFilePath + szDate).c_str(), nullptr)) {
-        DWORD dwErr = GetLastError();
-        if (ERROR_ALREADY_EXISTS != dwErr) {
-            char *pMsg = nullptr;
-            ::FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |
-                                 FORMAT_MESSAGE_IGNORE_INSERTS,
-                             nullptr,
-                             dwErr,
-                             0,
-                             LPSTR(&pMsg),
-                             0,
-                             nullptr);
-            m_strErrorMsg = pMsg;
-            ::LocalFree(pMsg);
-            return false;
-        }
+    std::tm curTime = GetLocalTm();
+    std::string strDateDir = m_strFilePath + GetDateDirName(curTime) +
+                             (char)fs::path::preferred_separator;
+    boost::system::error_code ec;
+    fs::create_directories(strDateDir, ec);
+    if (ec) {
+        m_strErrorMsg = ec.message();
+        return false;
     }
 
     //移动当前文件并改名
-    char szTime[20]{};
-    ::StringCbPrintfA(
-        szTime, sizeof(szTime), "_%02u%02u%02u", curTime.wHour, curTime.wMinute, curTime.wSecond);
-    //并非跨盘移动，所以速度是有保障的
-    if (!::MoveFileA(m_strFileFullName.c_str(),
-                     (m_strFilePath + szDate + "\\" + m_strFileName + szTime + ".log").c_str())) {
-        DWORD dwErr = GetLastError();
-        if (ERROR_ALREADY_EXISTS != dwErr) {
-            char *pMsg = nullptr;
-            ::FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |
-                                 FORMAT_MESSAGE_IGNORE_INSERTS,
-                             nullptr,
-                             dwErr,
-                             0,
-                             LPSTR(&pMsg),
-                             0,
-                             nullptr);
-            m_strErrorMsg = pMsg;
-            ::LocalFree(pMsg);
-            return false;
+    char szTime[32]{};
+    std::snprintf(szTime,
+                  sizeof(szTime),
+                  "_%02d%02d%02d",
+                  curTime.tm_hour,
+                  curTime.tm_min,
+                  curTime.tm_sec);
+    //并非跨盘移动，所以速度是有保障的。rename会覆盖已有的文件，同一秒内多次回滚时加序号，
+    //已压缩的同名文件也不能覆盖。序号接着上次的继续，被清理掉的文件名也不再使用
+    std::string strRotatedBase = strDateDir + m_strFileName + szTime;
+    int nCounter = (strRotatedBase == m_strLastRotatedBase) ? m_nLastRotatedCounter + 1 : 0;
+    std::string strRotatedFile;
+    for (;; ++nCounter) {
+        strRotatedFile = strRotatedBase;
+        if (nCounter > 0) {
+            strRotatedFile += "_" + std::to_string(nCounter);
         }
+        strRotatedFile += ".log";
+        if (!fs::exists(strRotatedFile, ec) && !fs::exists(strRotatedFile + ".gz", ec)) {
+            break;
+        }
+    }
+    fs::rename(m_strFileFullName, strRotatedFile, ec);
+    if (ec) {
+        m_strErrorMsg = ec.message();
+        return false;
     }
+    m_strLastRotatedBase = strRotatedBase;
+    m_nLastRotatedCounter = nCounter;
 
     {
         std::lock_guard<decltype(m_lockFileFullPath)> lock(m_lockFileFullPath);
-        m_strFileFullName = m_strFilePath + szDate + "\\" + m_strFileName +
-                            ".log"; //移动成功，当前日志文件重定位
+        m_strFileFullName = strDateDir + m_strFileName + ".log"; //移动成功，当前日志文件重定位
     }
-
-    //打开新文件准备输入
-    m_pFile = std::fopen(m_strFileFullName.c_str(), "abcS");
-    //fopen_s这种方式打开的文件不能共享读
-    if (!m_pFile) {
-        DWORD dwErr = GetLastError();
-        char *pMsg = nullptr;
-        ::FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |
-                             FORMAT_MESSAGE_IGNORE_INSERTS,
-                         nullptr,
-                         dwErr,
-                         0,
-                         LPSTR(&pMsg),
-                         0,
-                         nullptr);
-        m_strErrorMsg = pMsg;
-        ::LocalFree(pMsg);
-        return false;
+    if (m_spArchiver) {
+        m_spArchiver->Submit(strRotatedFile);
     }
-    m_bRunOK = true;
     return true;
 }
 
+void LogFileManager::SetSystemError(int nError)
+{
+    m_strErrorMsg = std::strerror(nError);
+}
+
 void LogFileManager::Flush()
 {
     if (m_bNeedFlush) {
-        if (m_pFile) {
-            std::fflush(m_pFile);
+        if (m_nFile >= 0) {
+#ifdef _WIN32
+            ::_commit(m_nFile);
+#else
+            ::fdatasync(m_nFile);
+#endif
         }
         m_bNeedFlush = false;
     }
@@ -231,51 +380,63 @@ const std::string &LogFileManager::GetLogFullPath() const
     return m_strFileFullName;
 }
 
-void LogFileManager::DeleteLogFile(bool bDeleteAll)
+void LogFileManager::DeleteLogFile(bool bDeleteAll, LogFileManager *pSibling /*= nullptr*/)
 {
     std::lock_guard<decltype(m_lockFileFullPath)> lock(m_lockFileFullPath);
-    std::wstring currLogFile = ATL::CA2W(m_strFileFullName.c_str(), CP_ACP).operator LPWSTR();
-    std::wstring logToday = currLogFile.substr(0, currLogFile.find_last_of('\\'));
-    std::wstring logDir = logToday.substr(0, logToday.find_last_of('\\'));
+    if (!pSibling) {
+        DeleteOtherLogFiles(bDeleteAll);
+        if (bDeleteAll) {
+            //清空当前文件
+            m_bRunOK = OpenFile(true);
+        }
+        return;
+    }
 
+    //分别删除时会互相删掉对方的当前文件，只删除一遍
+    std::lock_guard<decltype(m_lockFileFullPath)> siblingLock(pSibling->m_lockFileFullPath);
+    if (pSibling->m_spArchiver) {
+        pSibling->m_spArchiver->WaitIdle();
+    }
+    DeleteOtherLogFiles(bDeleteAll, {pSibling->m_strFileFullName});
     if (bDeleteAll) {
-        bool processCurrFile = false;
-        ForEachItemInDirectory(
-            logDir.c_str(),
-            10,
-            //参数3,lambda表达式
-            [](const wchar_t *) -> bool { return true; },
-            //参数4,lambda表达式
-            [&currLogFile, &processCurrFile, this](const wchar_t *pFileName) {
-                if (!processCurrFile && wcscmp(pFileName, currLogFile.c_str()) == 0) {
-                    if (m_pFile) {
-                        std::clearerr(m_pFile);
-                        std::fclose(m_pFile);
-                        m_pFile = nullptr;
-                    }
-                    m_pFile = std::fopen(m_strFileFullName.c_str(), "wbcS");
-                    processCurrFile = true;
-                } else {
-                    ::DeleteFileW(pFileName);
-                }
-            },
-            ::RemoveDirectoryW);
-    } else {
-        bool bTodaySkiped = false;
-        ForEachItemInDirectory(
-            logDir.c_str(),
-            10,
-            //参数3,lambda表达式
-            [&logToday, &bTodaySkiped](const wchar_t *pDir) -> bool {
-                if (!bTodaySkiped && wcscmp(pDir, logToday.c_str()) == 0) {
-                    bTodaySkiped = true;
-                    return false;
-                } else {
-                    return true;
+        m_bRunOK = OpenFile(true);
+        pSibling->m_bRunOK = pSibling->OpenFile(true);
+    }
+}
+
+void LogFileManager::DeleteOtherLogFiles(bool bDeleteAll,
+                                         const std::vector<std::string> &keepFiles /*= {}*/)
+{
+    if (m_spArchiver) {
+        m_spArchiver->WaitIdle();
+    }
+    std::vector<fs::path> currLogFiles{fs::path(m_strFileFullName)};
+    currLogFiles.insert(currLogFiles.end(), keepFiles.begin(), keepFiles.end());
+    std::vector<fs::path> logTodays;
+    for (auto &file : currLogFiles) {
+        logTodays.push_back(file.parent_path());
+    }
+    fs::path logDir = logTodays.front().parent_path();
+
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(logDir, ec), itEnd; !ec && it != itEnd; it.increment(ec)) {
+        const fs::path &item = it->path();
+        if (std::find(logTodays.begin(), logTodays.end(), item) == logTodays.end()) {
+            fs::remove_all(item, ec);
+            ec.clear();
+        } else if (bDeleteAll) {
+            //今天的文件夹只保留当前文件
+            for (fs::directory_iterator itToday(item, ec); !ec && itToday != itEnd;
+                 itToday.increment(ec)) {
+                const fs::path &file = itToday->path();
+                if (std::find(currLogFiles.begin(), currLogFiles.end(), file) ==
+                    currLogFiles.end()) {
+                    fs::remove_all(file, ec);
+                    ec.clear();
                 }
-            },
-            ::DeleteFileW,
-            ::RemoveDirectoryW);
+            }
+            ec.clear();
+        }
     }
 }
 
@@ -1,19 +1,29 @@
 ﻿#pragma once
 
-#include <cstdio>
-#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
-#include <windows.h>
+#include <vector>
+#include "Log/LogArchiver.h"
 #include "MacroDefBase.h"
 
 SHARELIB_BEGIN_NAMESPACE
 
 const long MAX_LOG_FILE_SIZE = 50 * 1024 * 1024; //单个日志文件的最大长度
 
+//一段待写入的数据
+struct TLogSlice
+{
+    const char *m_pData;
+    size_t m_nSize;
+};
+
 /*!
  * \class LogFileManager
  * \brief 此类不是线程安全的
+ 直接写文件描述符，不经过C库的缓冲区，写入后数据即在系统缓存中，进程崩溃也不会丢失
  */
 class LogFileManager
 {
@@ -31,25 +41,54 @@ public:
     */
     bool SetLogPathAndName(const char *pPath, const char *pName, bool bOneLogPerProcess = false);
 
+    /** 设置回滚文件的压缩及保留策略，需要在 SetLogPathAndName 之前调用。
+    回滚后的文件交给后台线程处理，只处理当前日志名的回滚文件(日志名_时分秒.log)
+    */
+    void SetArchiveOptions(const TLogArchiveOptions &options);
+
     /** 写入日志
     @param [in] uiCount 为0表示写入到'\0'结束，否则写入指定个数的字节
     */
     bool Write(const char *pkszMsg, size_t uiCount = 0);
 
+    /** 一次写入多段日志，非windows平台用writev，windows平台先拼接再写入
+    @param [in] pSlices 日志数组
+    @param [in] nCount 日志个数
+    */
+    bool Write(const TLogSlice *pSlices, size_t nCount);
+
     const char *GetErrMsg();
 
+    //把系统缓存中的数据写入磁盘
     void Flush();
 
     const std::string &GetLogFullPath() const;
 
+    /** 当前文件的序号，每打开一个文件(包括回滚后的新文件及清空后的文件)加1，
+    调用者据此判断是否需要在新文件开头重新写入文件头
+    */
+    uint64_t GetFileGeneration() const { return m_nFileGeneration; }
+
     /** 删除日志
     @param [in] bDeleteAll true表示删除所有的日志，false表示今天的不删除，其他的删除
+    @param [in] pSibling 写在同一文件夹下的另一个日志，可以为空。只删除一遍，两个当前文件
+                都保留，bDeleteAll时两个当前文件都清空
     */
-    void DeleteLogFile(bool bDeleteAll);
+    void DeleteLogFile(bool bDeleteAll, LogFileManager *pSibling = nullptr);
+
+protected:
+    //计算日志文件的路径，并创建日志文件夹
+    bool InitLogPath(const char *pPath, const char *pName, bool bOneLogPerProcess);
+
+    //当前文件改名为带时间的文件名，之后的日志写入新文件，改名后的文件交给后台压缩
+    bool MoveCurrentFile();
+
+    /** 删除当前文件之外的日志，调用者需要锁定m_lockFileFullPath。先等待后台处理完回滚文件
+    @param [in] bDeleteAll true表示删除所有的日志，false表示今天的不删除，其他的删除
+    @param [in] keepFiles 当前文件之外还要保留的文件，其所在的文件夹按今天的文件夹处理
+    */
+    void DeleteOtherLogFiles(bool bDeleteAll, const std::vector<std::string> &keepFiles = {});
 
-private:
-    bool m_bRunOK;
-    std::FILE *m_pFile;
     std::string m_strFilePath; //日志文件存放文件夹
     std::string m_strFileName; //当前写入日志的具体文件名
 
@@ -57,7 +96,38 @@ private:
     std::string m_strFileFullName; //当前写入日志的文件的全路径名
 
     std::string m_strErrorMsg;
+
+    TLogArchiveOptions m_archiveOptions;
+    std::unique_ptr<LogArchiver> m_spArchiver; //不需要处理回滚文件时为空
+
+    //上次回滚的文件名(不含序号)及序号，同一秒内的序号只增不减，不会重用已被清理的文件名
+    std::string m_strLastRotatedBase;
+    int m_nLastRotatedCounter;
+
+private:
+    //打开当前日志文件，bTruncate表示清空原有内容
+    bool OpenFile(bool bTruncate);
+
+    void CloseFile();
+
+    //写入全部数据，处理部分写入及中断
+    bool WriteAll(const TLogSlice *pSlices, size_t nCount);
+
+    //文件超出大小后改名，并打开新文件
+    bool RotateFile();
+
+    void SetSystemError(int nError);
+
+    bool m_bRunOK;
+    int m_nFile; //文件描述符，-1表示未打开
+    int64_t m_nFileSize;
     bool m_bNeedFlush;
+    uint64_t m_nFileGeneration;
+
+#ifdef _WIN32
+    //windows没有writev，拼接后一次写入
+    std::vector<char> m_gatherBuffer;
+#endif
 };
 
 SHARELIB_END_NAMESPACE
@@ -0,0 +1,200 @@
+﻿#include "MappedLogFile.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+SHARELIB_BEGIN_NAMESPACE
+
+namespace fs = boost::filesystem;
+
+struct MappedLogFile::TWindow
+{
+    //映射的文件及区域
+    std::string m_strFile;
+    boost::interprocess::mapped_region m_region;
+    char *m_pData = nullptr;
+    size_t m_nSize = 0;
+
+    //映射的序号
+    uint64_t m_nSerial = 0;
+
+    //已占用的偏移，超出m_nSize的部分不会写入
+    std::atomic<size_t> m_nReserved{0};
+
+    //第一个超出范围的偏移，即文件的实际长度
+    std::atomic<size_t> m_nOverflowOffset{SIZE_MAX};
+};
+
+MappedLogFile::MappedLogFile() {}
+
+MappedLogFile::~MappedLogFile()
+{
+    std::lock_guard<std::mutex> lock(m_rotateLock);
+    CloseWindow();
+}
+
+bool MappedLogFile::SetLogPathAndName(const char *pPath,
+                                      const char *pName,
+                                      bool bOneLogPerProcess /*= false*/)
+{
+    std::lock_guard<std::mutex> lock(m_rotateLock);
+    if (m_pWindow.load() || !InitLogPath(pPath, pName, bOneLogPerProcess)) {
+        return false;
+    }
+    TWindow *pWindow = OpenWindow(false);
+    m_pWindow.store(pWindow);
+    return pWindow != nullptr;
+}
+
+bool MappedLogFile::Write(const char *pkszMsg, size_t uiCount)
+{
+    size_t nBytes = uiCount ? uiCount : std::strlen(pkszMsg);
+    if (nBytes == 0) {
+        return true;
+    }
+    if (nBytes > (size_t)MAX_LOG_FILE_SIZE) {
+        return false;
+    }
+
+    for (;;) {
+        //先登记再取映射，摘下映射的线程会等待登记的线程都离开后才释放
+        ++m_nWriters;
+        TWindow *pWindow = m_pWindow.load();
+        if (!pWindow) {
+            --m_nWriters;
+            //正在换文件或者上次映射失败，等待换完，映射失败时重试
+            std::lock_guard<std::mutex> lock(m_rotateLock);
+            if (!m_pWindow.load()) {
+                if (m_strFileFullName.empty()) {
+                    return false;
+                }
+                TWindow *pNewWindow = OpenWindow(false);
+                if (!pNewWindow) {
+                    return false;
+                }
+                m_pWindow.store(pNewWindow);
+            }
+            continue;
+        }
+
+        size_t nOffset = pWindow->m_nReserved.fetch_add(nBytes);
+        if (nOffset + nBytes <= pWindow->m_nSize) {
+            std::memcpy(pWindow->m_pData + nOffset, pkszMsg, nBytes);
+            --m_nWriters;
+            return true;
+        }
+        if (nOffset <= pWindow->m_nSize) {
+            //只有一个线程满足该条件
+            pWindow->m_nOverflowOffset.store(nOffset);
+        }
+        uint64_t nSerial = pWindow->m_nSerial;
+        --m_nWriters;
+        if (!Rotate(nSerial)) {
+            return false;
+        }
+    }
+}
+
+void MappedLogFile::DeleteLogFile(bool bDeleteAll)
+{
+    std::lock_guard<std::mutex> lock(m_rotateLock);
+    {
+        std::lock_guard<decltype(m_lockFileFullPath)> pathLock(m_lockFileFullPath);
+        DeleteOtherLogFiles(bDeleteAll);
+    }
+    if (!bDeleteAll || m_strFileFullName.empty()) {
+        return;
+    }
+
+    //清空当前文件
+    CloseWindow();
+    boost::system::error_code ec;
+    fs::resize_file(m_strFileFullName, 0, ec);
+    m_pWindow.store(OpenWindow(false));
+}
+
+MappedLogFile::TWindow *MappedLogFile::OpenWindow(bool bExtend)
+{
+    std::unique_ptr<TWindow> spWindow = std::make_unique<TWindow>();
+    spWindow->m_strFile = m_strFileFullName;
+    spWindow->m_nSerial = m_nNextSerial++;
+    try {
+        //预分配文件，崩溃后留下的文件大小等于映射大小，末尾为'\0'
+        std::ofstream{spWindow->m_strFile, std::ios::binary | std::ios::app};
+        size_t nFileSize = (size_t)fs::file_size(spWindow->m_strFile);
+        size_t nMapSize = bExtend ? nFileSize + (size_t)MAX_LOG_FILE_SIZE
+                                  : (std::max)(nFileSize, (size_t)MAX_LOG_FILE_SIZE);
+        if (nFileSize < nMapSize) {
+            fs::resize_file(spWindow->m_strFile, nMapSize);
+        }
+
+        boost::interprocess::file_mapping file{spWindow->m_strFile.c_str(),
+                                               boost::interprocess::mode_t::read_write};
+        boost::interprocess::mapped_region region{
+            file, boost::interprocess::mode_t::read_write, 0, nMapSize};
+        spWindow->m_region.swap(region);
+        spWindow->m_pData = static_cast<char *>(spWindow->m_region.get_address());
+        spWindow->m_nSize = nMapSize;
+
+        size_t nDataSize = nFileSize;
+        if (nFileSize == nMapSize) {
+            while (nDataSize > 0 && spWindow->m_pData[nDataSize - 1] == '\0') {
+                --nDataSize;
+            }
+        }
+        spWindow->m_nReserved.store(nDataSize);
+    } catch (const std::exception &e) {
+        m_strErrorMsg = e.what();
+        return nullptr;
+    }
+    return spWindow.release();
+}
+
+void MappedLogFile::CloseWindow()
+{
+    std::unique_ptr<TWindow> spWindow{m_pWindow.exchange(nullptr)};
+    if (!spWindow) {
+        return;
+    }
+
+    //m_pWindow已为空，之后登记的线程取不到该映射，等待之前登记的线程离开
+    size_t nSpinCount = 0;
+    while (m_nWriters.load() != 0) {
+        if (++nSpinCount > 16) {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t nDataSize = (std::min)(spWindow->m_nReserved.load(), spWindow->m_nSize);
+    nDataSize = (std::min)(nDataSize, spWindow->m_nOverflowOffset.load());
+    boost::interprocess::mapped_region{}.swap(spWindow->m_region);
+    spWindow->m_pData = nullptr;
+    boost::system::error_code ec;
+    fs::resize_file(spWindow->m_strFile, nDataSize, ec);
+}
+
+bool MappedLogFile::Rotate(uint64_t nFullSerial)
+{
+    std::lock_guard<std::mutex> lock(m_rotateLock);
+    TWindow *pCurrent = m_pWindow.load();
+    if (!pCurrent || pCurrent->m_nSerial != nFullSerial) {
+        //其它线程已经换过；映射失败时由之后的写入重试
+        return pCurrent != nullptr;
+    }
+
+    //先摘下映射，windows下映射中的文件不能改名
+    CloseWindow();
+
+    //改名失败时在原文件后面继续写，下次写满时再尝试改名
+    bool bMoved = MoveCurrentFile();
+    TWindow *pWindow = OpenWindow(!bMoved);
+    m_pWindow.store(pWindow);
+    return pWindow != nullptr;
+}
+
+SHARELIB_END_NAMESPACE
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "LogFileManager.h"
+
+SHARELIB_BEGIN_NAMESPACE
+
+/*!
+ * \class MappedLogFile
+ * \brief 内存映射方式的日志文件，Write是线程安全的
+ 日志文件预先扩展到MAX_LOG_FILE_SIZE并整体映射，写日志的线程用原子操作占用一段偏移后直接
+ 复制到映射内存中，没有系统调用；数据写入后即在系统缓存中，进程崩溃也不会丢失。
+ 文件写满后改名，再映射新文件；正常关闭时把文件截断到实际长度，崩溃后留下的文件末尾是'\0'。
+ 改名失败时在原文件后面继续写，下次写满时再改名；映射失败时在之后的写入中重试
+ */
+class MappedLogFile : protected LogFileManager
+{
+    SHARELIB_DISABLE_COPY_CLASS(MappedLogFile);
+
+public:
+    MappedLogFile();
+
+    ~MappedLogFile();
+
+    /** 初始化日志路径及名称，并映射日志文件
+    @param [in] pPath 日志路径，如果为nullptr或长度为0则取当前可执行文件所在文件夹
+    @param [in] pName 日志名字，如果为nullptr或长度为0则取当前可执行文件的名字
+    @param [in] bOneLogPerProcess 是否每个进程一个日志文件
+    */
+    bool SetLogPathAndName(const char *pPath, const char *pName, bool bOneLogPerProcess = false);
+
+    /** 写入日志，多线程安全
+    @param [in] uiCount 为0表示写入到'\0'结束，否则写入指定个数的字节
+    */
+    bool Write(const char *pkszMsg, size_t uiCount = 0);
+
+    /** 删除日志，多线程安全
+    @param [in] bDeleteAll true表示删除所有的日志，false表示今天的不删除，其他的删除
+    */
+    void DeleteLogFile(bool bDeleteAll);
+
+    using LogFileManager::GetErrMsg;
+    using LogFileManager::GetLogFullPath;
+    using LogFileManager::SetArchiveOptions;
+
+private:
+    struct TWindow;
+
+    /** 预分配并映射当前日志文件，调用者需要锁定m_rotateLock
+    @param [in] bExtend false表示映射MAX_LOG_FILE_SIZE，true表示在已有内容后面再映射
+                MAX_LOG_FILE_SIZE，用于改名失败后继续写原文件
+    */
+    TWindow *OpenWindow(bool bExtend);
+
+    //摘下当前映射，等待正在写入的线程完成后解除映射，把文件截断到实际长度并释放映射
+    void CloseWindow();
+
+    //序号为nFullSerial的映射已写满，换到新文件
+    bool Rotate(uint64_t nFullSerial);
+
+    //当前映射，换文件期间或映射失败时为空
+    std::atomic<TWindow *> m_pWindow{nullptr};
+
+    //正在使用m_pWindow的线程数，为0且m_pWindow为空时才能释放摘下的映射
+    std::atomic<size_t> m_nWriters{0};
+
+    //换文件及删除日志时加锁
+    std::mutex m_rotateLock;
+
+    //下一个映射的序号，用于判断写满的映射是否已经被换掉
+    uint64_t m_nNextSerial = 0;
+};
+
+SHARELIB_END_NAMESPACE
@@ -1,34 +1,71 @@
 ﻿#include "Memory/FileMappingHelper.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 
+#ifdef __linux__
+#    include <fcntl.h>
+#endif
+
 SHARELIB_BEGIN_NAMESPACE
 
-FileMappingHelper::FileMappingHelper(const wchar_t *pFile)
-    : m_fileSize(0)
+//映射偏移的对齐粒度, windows下必须是分配粒度(64K)的整数倍, 统一按64K对齐
+static size_t GetMapGranularity()
+{
+    static const size_t s_granularity = (std::max)(
+        (size_t)boost::interprocess::mapped_region::get_page_size(), (size_t)64 * 1024);
+    return s_granularity;
+}
+
+FileMappingHelper::FileMappingHelper(const wchar_t *pFile,
+                                     size_t nWindowSize /*= DEFAULT_WINDOW_SIZE*/,
+                                     bool bGrowable /*= false*/)
+    : m_viewBegin(0)
+    , m_viewEnd(0)
+    , m_nWindowSize(0)
+    , m_bGrowable(false)
+    , m_fileCapacity(0)
+    , m_fileSize(0)
     , m_writedSize(0)
     , m_readSize(0)
 {
     boost::filesystem::path filePath{pFile};
-    Init(filePath);
+    Init(filePath, nWindowSize, bGrowable);
 }
 
-FileMappingHelper::FileMappingHelper(const char *pFile)
-    : m_fileSize(0)
+FileMappingHelper::FileMappingHelper(const char *pFile,
+                                     size_t nWindowSize /*= DEFAULT_WINDOW_SIZE*/,
+                                     bool bGrowable /*= false*/)
+    : m_viewBegin(0)
+    , m_viewEnd(0)
+    , m_nWindowSize(0)
+    , m_bGrowable(false)
+    , m_fileCapacity(0)
+    , m_fileSize(0)
     , m_writedSize(0)
     , m_readSize(0)
 {
     boost::filesystem::path filePath{pFile};
-    Init(filePath);
+    Init(filePath, nWindowSize, bGrowable);
 }
 
 FileMappingHelper::~FileMappingHelper()
 {
     m_spMappedRegion.reset();
+    m_readWindow.m_spRegion.reset();
+    m_writeWindow.m_spRegion.reset();
+    m_spViewRegion.reset();
     m_spFileMapping.reset();
+    if (m_fileCapacity > m_fileSize) {
+        //去掉扩展时多分配的部分; 外部持有View时windows下截断会失败, 只留下多余的'\0'
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(*m_spFilePath, m_fileSize, ec);
+    }
 }
 
 uint64_t FileMappingHelper::GetFileSize()
@@ -61,22 +98,20 @@ bool FileMappingHelper::WriteBytes(const void *pBits, size_t nBytes)
     if (!pBits || !nBytes) {
         return true;
     }
-    if (m_writedSize + nBytes > m_fileSize) {
+    uint64_t endPos = m_writedSize + nBytes;
+    if (endPos > m_fileSize && !GrowFile(endPos)) {
         return false;
     }
-    try {
-        m_spMappedRegion.reset();
-        boost::interprocess::mapped_region region{*m_spFileMapping,
-                                                  boost::interprocess::mode_t::read_write,
-                                                  (boost::interprocess::offset_t)m_writedSize,
-                                                  nBytes};
-        std::memcpy(region.get_address(), pBits, nBytes);
-        m_writedSize += nBytes;
-        return true;
-    } catch (const std::exception &) {
-        assert(!"WriteBytes Failed");
+
+    //整段数据在一个映射中, 映射失败时一个字节也不写入
+    char *pDest = MapWindow(m_writeWindow, m_writedSize, nBytes, true);
+    if (!pDest) {
         return false;
     }
+    std::memcpy(pDest, pBits, nBytes);
+    m_writedSize = endPos;
+    m_fileSize = (std::max)(m_fileSize, endPos);
+    return true;
 }
 
 size_t FileMappingHelper::ReadBytes(void *pBuffer, size_t bufferSize)
@@ -84,23 +119,54 @@ size_t FileMappingHelper::ReadBytes(void *pBuffer, size_t bufferSize)
     if (!pBuffer || (bufferSize == 0)) {
         return 0;
     }
-    size_t copySize = (size_t)(std::min)(m_fileSize - m_readSize, (uint64_t)bufferSize);
-    if (copySize == 0) {
-        return 0;
-    }
-    try {
-        m_spMappedRegion.reset();
-        boost::interprocess::mapped_region region{*m_spFileMapping,
-                                                  boost::interprocess::mode_t::read_write,
-                                                  (boost::interprocess::offset_t)m_readSize,
-                                                  copySize};
-        std::memcpy(pBuffer, region.get_address(), copySize);
+    uint64_t endPos = m_readSize + (std::min)(m_fileSize - m_readSize, (uint64_t)bufferSize);
+    char *pDest = static_cast<char *>(pBuffer);
+    size_t readSize = 0;
+    while (m_readSize < endPos) {
+        size_t copySize = (size_t)(std::min)(endPos - m_readSize, (uint64_t)m_nWindowSize);
+        const char *pSrc = MapWindow(m_readWindow, m_readSize, copySize, false);
+        if (!pSrc) {
+            break;
+        }
+        std::memcpy(pDest + readSize, pSrc, copySize);
+        readSize += copySize;
         m_readSize += copySize;
-        return copySize;
-    } catch (const std::exception &) {
-        assert(!"ReadBytes Failed");
-        return 0;
     }
+    return readSize;
+}
+
+FileMappingView FileMappingHelper::View(uint64_t offset, size_t nBytes)
+{
+    FileMappingView view;
+    if (nBytes == 0 || offset > m_fileSize || m_fileSize - offset < nBytes) {
+        return view;
+    }
+    if (!m_spViewRegion || offset < m_viewBegin || offset + nBytes > m_viewEnd) {
+        //和读窗口一样从对齐位置开始映射, 旧的映射由持有它的View释放
+        uint64_t begin = offset / GetMapGranularity() * GetMapGranularity();
+        uint64_t end =
+            (std::min)(begin + (std::max)((uint64_t)m_nWindowSize, offset + nBytes - begin),
+                       m_fileCapacity);
+        try {
+            m_spViewRegion = std::make_shared<boost::interprocess::mapped_region>(
+                *m_spFileMapping,
+                boost::interprocess::mode_t::read_only,
+                (boost::interprocess::offset_t)begin,
+                (size_t)(end - begin));
+        } catch (const std::exception &) {
+            assert(!"View Failed");
+            m_spViewRegion.reset();
+            return view;
+        }
+        m_viewBegin = begin;
+        m_viewEnd = end;
+        m_spViewRegion->advise(boost::interprocess::mapped_region::advice_sequential);
+    }
+    view.m_spRegion = m_spViewRegion;
+    view.m_pData = static_cast<const char *>(m_spViewRegion->get_address());
+    view.m_pData += offset - m_viewBegin;
+    view.m_nSize = nBytes;
+    return view;
 }
 
 void *FileMappingHelper::LockBits(uint64_t offset, size_t nLockBytes)
@@ -126,11 +192,87 @@ void FileMappingHelper::UnLockBits()
     m_spMappedRegion.reset();
 }
 
-void FileMappingHelper::Init(const boost::filesystem::path &filePath)
+void FileMappingHelper::Init(const boost::filesystem::path &filePath,
+                             size_t nWindowSize,
+                             bool bGrowable)
 {
+    if (bGrowable && !boost::filesystem::exists(filePath)) {
+        boost::filesystem::ofstream{filePath, std::ios::binary | std::ios::app};
+    }
     m_spFileMapping = std::make_unique<boost::interprocess::file_mapping>(
         filePath.string().c_str(), boost::interprocess::mode_t::read_write);
+    m_spFilePath = std::make_unique<boost::filesystem::path>(filePath);
     m_fileSize = boost::filesystem::file_size(filePath);
+    m_fileCapacity = m_fileSize;
+    m_bGrowable = bGrowable;
+
+    const size_t granularity = GetMapGranularity();
+    m_nWindowSize = (std::max)(nWindowSize, granularity) / granularity * granularity;
+}
+
+bool FileMappingHelper::GrowFile(uint64_t endPos)
+{
+    if (endPos <= m_fileCapacity) {
+        return true;
+    }
+    if (!m_bGrowable) {
+        return false;
+    }
+
+    //按窗口大小成块扩展, 避免每次写入都改变文件大小
+    uint64_t newCapacity = (endPos + m_nWindowSize - 1) / m_nWindowSize * m_nWindowSize;
+#ifdef __linux__
+    //预先分配磁盘空间, 避免写映射内存时磁盘已满导致SIGBUS
+    int fd = (int)m_spFileMapping->get_mapping_handle().handle;
+    if (::posix_fallocate(fd, (off_t)m_fileCapacity, (off_t)(newCapacity - m_fileCapacity)) != 0) {
+        return false;
+    }
+#else
+    boost::system::error_code ec;
+    boost::filesystem::resize_file(*m_spFilePath, newCapacity, ec);
+    if (ec) {
+        return false;
+    }
+#endif
+    m_fileCapacity = newCapacity;
+    return true;
+}
+
+char *FileMappingHelper::MapWindow(TWindow &window, uint64_t pos, size_t nBytes, bool bWrite)
+{
+    if (window.m_spRegion && pos >= window.m_nBegin && pos + nBytes <= window.m_nEnd) {
+        return static_cast<char *>(window.m_spRegion->get_address()) + (pos - window.m_nBegin);
+    }
+
+    if (window.m_spRegion && bWrite) {
+        //写窗口换出前异步回写, 不等待磁盘
+        window.m_spRegion->flush(0, 0, true);
+    }
+    window.m_spRegion.reset();
+    //窗口从pos所在的对齐位置开始, 数据超过窗口大小时扩大窗口
+    uint64_t begin = pos / GetMapGranularity() * GetMapGranularity();
+    uint64_t end = (std::min)(begin + (std::max)((uint64_t)m_nWindowSize, pos + nBytes - begin),
+                              m_fileCapacity);
+    try {
+        window.m_spRegion = std::make_unique<boost::interprocess::mapped_region>(
+            *m_spFileMapping,
+            bWrite ? boost::interprocess::mode_t::read_write
+                   : boost::interprocess::mode_t::read_only,
+            (boost::interprocess::offset_t)begin,
+            (size_t)(end - begin));
+    } catch (const std::exception &) {
+        assert(!"MapWindow Failed");
+        return nullptr;
+    }
+    window.m_nBegin = begin;
+    window.m_nEnd = end;
+
+    //顺序读写, 读窗口同时提示预读; 不支持时(windows)忽略
+    window.m_spRegion->advise(boost::interprocess::mapped_region::advice_sequential);
+    if (!bWrite) {
+        window.m_spRegion->advise(boost::interprocess::mapped_region::advice_willneed);
+    }
+    return static_cast<char *>(window.m_spRegion->get_address()) + (pos - begin);
 }
 
 void FileMappingHelper::SeekImpl(uint64_t &prevSize, int64_t offset, TSeekType type)
@@ -0,0 +1,165 @@
+﻿#include "Memory/MonotonicArena.h"
+#include <cstdlib>
+#include <cstring>
+
+SHARELIB_BEGIN_NAMESPACE
+
+namespace {
+
+//块的最小大小
+const size_t MIN_BLOCK_SIZE = 1024;
+
+} // namespace
+
+//块的头部，数据紧跟在后面，16字节保证数据的起始位置与系统堆的对齐相同
+struct MonotonicArena::TBlock
+{
+    TBlock *m_pNext;
+
+    //数据的字节数
+    size_t m_nSize;
+
+    char *Data()
+    {
+        return (char *)(this + 1);
+    }
+};
+
+MonotonicArena::MonotonicArena(size_t nBlockSize)
+    : m_nBlockSize(nBlockSize < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : nBlockSize)
+{}
+
+MonotonicArena::~MonotonicArena()
+{
+    Release();
+}
+
+void *MonotonicArena::Reallocate(void *p, size_t nOldBytes, size_t nNewBytes) throw()
+{
+    if (!p) {
+        return Allocate(nNewBytes);
+    }
+    if (nNewBytes <= nOldBytes) {
+        return p;
+    }
+
+    //最后一次分配的内存，剩余空间足够时原地扩展
+    char *pOldEnd = (char *)p + nOldBytes;
+    if (pOldEnd == m_pPos && nNewBytes - nOldBytes <= (size_t)(m_pEnd - m_pPos)) {
+        m_pPos = (char *)p + nNewBytes;
+        return p;
+    }
+
+    void *pNew = Allocate(nNewBytes);
+    if (pNew) {
+        std::memcpy(pNew, p, nOldBytes);
+    }
+    return pNew;
+}
+
+void MonotonicArena::Reset() throw()
+{
+    FreeLargeBlocks(nullptr);
+    SetCurrentBlock(m_pFirst);
+}
+
+void MonotonicArena::Release() throw()
+{
+    FreeLargeBlocks(nullptr);
+    while (m_pFirst) {
+        TBlock *pNext = m_pFirst->m_pNext;
+        std::free(m_pFirst);
+        m_pFirst = pNext;
+    }
+    SetCurrentBlock(nullptr);
+    m_nReservedBytes = 0;
+}
+
+MonotonicArena::TMarker MonotonicArena::GetMarker() const
+{
+    TMarker marker;
+    marker.m_pBlock = m_pCurrent;
+    marker.m_pPos = m_pPos;
+    marker.m_pLargeBlock = m_pLarge;
+    return marker;
+}
+
+void MonotonicArena::Rewind(const TMarker &marker) throw()
+{
+    FreeLargeBlocks((TBlock *)marker.m_pLargeBlock);
+    SetCurrentBlock((TBlock *)marker.m_pBlock);
+    if (m_pCurrent) {
+        m_pPos = marker.m_pPos;
+    }
+}
+
+void *MonotonicArena::AllocateSlow(size_t nBytes, size_t nAlign) throw()
+{
+    if (nBytes > m_nBlockSize / 4 || nAlign > m_nBlockSize / 4) {
+        return AllocateLarge(nBytes, nAlign);
+    }
+
+    //当前块不够，先复用Reset后留下的块，没有了再申请新的
+    TBlock *pNext = m_pCurrent ? m_pCurrent->m_pNext : m_pFirst;
+    if (!pNext) {
+        pNext = (TBlock *)std::malloc(sizeof(TBlock) + m_nBlockSize);
+        if (!pNext) {
+            return nullptr;
+        }
+        pNext->m_pNext = nullptr;
+        pNext->m_nSize = m_nBlockSize;
+        m_nReservedBytes += sizeof(TBlock) + m_nBlockSize;
+        if (m_pCurrent) {
+            m_pCurrent->m_pNext = pNext;
+        } else {
+            m_pFirst = pNext;
+        }
+    }
+    SetCurrentBlock(pNext);
+
+    //新块的大小至少是请求的4倍，一定能满足
+    char *p = (char *)(((uintptr_t)m_pPos + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+    m_pPos = p + nBytes;
+    return p;
+}
+
+void *MonotonicArena::AllocateLarge(size_t nBytes, size_t nAlign) throw()
+{
+    if (nBytes > (size_t)-1 - sizeof(TBlock) - nAlign) {
+        return nullptr;
+    }
+    size_t nSize = nBytes + nAlign;
+    TBlock *pBlock = (TBlock *)std::malloc(sizeof(TBlock) + nSize);
+    if (!pBlock) {
+        return nullptr;
+    }
+    pBlock->m_pNext = m_pLarge;
+    pBlock->m_nSize = nSize;
+    m_pLarge = pBlock;
+    m_nReservedBytes += sizeof(TBlock) + nSize;
+    return (void *)(((uintptr_t)pBlock->Data() + nAlign - 1) & ~(uintptr_t)(nAlign - 1));
+}
+
+void MonotonicArena::FreeLargeBlocks(TBlock *pStop) throw()
+{
+    while (m_pLarge && m_pLarge != pStop) {
+        TBlock *pNext = m_pLarge->m_pNext;
+        m_nReservedBytes -= sizeof(TBlock) + m_pLarge->m_nSize;
+        std::free(m_pLarge);
+        m_pLarge = pNext;
+    }
+}
+
+void MonotonicArena::SetCurrentBlock(TBlock *pBlock)
+{
+    m_pCurrent = pBlock;
+    if (pBlock) {
+        m_pPos = pBlock->Data();
+        m_pEnd = m_pPos + pBlock->m_nSize;
+    } else {
+        m_pPos = nullptr;
+        m_pEnd = nullptr;
+    }
+}
+
+SHARELIB_END_NAMESPACE
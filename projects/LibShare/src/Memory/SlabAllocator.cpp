@@ -0,0 +1,433 @@
+﻿#include "Memory/SlabAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+
+SHARELIB_BEGIN_NAMESPACE
+
+namespace {
+
+//每个slab的大小
+const size_t SLAB_SIZE = 64 * 1024;
+
+//16~256按16字节分级，之后每2倍分4级，到 MAX_SMALL_SIZE 共32级
+const size_t CLASS_COUNT = 32;
+
+//直接从系统堆分配的块的分级
+const uint32_t LARGE_CLASS = 0xFFFFFFFF;
+
+//头部的校验值，用于发现释放了不是本分配器分配的内存
+const uint32_t BLOCK_MAGIC = 0x534C4142;
+
+//线程与全局每次交换的字节数，换算成块数后限制在[4, 64]
+const size_t BATCH_BYTES = 16 * 1024;
+
+//块头部，紧挨在返回给调用者的地址之前，大小保证数据区的对齐与系统堆相同
+struct TBlockHeader
+{
+    uint32_t m_nClass;
+    uint32_t m_nMagic;
+
+    //只有大块使用，数据区的大小
+    uint64_t m_nSize;
+};
+static_assert(sizeof(TBlockHeader) == 16, "header size must keep alignment");
+
+//空闲块用数据区的开头链接
+struct TFreeBlock
+{
+    TFreeBlock *m_pNext;
+};
+
+//头尾都记录，整批移动不需要遍历
+struct TFreeList
+{
+    TFreeBlock *m_pHead = nullptr;
+    TFreeBlock *m_pTail = nullptr;
+    size_t m_nCount = 0;
+
+    void Push(TFreeBlock *pBlock)
+    {
+        pBlock->m_pNext = m_pHead;
+        m_pHead = pBlock;
+        if (m_nCount++ == 0) {
+            m_pTail = pBlock;
+        }
+    }
+
+    TFreeBlock *Pop()
+    {
+        TFreeBlock *pBlock = m_pHead;
+        m_pHead = pBlock->m_pNext;
+        if (--m_nCount == 0) {
+            m_pTail = nullptr;
+        }
+        return pBlock;
+    }
+};
+
+/* 线程缓存的一个分级: 当前链表满一批时整体移到备用链表，备用链表已有时先把它还给全局;
+当前链表空时先换上备用链表，都没有才从全局取一批
+*/
+struct TClassCache
+{
+    TFreeList m_list;
+    TFreeList m_spare;
+    size_t m_nBatch = 0;
+};
+
+struct TThreadCache
+{
+    TClassCache m_classes[CLASS_COUNT];
+
+    //本线程分配减去释放的块数，只有本线程写，统计时其它线程读
+    std::atomic<int64_t> m_inUse[CLASS_COUNT];
+};
+
+struct TCentralList
+{
+    std::mutex m_lock;
+
+    //空闲块按批保存，线程退出时归还的批可能不满
+    std::vector<TFreeList> m_batches;
+
+    std::atomic<size_t> m_nReserved{0};
+};
+
+struct TSlabHeap
+{
+    //各分级的大小及每批的块数
+    size_t m_classSizes[CLASS_COUNT];
+    size_t m_batchCounts[CLASS_COUNT];
+
+    TCentralList m_central[CLASS_COUNT];
+
+    //所有线程的缓存，统计时遍历
+    std::mutex m_cacheLock;
+    std::vector<TThreadCache *> m_caches;
+
+    //已退出的线程及没有缓存时的计数
+    std::atomic<int64_t> m_orphanInUse[CLASS_COUNT];
+
+    std::atomic<int64_t> m_nLargeBlocks{0};
+    std::atomic<int64_t> m_nLargeBytes{0};
+
+    TSlabHeap()
+    {
+        size_t nClass = 0;
+        for (size_t nSize = 16; nSize <= 256; nSize += 16) {
+            m_classSizes[nClass++] = nSize;
+        }
+        for (size_t nBase = 256; nBase < SlabAllocator::MAX_SMALL_SIZE; nBase *= 2) {
+            for (size_t i = 1; i <= 4; ++i) {
+                m_classSizes[nClass++] = nBase + nBase / 4 * i;
+            }
+        }
+        assert(nClass == CLASS_COUNT &&
+               m_classSizes[CLASS_COUNT - 1] == SlabAllocator::MAX_SMALL_SIZE);
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            size_t nBatch = BATCH_BYTES / m_classSizes[i];
+            m_batchCounts[i] = (std::max)((size_t)4, (std::min)((size_t)64, nBatch));
+            m_orphanInUse[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /** 从全局取一批块，没有则新建slab
+    @return 内存不足返回false
+    */
+    bool Fetch(size_t nClass, TFreeList &list)
+    {
+        TCentralList &central = m_central[nClass];
+        std::lock_guard<std::mutex> lock(central.m_lock);
+        if (central.m_batches.empty() && !NewSlab(nClass, central)) {
+            return false;
+        }
+        list = central.m_batches.back();
+        central.m_batches.pop_back();
+        return true;
+    }
+
+    //归还一批到全局
+    void Release(size_t nClass, TFreeList &list)
+    {
+        if (list.m_nCount == 0) {
+            return;
+        }
+        TCentralList &central = m_central[nClass];
+        {
+            std::lock_guard<std::mutex> lock(central.m_lock);
+            central.m_batches.push_back(list);
+        }
+        list = TFreeList{};
+    }
+
+    //已加锁，切分后按批放入
+    bool NewSlab(size_t nClass, TCentralList &central)
+    {
+        char *pSlab = static_cast<char *>(std::malloc(SLAB_SIZE));
+        if (!pSlab) {
+            return false;
+        }
+        central.m_nReserved.fetch_add(SLAB_SIZE, std::memory_order_relaxed);
+        const size_t nStride = sizeof(TBlockHeader) + m_classSizes[nClass];
+        TFreeList batch;
+        //倒序放入，分配时地址递增
+        for (size_t i = SLAB_SIZE / nStride; i-- > 0;) {
+            TBlockHeader *pHeader = reinterpret_cast<TBlockHeader *>(pSlab + i * nStride);
+            pHeader->m_nClass = (uint32_t)nClass;
+            pHeader->m_nMagic = BLOCK_MAGIC;
+            pHeader->m_nSize = 0;
+            batch.Push(reinterpret_cast<TFreeBlock *>(pHeader + 1));
+            if (batch.m_nCount == m_batchCounts[nClass] || i == 0) {
+                central.m_batches.push_back(batch);
+                batch = TFreeList{};
+            }
+        }
+        return true;
+    }
+};
+
+//不析构，线程退出及进程退出时仍可能有释放
+TSlabHeap &GetHeap()
+{
+    static TSlabHeap *s_pHeap = new TSlabHeap;
+    return *s_pHeap;
+}
+
+//分级，与 TSlabHeap::m_classSizes 对应
+inline size_t GetClassIndex(size_t nBytes)
+{
+    if (nBytes <= 256) {
+        return nBytes ? (nBytes - 1) / 16 : 0;
+    }
+    size_t nValue = nBytes - 1;
+    size_t nBit = 8;
+    while ((nValue >> (nBit + 1)) != 0) {
+        ++nBit;
+    }
+    return 16 + (nBit - 8) * 4 + (nValue >> (nBit - 2)) - 4;
+}
+
+//线程局部变量只保存指针，析构时把缓存的块还给全局
+struct TThreadHolder
+{
+    ~TThreadHolder();
+
+    TThreadCache *m_pCache = nullptr;
+};
+
+//快速路径只读这两个平凡的线程局部变量
+thread_local TThreadCache *t_pCache = nullptr;
+thread_local bool t_bExited = false;
+
+TThreadHolder::~TThreadHolder()
+{
+    if (!m_pCache) {
+        return;
+    }
+    t_pCache = nullptr;
+    t_bExited = true;
+    TSlabHeap &heap = GetHeap();
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        heap.Release(i, m_pCache->m_classes[i].m_list);
+        heap.Release(i, m_pCache->m_classes[i].m_spare);
+    }
+    {
+        std::lock_guard<std::mutex> lock(heap.m_cacheLock);
+        heap.m_caches.erase(std::find(heap.m_caches.begin(), heap.m_caches.end(), m_pCache));
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            heap.m_orphanInUse[i].fetch_add(m_pCache->m_inUse[i].load(std::memory_order_relaxed),
+                                            std::memory_order_relaxed);
+        }
+    }
+    delete m_pCache;
+    m_pCache = nullptr;
+}
+
+/** 当前线程的缓存，第一次调用时创建
+@return 线程退出过程中返回nullptr，此时直接操作全局
+*/
+TThreadCache *GetThreadCache()
+{
+    if (t_pCache) {
+        return t_pCache;
+    }
+    if (t_bExited) {
+        return nullptr;
+    }
+    static thread_local TThreadHolder s_holder;
+    if (!s_holder.m_pCache) {
+        TSlabHeap &heap = GetHeap();
+        TThreadCache *pCache = new TThreadCache;
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            pCache->m_classes[i].m_nBatch = heap.m_batchCounts[i];
+            pCache->m_inUse[i].store(0, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(heap.m_cacheLock);
+        heap.m_caches.push_back(pCache);
+        s_holder.m_pCache = pCache;
+    }
+    t_pCache = s_holder.m_pCache;
+    return t_pCache;
+}
+
+//只有本线程写，不需要原子的读改写
+inline void AddInUse(std::atomic<int64_t> &nInUse, int64_t nDelta)
+{
+    nInUse.store(nInUse.load(std::memory_order_relaxed) + nDelta, std::memory_order_relaxed);
+}
+
+void *AllocateLarge(size_t nBytes)
+{
+    if (nBytes > SIZE_MAX - sizeof(TBlockHeader)) {
+        return nullptr;
+    }
+    TBlockHeader *pHeader = static_cast<TBlockHeader *>(std::malloc(sizeof(TBlockHeader) + nBytes));
+    if (!pHeader) {
+        return nullptr;
+    }
+    pHeader->m_nClass = LARGE_CLASS;
+    pHeader->m_nMagic = BLOCK_MAGIC;
+    pHeader->m_nSize = nBytes;
+    TSlabHeap &heap = GetHeap();
+    heap.m_nLargeBlocks.fetch_add(1, std::memory_order_relaxed);
+    heap.m_nLargeBytes.fetch_add((int64_t)nBytes, std::memory_order_relaxed);
+    return pHeader + 1;
+}
+
+void FreeLarge(TBlockHeader *pHeader)
+{
+    TSlabHeap &heap = GetHeap();
+    heap.m_nLargeBlocks.fetch_sub(1, std::memory_order_relaxed);
+    heap.m_nLargeBytes.fetch_sub((int64_t)pHeader->m_nSize, std::memory_order_relaxed);
+    std::free(pHeader);
+}
+
+//本线程缓存的当前链表为空
+void *AllocateSlow(size_t nClass)
+{
+    TSlabHeap &heap = GetHeap();
+    TThreadCache *pCache = GetThreadCache();
+    if (!pCache) {
+        TFreeList list;
+        if (!heap.Fetch(nClass, list)) {
+            return nullptr;
+        }
+        TFreeBlock *pBlock = list.Pop();
+        heap.Release(nClass, list);
+        heap.m_orphanInUse[nClass].fetch_add(1, std::memory_order_relaxed);
+        return pBlock;
+    }
+
+    TClassCache &cache = pCache->m_classes[nClass];
+    if (!cache.m_list.m_pHead) {
+        if (cache.m_spare.m_pHead) {
+            std::swap(cache.m_list, cache.m_spare);
+        } else if (!heap.Fetch(nClass, cache.m_list)) {
+            return nullptr;
+        }
+    }
+    AddInUse(pCache->m_inUse[nClass], 1);
+    return cache.m_list.Pop();
+}
+
+//本线程缓存的当前链表放入后满一批
+void FreeSlow(TFreeBlock *pBlock, size_t nClass)
+{
+    TSlabHeap &heap = GetHeap();
+    TThreadCache *pCache = GetThreadCache();
+    if (!pCache) {
+        TFreeList list;
+        list.Push(pBlock);
+        heap.Release(nClass, list);
+        heap.m_orphanInUse[nClass].fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TClassCache &cache = pCache->m_classes[nClass];
+    cache.m_list.Push(pBlock);
+    AddInUse(pCache->m_inUse[nClass], -1);
+    if (cache.m_list.m_nCount >= cache.m_nBatch) {
+        heap.Release(nClass, cache.m_spare);
+        cache.m_spare = cache.m_list;
+        cache.m_list = TFreeList{};
+    }
+}
+
+} // namespace
+
+void *SlabAllocator::Allocate(size_t nBytes) throw()
+{
+    if (nBytes > MAX_SMALL_SIZE) {
+        return AllocateLarge(nBytes);
+    }
+    size_t nClass = GetClassIndex(nBytes);
+    TThreadCache *pCache = t_pCache;
+    if (pCache) {
+        TClassCache &cache = pCache->m_classes[nClass];
+        if (cache.m_list.m_pHead) {
+            AddInUse(pCache->m_inUse[nClass], 1);
+            return cache.m_list.Pop();
+        }
+    }
+    return AllocateSlow(nClass);
+}
+
+void SlabAllocator::Free(void *p) throw()
+{
+    if (!p) {
+        return;
+    }
+    TBlockHeader *pHeader = static_cast<TBlockHeader *>(p) - 1;
+    assert(pHeader->m_nMagic == BLOCK_MAGIC);
+    if (pHeader->m_nClass == LARGE_CLASS) {
+        FreeLarge(pHeader);
+        return;
+    }
+    size_t nClass = pHeader->m_nClass;
+    TFreeBlock *pBlock = static_cast<TFreeBlock *>(p);
+    TThreadCache *pCache = t_pCache;
+    if (pCache) {
+        TClassCache &cache = pCache->m_classes[nClass];
+        if (cache.m_list.m_nCount + 1 < cache.m_nBatch) {
+            cache.m_list.Push(pBlock);
+            AddInUse(pCache->m_inUse[nClass], -1);
+            return;
+        }
+    }
+    FreeSlow(pBlock, nClass);
+}
+
+void SlabAllocator::GetStats(TSlabStats &stats)
+{
+    TSlabHeap &heap = GetHeap();
+    int64_t inUse[CLASS_COUNT];
+    {
+        std::lock_guard<std::mutex> lock(heap.m_cacheLock);
+        for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            inUse[i] = heap.m_orphanInUse[i].load(std::memory_order_relaxed);
+            for (auto pCache : heap.m_caches) {
+                inUse[i] += pCache->m_inUse[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    stats.m_classes.resize(CLASS_COUNT);
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        TSlabClassStats &classStats = stats.m_classes[i];
+        //其它线程正在分配、释放时，各线程的计数不是同一时刻的，和可能暂时为负
+        classStats.m_nBlockSize = heap.m_classSizes[i];
+        classStats.m_nBlocksInUse = (size_t)(std::max)(inUse[i], (int64_t)0);
+        classStats.m_nBytesInUse = classStats.m_nBlocksInUse * classStats.m_nBlockSize;
+        classStats.m_nBytesReserved =
+            heap.m_central[i].m_nReserved.load(std::memory_order_relaxed);
+    }
+    stats.m_nLargeBlocks =
+        (size_t)(std::max)(heap.m_nLargeBlocks.load(std::memory_order_relaxed), (int64_t)0);
+    stats.m_nLargeBytes =
+        (size_t)(std::max)(heap.m_nLargeBytes.load(std::memory_order_relaxed), (int64_t)0);
+}
+
+SHARELIB_END_NAMESPACE
@@ -1,60 +1,428 @@
 ﻿#include "Memory/compress_utility.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <memory>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <brotli/decode.h>
+#include <brotli/encode.h>
 #include "zlib.h"
 
 SHARELIB_BEGIN_NAMESPACE
 
-#define CACHE_BUFFER_SIZE 8192
-
 namespace {
-bool compress_data_impl(const void *pInput,
-                        uint32_t nLength,
-                        std::vector<uint8_t> &output,
-                        int nLevel,
-                        int windowBits)
+
+//zlib的长度是uInt，超过时分段输入、输出
+const size_t MAX_CHUNK_SIZE = 1u << 30;
+
+//输出空间不够时的最小扩展大小
+const size_t MIN_GROW_SIZE = 16 * 1024;
+
+//按deflateBound预先分配的上限，数据很大时不一次占用等量的内存
+const size_t MAX_RESERVE_SIZE = 64 * 1024 * 1024;
+
+//output已用nUsed字节，保证至少还有nNeed字节可写，按倍数扩展
+void grow_output(std::vector<uint8_t> &output, size_t nUsed, size_t nNeed)
 {
-    output.clear();
-    if (!pInput || nLength == 0) {
+    if (output.size() - nUsed < nNeed) {
+        output.resize(nUsed + (std::max)((std::max)(nNeed, MIN_GROW_SIZE), nUsed));
+    }
+}
+
+} // namespace
+
+//----------------------------------------------------------------------
+
+struct Compressor::TImpl
+{
+    z_stream m_strm{};
+    bool m_bInitOK = false;
+
+    //上次Reset之后调用过deflate
+    bool m_bStarted = false;
+
+    //当前流已结束，下次输入前需要Reset
+    bool m_bEnded = false;
+
+    //deflateReset要清空哈希表，只在需要时调用
+    void Reset()
+    {
+        if (m_bInitOK && m_bStarted) {
+            ::deflateReset(&m_strm);
+        }
+        m_bStarted = false;
+        m_bEnded = false;
+    }
+
+    /** 压缩一段数据到output[nUsed, output.size())，空间不够时扩展
+    @param[in] bFinish 是否结束当前流
+    */
+    bool Deflate(const Bytef *pInput,
+                 size_t nLength,
+                 bool bFinish,
+                 std::vector<uint8_t> &output,
+                 size_t &nUsed)
+    {
+        if (m_bEnded) {
+            Reset();
+        }
+        m_bStarted = true;
+        do {
+            size_t nChunk = (std::min)(nLength, MAX_CHUNK_SIZE);
+            m_strm.next_in = const_cast<Bytef *>(pInput);
+            m_strm.avail_in = (uInt)nChunk;
+            pInput += nChunk;
+            nLength -= nChunk;
+            int flush = (bFinish && nLength == 0) ? Z_FINISH : Z_NO_FLUSH;
+
+            int err = Z_OK;
+            for (;;) {
+                if (output.size() == nUsed) {
+                    grow_output(output,
+                                nUsed,
+                                (std::min)((size_t)::deflateBound(&m_strm, m_strm.avail_in),
+                                           MAX_RESERVE_SIZE));
+                }
+                size_t nAvail = (std::min)(output.size() - nUsed, MAX_CHUNK_SIZE);
+                m_strm.next_out = output.data() + nUsed;
+                m_strm.avail_out = (uInt)nAvail;
+                err = ::deflate(&m_strm, flush);
+                nUsed += nAvail - m_strm.avail_out;
+                if (err == Z_STREAM_ERROR) {
+                    return false;
+                }
+                if (flush == Z_FINISH ? (err == Z_STREAM_END) : (m_strm.avail_in == 0)) {
+                    break;
+                }
+            }
+        } while (nLength > 0);
+        m_bEnded = bFinish;
         return true;
     }
-    z_stream strm{0};
-    int err =
-        ::deflateInit2(&strm, nLevel, Z_DEFLATED, windowBits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-    if (err != Z_OK) {
+};
+
+Compressor::Compressor(TCompressFormat format /*= TCompressFormat::ZLIB*/, int nLevel /*= 6*/)
+    : m_spImpl(std::make_unique<TImpl>())
+{
+    //MAX_WBITS + 16, gz压缩方式
+    int windowBits = (format == TCompressFormat::GZIP) ? (MAX_WBITS + 16) : MAX_WBITS;
+    m_spImpl->m_bInitOK = (::deflateInit2(&m_spImpl->m_strm,
+                                          nLevel,
+                                          Z_DEFLATED,
+                                          windowBits,
+                                          MAX_MEM_LEVEL,
+                                          Z_DEFAULT_STRATEGY) == Z_OK);
+}
+
+Compressor::~Compressor()
+{
+    if (m_spImpl->m_bInitOK) {
+        ::deflateEnd(&m_spImpl->m_strm);
+    }
+}
+
+bool Compressor::IsValid() const
+{
+    return m_spImpl->m_bInitOK;
+}
+
+bool Compressor::Push(const void *pInput,
+                      size_t nLength,
+                      std::vector<uint8_t> &output,
+                      bool bFinish /*= false*/)
+{
+    if (!m_spImpl->m_bInitOK) {
         return false;
     }
+    size_t nUsed = output.size();
+    bool bResult = m_spImpl->Deflate(
+        (const Bytef *)pInput, pInput ? nLength : 0, bFinish, output, nUsed);
+    output.resize(nUsed);
+    if (!bResult) {
+        Reset();
+    }
+    return bResult;
+}
 
-    std::unique_ptr<uint8_t[]> spBuffer(new uint8_t[CACHE_BUFFER_SIZE]{});
-    strm.avail_in = nLength;
-    strm.next_in = (Bytef *)pInput;
-    strm.avail_out = CACHE_BUFFER_SIZE;
-    strm.next_out = spBuffer.get();
+bool Compressor::Finish(std::vector<uint8_t> &output)
+{
+    return Push(nullptr, 0, output, true);
+}
 
-    int flushFlag = Z_NO_FLUSH;
+bool Compressor::Compress(const void *pInput, size_t nLength, std::vector<uint8_t> &output)
+{
+    output.clear();
+    if (!m_spImpl->m_bInitOK) {
+        return false;
+    }
+    //放弃Push输入了一部分的流
+    Reset();
+    //输出空间足够时只需调用一次deflate
+    output.resize((std::min)(Bound(nLength), MAX_RESERVE_SIZE));
+    size_t nUsed = 0;
+    bool bResult = m_spImpl->Deflate(
+        (const Bytef *)pInput, pInput ? nLength : 0, true, output, nUsed);
+    output.resize(bResult ? nUsed : 0);
+    return bResult;
+}
+
+bool Compressor::Compress(const void *pInput, size_t nLength, void *pOutput, size_t &nOutLength)
+{
+    if (!m_spImpl->m_bInitOK || !pOutput) {
+        return false;
+    }
+    Reset();
+    m_spImpl->m_bStarted = true;
+    z_stream &strm = m_spImpl->m_strm;
+    const Bytef *pIn = (const Bytef *)pInput;
+    size_t nInLeft = pInput ? nLength : 0;
+    Bytef *pOut = (Bytef *)pOutput;
+    size_t nOutLeft = nOutLength;
+    int err = Z_OK;
     do {
-        err = ::deflate(&strm, flushFlag);
-        if (err == Z_OK || (flushFlag == Z_FINISH && err == Z_BUF_ERROR)) {
-            if (strm.avail_out == 0) {
-                output.insert(output.end(), spBuffer.get(), spBuffer.get() + CACHE_BUFFER_SIZE);
-                strm.avail_out = CACHE_BUFFER_SIZE;
-                strm.next_out = spBuffer.get();
-            } else if (flushFlag == Z_NO_FLUSH && strm.avail_in == 0) {
-                flushFlag = Z_FINISH;
-            }
-        } else if (flushFlag == Z_FINISH && err == Z_STREAM_END) {
-            output.insert(
-                output.end(), spBuffer.get(), spBuffer.get() + CACHE_BUFFER_SIZE - strm.avail_out);
+        size_t nInChunk = (std::min)(nInLeft, MAX_CHUNK_SIZE);
+        size_t nOutChunk = (std::min)(nOutLeft, MAX_CHUNK_SIZE);
+        strm.next_in = const_cast<Bytef *>(pIn);
+        strm.avail_in = (uInt)nInChunk;
+        strm.next_out = pOut;
+        strm.avail_out = (uInt)nOutChunk;
+        err = ::deflate(&strm, (nInChunk == nInLeft) ? Z_FINISH : Z_NO_FLUSH);
+        pIn += nInChunk - strm.avail_in;
+        nInLeft -= nInChunk - strm.avail_in;
+        pOut += nOutChunk - strm.avail_out;
+        nOutLeft -= nOutChunk - strm.avail_out;
+        if (nOutLeft == 0 && err != Z_STREAM_END) {
+            err = Z_BUF_ERROR;
             break;
         }
     } while (err == Z_OK);
+    if (err != Z_STREAM_END) {
+        return false;
+    }
+    nOutLength -= nOutLeft;
+    return true;
+}
+
+void Compressor::Reset()
+{
+    m_spImpl->Reset();
+}
+
+size_t Compressor::Bound(size_t nLength)
+{
+    //deflateBound的参数是uLong，windows下只有32位，按分段累加
+    size_t nBound = 0;
+    do {
+        size_t nChunk = (std::min)(nLength, MAX_CHUNK_SIZE);
+        nBound += ::deflateBound(&m_spImpl->m_strm, (uLong)nChunk);
+        nLength -= nChunk;
+    } while (nLength > 0);
+    return nBound;
+}
+
+//----------------------------------------------------------------------
 
-    if (::deflateEnd(&strm) == Z_OK && err == Z_STREAM_END) {
+struct Decompressor::TImpl
+{
+    z_stream m_strm{};
+    bool m_bInitOK = false;
+
+    //最后一个流已完整结束
+    bool m_bFinished = false;
+
+    //流结束后遇到无效数据，之后的输入都忽略
+    bool m_bIgnoreRest = false;
+
+    /** 解压到外部缓冲区[pOutput, pOutput + nOutLength)
+    @param[in,out] pInput 输入，返回时指向未处理的数据
+    @param[in,out] nLength 输入长度
+    @param[out] nWritten 写入的字节数
+    @return 数据错误时返回false
+    */
+    bool Inflate(const Bytef *&pInput,
+                 size_t &nLength,
+                 Bytef *pOutput,
+                 size_t nOutLength,
+                 size_t &nWritten)
+    {
+        nWritten = 0;
+        while (!m_bIgnoreRest && nWritten < nOutLength) {
+            size_t nInChunk = (std::min)(nLength, MAX_CHUNK_SIZE);
+            size_t nOutChunk = (std::min)(nOutLength - nWritten, MAX_CHUNK_SIZE);
+            if (nInChunk == 0 && m_bFinished) {
+                break;
+            }
+            m_strm.next_in = const_cast<Bytef *>(pInput);
+            m_strm.avail_in = (uInt)nInChunk;
+            m_strm.next_out = pOutput + nWritten;
+            m_strm.avail_out = (uInt)nOutChunk;
+            int err = ::inflate(&m_strm, Z_NO_FLUSH);
+            pInput += nInChunk - m_strm.avail_in;
+            nLength -= nInChunk - m_strm.avail_in;
+            nWritten += nOutChunk - m_strm.avail_out;
+
+            if (err == Z_STREAM_END) {
+                //之后的数据可能是下一个流
+                m_bFinished = true;
+                ::inflateReset(&m_strm);
+            } else if (err == Z_OK) {
+                //下一个流有了输出才算开始，之前出错按无效数据忽略
+                if (m_strm.total_out > 0) {
+                    m_bFinished = false;
+                }
+            } else if (err == Z_BUF_ERROR) {
+                //没有输入或没有输出空间，等待下一次调用
+                break;
+            } else if (m_bFinished && m_strm.total_out == 0) {
+                //流结束后的数据不是有效的流，忽略
+                m_bIgnoreRest = true;
+                nLength = 0;
+            } else {
+                return false;
+            }
+        }
         return true;
-    } else {
+    }
+};
+
+Decompressor::Decompressor()
+    : m_spImpl(std::make_unique<TImpl>())
+{
+    //Add 32 to windowBits to enable zlib and gzip decoding with automatic header detection.
+    m_spImpl->m_bInitOK = (::inflateInit2(&m_spImpl->m_strm, MAX_WBITS + 32) == Z_OK);
+}
+
+Decompressor::~Decompressor()
+{
+    if (m_spImpl->m_bInitOK) {
+        ::inflateEnd(&m_spImpl->m_strm);
+    }
+}
+
+bool Decompressor::IsValid() const
+{
+    return m_spImpl->m_bInitOK;
+}
+
+bool Decompressor::Push(const void *pInput, size_t nLength, std::vector<uint8_t> &output)
+{
+    if (!m_spImpl->m_bInitOK) {
+        return false;
+    }
+    const Bytef *pIn = (const Bytef *)pInput;
+    size_t nInLeft = pInput ? nLength : 0;
+    size_t nUsed = output.size();
+    bool bResult = true;
+    do {
+        //压缩率未知，按输入的两倍预留；输入已用完但输出空间刚好写满时，至少扩展一次，
+        //否则没有输出空间，可能还有未输出的数据
+        size_t nReserve = (std::min)(nInLeft * 2, MAX_RESERVE_SIZE);
+        grow_output(output, nUsed, (std::max)(nReserve, (size_t)1));
+        size_t nAvail = output.size() - nUsed;
+        size_t nWritten = 0;
+        size_t nInBefore = nInLeft;
+        bResult = m_spImpl->Inflate(pIn, nInLeft, output.data() + nUsed, nAvail, nWritten);
+        nUsed += nWritten;
+        if (nWritten < nAvail) {
+            //输出空间有剩余，说明输入已处理完
+            break;
+        }
+        if (nWritten == 0 && nInLeft == nInBefore) {
+            //没有任何进展，避免死循环
+            break;
+        }
+    } while (bResult);
+    output.resize(nUsed);
+    return bResult;
+}
+
+bool Decompressor::IsFinished() const
+{
+    return m_spImpl->m_bFinished;
+}
+
+bool Decompressor::Decompress(const void *pInput, size_t nLength, std::vector<uint8_t> &output)
+{
+    output.clear();
+    Reset();
+    bool bResult = Push(pInput, nLength, output) && IsFinished();
+    if (!bResult) {
         output.clear();
+    }
+    Reset();
+    return bResult;
+}
+
+bool Decompressor::Decompress(const void *pInput,
+                              size_t nLength,
+                              void *pOutput,
+                              size_t &nOutLength)
+{
+    if (!m_spImpl->m_bInitOK || !pOutput) {
         return false;
     }
+    Reset();
+    const Bytef *pIn = (const Bytef *)pInput;
+    size_t nInLeft = pInput ? nLength : 0;
+    size_t nWritten = 0;
+    bool bResult = m_spImpl->Inflate(pIn, nInLeft, (Bytef *)pOutput, nOutLength, nWritten) &&
+                   m_spImpl->m_bFinished && (nInLeft == 0 || m_spImpl->m_bIgnoreRest);
+    Reset();
+    if (bResult) {
+        nOutLength = nWritten;
+    }
+    return bResult;
+}
+
+void Decompressor::Reset()
+{
+    if (m_spImpl->m_bInitOK) {
+        ::inflateReset(&m_spImpl->m_strm);
+    }
+    m_spImpl->m_bFinished = false;
+    m_spImpl->m_bIgnoreRest = false;
+}
+
+//----------------------------------------------------------------------
+
+namespace {
+
+//每个线程按格式和压缩级别缓存压缩对象
+Compressor *get_thread_compressor(TCompressFormat format, int nLevel)
+{
+    if (nLevel == Z_DEFAULT_COMPRESSION) {
+        nLevel = 6;
+    }
+    if (nLevel < 0 || nLevel > 9) {
+        return nullptr;
+    }
+    static thread_local std::unique_ptr<Compressor> s_compressors[2][10];
+    auto &spCompressor = s_compressors[format == TCompressFormat::GZIP ? 1 : 0][nLevel];
+    if (!spCompressor) {
+        spCompressor = std::make_unique<Compressor>(format, nLevel);
+    }
+    return spCompressor->IsValid() ? spCompressor.get() : nullptr;
+}
+
+Decompressor *get_thread_decompressor()
+{
+    static thread_local Decompressor s_decompressor;
+    return s_decompressor.IsValid() ? &s_decompressor : nullptr;
+}
+
+bool compress_data_impl(const void *pInput,
+                        uint32_t nLength,
+                        std::vector<uint8_t> &output,
+                        int nLevel,
+                        TCompressFormat format)
+{
+    output.clear();
+    if (!pInput || nLength == 0) {
+        return true;
+    }
+    Compressor *pCompressor = get_thread_compressor(format, nLevel);
+    return pCompressor && pCompressor->Compress(pInput, nLength, output);
 }
 
 bool compress_data_impl(const void *pInput,
@@ -62,7 +430,7 @@ bool compress_data_impl(const void *pInput,
                         void *pOutput,
                         uint32_t &nOutLength,
                         int nLevel,
-                        int windowBits)
+                        TCompressFormat format)
 {
     if (!pInput || nLength == 0) {
         return true;
@@ -71,25 +439,193 @@ bool compress_data_impl(const void *pInput,
     if (!pOutput || nOutLength <= 6) {
         return false;
     }
-    z_stream strm{0};
-    int err =
-        ::deflateInit2(&strm, nLevel, Z_DEFLATED, windowBits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-    if (err != Z_OK) {
+    Compressor *pCompressor = get_thread_compressor(format, nLevel);
+    size_t nOutSize = nOutLength;
+    if (!pCompressor || !pCompressor->Compress(pInput, nLength, pOutput, nOutSize)) {
         return false;
     }
+    nOutLength = (uint32_t)nOutSize;
+    return true;
+}
+
+//帧头, 见 TCompressCodec
+const uint8_t FRAME_MAGIC_0 = 0xB5;
+const uint8_t FRAME_MAGIC_1 = 0x43;
+const uint32_t FRAME_HEADER_SIZE = 8;
+
+//brotli默认的压缩级别, 速度与zlib的6级相近, 文本的压缩率高得多; 更高的级别慢很多
+const int BROTLI_DEFAULT_LEVEL = 5;
+
+void write_frame_header(uint8_t *pHeader, TCompressCodec codec, uint32_t nLength)
+{
+    pHeader[0] = FRAME_MAGIC_0;
+    pHeader[1] = FRAME_MAGIC_1;
+    pHeader[2] = (uint8_t)codec;
+    pHeader[3] = 0;
+    for (int i = 0; i < 4; ++i) {
+        pHeader[4 + i] = (uint8_t)(nLength >> (i * 8));
+    }
+}
 
-    strm.avail_in = nLength;
-    strm.next_in = (Bytef *)pInput;
-    strm.avail_out = nOutLength;
-    strm.next_out = (Bytef *)pOutput;
+/** 解析帧头
+@param[out] codec 编码
+@param[out] nLength 原数据长度
+@return 不是帧头时返回false
+*/
+bool read_frame_header(const uint8_t *pInput,
+                       uint32_t nInLength,
+                       TCompressCodec &codec,
+                       uint32_t &nLength)
+{
+    if (nInLength < FRAME_HEADER_SIZE || pInput[0] != FRAME_MAGIC_0 ||
+        pInput[1] != FRAME_MAGIC_1 || pInput[3] != 0) {
+        return false;
+    }
+    if (pInput[2] != (uint8_t)TCompressCodec::STORE &&
+        pInput[2] != (uint8_t)TCompressCodec::BROTLI) {
+        return false;
+    }
+    codec = (TCompressCodec)pInput[2];
+    nLength = 0;
+    for (int i = 0; i < 4; ++i) {
+        nLength |= (uint32_t)pInput[4 + i] << (i * 8);
+    }
+    return true;
+}
 
-    err = ::deflate(&strm, Z_FINISH);
-    if (::deflateEnd(&strm) == Z_OK && err == Z_STREAM_END) {
-        nOutLength = strm.total_out;
+using TBrotliEncoderPtr = std::unique_ptr<BrotliEncoderState, void (*)(BrotliEncoderState *)>;
+using TBrotliDecoderPtr = std::unique_ptr<BrotliDecoderState, void (*)(BrotliDecoderState *)>;
+
+int brotli_level(int nLevel)
+{
+    return nLevel < 0 ? BROTLI_DEFAULT_LEVEL : nLevel;
+}
+
+//brotli压缩, 结果写到output[nUsed, ...)
+bool brotli_encode(const uint8_t *pInput,
+                   uint32_t nLength,
+                   int nLevel,
+                   std::vector<uint8_t> &output,
+                   size_t nUsed)
+{
+    TBrotliEncoderPtr spState(::BrotliEncoderCreateInstance(nullptr, nullptr, nullptr),
+                              &::BrotliEncoderDestroyInstance);
+    if (!spState || nLevel > BROTLI_MAX_QUALITY) {
+        return false;
+    }
+    ::BrotliEncoderSetParameter(spState.get(), BROTLI_PARAM_QUALITY, (uint32_t)nLevel);
+    ::BrotliEncoderSetParameter(spState.get(), BROTLI_PARAM_SIZE_HINT, nLength);
+
+    size_t nAvailIn = nLength;
+    const uint8_t *pNextIn = pInput;
+    while (!::BrotliEncoderIsFinished(spState.get())) {
+        if (output.size() == nUsed) {
+            size_t nBound = ::BrotliEncoderMaxCompressedSize(nAvailIn);
+            grow_output(output, nUsed, (std::min)(nBound ? nBound : nAvailIn, MAX_RESERVE_SIZE));
+        }
+        size_t nAvailOut = output.size() - nUsed;
+        uint8_t *pNextOut = output.data() + nUsed;
+        if (!::BrotliEncoderCompressStream(spState.get(),
+                                           BROTLI_OPERATION_FINISH,
+                                           &nAvailIn,
+                                           &pNextIn,
+                                           &nAvailOut,
+                                           &pNextOut,
+                                           nullptr)) {
+            return false;
+        }
+        nUsed = pNextOut - output.data();
+    }
+    output.resize(nUsed);
+    return true;
+}
+
+//brotli解压, 解压后的长度必须等于nLength
+bool brotli_decode(const uint8_t *pInput,
+                   uint32_t nInLength,
+                   uint32_t nLength,
+                   std::vector<uint8_t> &output)
+{
+    TBrotliDecoderPtr spState(::BrotliDecoderCreateInstance(nullptr, nullptr, nullptr),
+                              &::BrotliDecoderDestroyInstance);
+    if (!spState) {
+        return false;
+    }
+    //帧头中的长度未经校验, 不一次按它分配
+    output.resize((std::min)((size_t)nLength, MAX_RESERVE_SIZE));
+    size_t nUsed = 0;
+    size_t nAvailIn = nInLength;
+    const uint8_t *pNextIn = pInput;
+    for (;;) {
+        size_t nAvailOut = output.size() - nUsed;
+        uint8_t *pNextOut = output.data() + nUsed;
+        BrotliDecoderResult result = ::BrotliDecoderDecompressStream(
+            spState.get(), &nAvailIn, &pNextIn, &nAvailOut, &pNextOut, nullptr);
+        nUsed = pNextOut - output.data();
+        if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+            break;
+        }
+        if (result != BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT || nUsed >= nLength) {
+            return false;
+        }
+        output.resize((std::min)((size_t)nLength, nUsed + (std::max)(nUsed, MIN_GROW_SIZE)));
+    }
+    return nUsed == nLength;
+}
+
+//解压带帧头的数据
+bool decompress_frame(const uint8_t *pInput, uint32_t nInLength, std::vector<uint8_t> &output)
+{
+    TCompressCodec codec;
+    uint32_t nLength = 0;
+    if (!read_frame_header(pInput, nInLength, codec, nLength)) {
+        return false;
+    }
+    pInput += FRAME_HEADER_SIZE;
+    nInLength -= FRAME_HEADER_SIZE;
+    if (codec == TCompressCodec::STORE) {
+        if (nInLength != nLength) {
+            return false;
+        }
+        output.assign(pInput, pInput + nLength);
         return true;
-    } else {
+    }
+    if (!brotli_decode(pInput, nInLength, nLength, output)) {
+        output.clear();
         return false;
     }
+    return true;
+}
+
+//解压带帧头的数据到外部缓冲区
+bool decompress_frame(const uint8_t *pInput,
+                      uint32_t nInLength,
+                      void *pOutput,
+                      uint32_t &nOutLength)
+{
+    TCompressCodec codec;
+    uint32_t nLength = 0;
+    if (!read_frame_header(pInput, nInLength, codec, nLength) || !pOutput ||
+        nOutLength < nLength) {
+        return false;
+    }
+    pInput += FRAME_HEADER_SIZE;
+    nInLength -= FRAME_HEADER_SIZE;
+    if (codec == TCompressCodec::STORE) {
+        if (nInLength != nLength) {
+            return false;
+        }
+        std::memcpy(pOutput, pInput, nLength);
+    } else {
+        size_t nDecoded = nLength;
+        if (::BrotliDecoderDecompress(nInLength, pInput, &nDecoded, (uint8_t *)pOutput) !=
+                BROTLI_DECODER_RESULT_SUCCESS ||
+            nDecoded != nLength) {
+            return false;
+        }
+    }
+    nOutLength = nLength;
+    return true;
 }
 
 } // namespace
@@ -99,7 +635,7 @@ bool zlib_compress_data(const void *pInput,
                         std::vector<uint8_t> &output,
                         int nLevel /* = 6*/)
 {
-    return compress_data_impl(pInput, nLength, output, nLevel, MAX_WBITS);
+    return compress_data_impl(pInput, nLength, output, nLevel, TCompressFormat::ZLIB);
 }
 
 bool zlib_compress_data(const void *pInput,
@@ -108,7 +644,7 @@ bool zlib_compress_data(const void *pInput,
                         uint32_t &nOutLength,
                         int nLevel /*= 6*/)
 {
-    return compress_data_impl(pInput, nLength, pOutput, nOutLength, nLevel, MAX_WBITS);
+    return compress_data_impl(pInput, nLength, pOutput, nOutLength, nLevel, TCompressFormat::ZLIB);
 }
 
 bool gzip_compress_data(const void *pInput,
@@ -116,8 +652,7 @@ bool gzip_compress_data(const void *pInput,
                         std::vector<uint8_t> &output,
                         int nLevel /* = 6*/)
 {
-    //MAX_WBITS + 16, gz压缩方式
-    return compress_data_impl(pInput, nLength, output, nLevel, MAX_WBITS + 16);
+    return compress_data_impl(pInput, nLength, output, nLevel, TCompressFormat::GZIP);
 }
 
 bool gzip_compress_data(const void *pInput,
@@ -126,8 +661,7 @@ bool gzip_compress_data(const void *pInput,
                         uint32_t &nOutLength,
                         int nLevel /*= 6*/)
 {
-    //MAX_WBITS + 16, gz压缩方式
-    return compress_data_impl(pInput, nLength, pOutput, nOutLength, nLevel, MAX_WBITS + 16);
+    return compress_data_impl(pInput, nLength, pOutput, nOutLength, nLevel, TCompressFormat::GZIP);
 }
 
 bool decompress_data(const void *pInput, uint32_t nLength, std::vector<uint8_t> &output)
@@ -136,65 +670,348 @@ bool decompress_data(const void *pInput, uint32_t nLength, std::vector<uint8_t>
     if (!pInput || (nLength == 0)) {
         return true;
     }
-    z_stream strm{0};
-    //Add 32 to windowBits to enable zlib and gzip decoding with automatic header detection.
-    int err = ::inflateInit2(&strm, MAX_WBITS + 32);
-    if (err != Z_OK) {
+    if (((const uint8_t *)pInput)[0] == FRAME_MAGIC_0) {
+        return decompress_frame((const uint8_t *)pInput, nLength, output);
+    }
+    Decompressor *pDecompressor = get_thread_decompressor();
+    return pDecompressor && pDecompressor->Decompress(pInput, nLength, output);
+}
+
+bool decompress_data(const void *pInput, uint32_t nLength, void *pOutput, uint32_t &nOutLength)
+{
+    if (!pInput || (nLength == 0)) {
+        return true;
+    }
+    if (((const uint8_t *)pInput)[0] == FRAME_MAGIC_0) {
+        return decompress_frame((const uint8_t *)pInput, nLength, pOutput, nOutLength);
+    }
+    assert(pOutput && nOutLength > 6);
+    if (!pOutput || nOutLength <= 6) {
         return false;
     }
-    std::unique_ptr<uint8_t[]> spBuffer(new uint8_t[CACHE_BUFFER_SIZE]{});
-    strm.avail_in = nLength;
-    strm.next_in = (Bytef *)pInput;
-    strm.avail_out = CACHE_BUFFER_SIZE;
-    strm.next_out = spBuffer.get();
-    do {
-        err = ::inflate(&strm, Z_NO_FLUSH);
-        if (err == Z_OK && strm.avail_out == 0) {
-            output.insert(output.end(), spBuffer.get(), spBuffer.get() + CACHE_BUFFER_SIZE);
-            strm.avail_out = CACHE_BUFFER_SIZE;
-            strm.next_out = spBuffer.get();
-        } else if (err == Z_STREAM_END) {
-            output.insert(
-                output.end(), spBuffer.get(), spBuffer.get() + CACHE_BUFFER_SIZE - strm.avail_out);
+    Decompressor *pDecompressor = get_thread_decompressor();
+    size_t nOutSize = nOutLength;
+    if (!pDecompressor || !pDecompressor->Decompress(pInput, nLength, pOutput, nOutSize)) {
+        return false;
+    }
+    nOutLength = (uint32_t)nOutSize;
+    return true;
+}
+
+//----------------------------------------------------------------------
+
+namespace {
+
+//deflate的窗口大小，也是每块字典的大小
+const size_t DICTIONARY_SIZE = 32 * 1024;
+
+//并行压缩的一块
+struct TParallelBlock
+{
+    std::vector<uint8_t> m_output;
+    uLong m_checksum = 0;
+};
+
+/** 压缩一块为原始deflate数据，不含头尾
+@param[in] strm 已用deflateInit2(-MAX_WBITS)初始化
+@param[in] bLast 最后一块以Z_FINISH结束，其它块以Z_SYNC_FLUSH结束，保证字节对齐可以直接拼接
+*/
+bool deflate_block(z_stream &strm,
+                   const Bytef *pInput,
+                   size_t nLength,
+                   const Bytef *pDictionary,
+                   size_t nDictionary,
+                   bool bLast,
+                   std::vector<uint8_t> &output)
+{
+    if (::deflateReset(&strm) != Z_OK) {
+        return false;
+    }
+    if (nDictionary > 0 &&
+        ::deflateSetDictionary(&strm, pDictionary, (uInt)nDictionary) != Z_OK) {
+        return false;
+    }
+
+    //同步刷新最多额外输出5字节空的存储块
+    output.resize(::deflateBound(&strm, (uLong)nLength) + 16);
+    strm.next_in = const_cast<Bytef *>(pInput);
+    strm.avail_in = (uInt)nLength;
+    strm.next_out = output.data();
+    strm.avail_out = (uInt)output.size();
+    int err = ::deflate(&strm, bLast ? Z_FINISH : Z_SYNC_FLUSH);
+    if (bLast ? (err != Z_STREAM_END) : (err != Z_OK || strm.avail_in != 0)) {
+        return false;
+    }
+    output.resize(output.size() - strm.avail_out);
+    return true;
+}
+
+//按小端或大端追加32位整数
+void append_uint32(std::vector<uint8_t> &output, uint32_t nValue, bool bLittleEndian)
+{
+    for (int i = 0; i < 4; ++i) {
+        int nShift = bLittleEndian ? (8 * i) : (24 - 8 * i);
+        output.push_back((uint8_t)(nValue >> nShift));
+    }
+}
+
+} // namespace
+
+bool parallel_compress_data(const void *pInput,
+                            size_t nLength,
+                            std::vector<uint8_t> &output,
+                            TCompressFormat format /*= TCompressFormat::GZIP*/,
+                            int nLevel /*= 6*/,
+                            unsigned int nThreads /*= 0*/,
+                            size_t nBlockSize /*= 1024 * 1024*/)
+{
+    output.clear();
+    if (!pInput || nLength == 0) {
+        return true;
+    }
+    if (nLevel == Z_DEFAULT_COMPRESSION) {
+        nLevel = 6;
+    }
+    if (nLevel < 0 || nLevel > 9) {
+        return false;
+    }
+    //块必须比字典大，也不能超过zlib的长度限制
+    nBlockSize = (std::min)((std::max)(nBlockSize, 2 * DICTIONARY_SIZE), MAX_CHUNK_SIZE);
+    if (nThreads == 0) {
+        nThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    }
+    size_t nBlocks = (nLength + nBlockSize - 1) / nBlockSize;
+    if (nBlocks < 2 || nThreads < 2) {
+        Compressor *pCompressor = get_thread_compressor(format, nLevel);
+        return pCompressor && pCompressor->Compress(pInput, nLength, output);
+    }
+
+    const Bytef *pData = (const Bytef *)pInput;
+    const bool bGzip = (format == TCompressFormat::GZIP);
+    std::vector<TParallelBlock> blocks(nBlocks);
+    std::atomic<size_t> nNextBlock{0};
+    std::atomic<bool> bFailed{false};
+    auto worker = [&]() {
+        z_stream strm{};
+        if (::deflateInit2(
+                &strm, nLevel, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            bFailed = true;
+            return;
+        }
+        for (size_t i = nNextBlock++; i < nBlocks && !bFailed; i = nNextBlock++) {
+            size_t nOffset = i * nBlockSize;
+            size_t nSize = (std::min)(nBlockSize, nLength - nOffset);
+            size_t nDictionary = (std::min)(nOffset, DICTIONARY_SIZE);
+            TParallelBlock &block = blocks[i];
+            if (!deflate_block(strm,
+                               pData + nOffset,
+                               nSize,
+                               pData + nOffset - nDictionary,
+                               nDictionary,
+                               i + 1 == nBlocks,
+                               block.m_output)) {
+                bFailed = true;
+                break;
+            }
+            block.m_checksum = bGzip ? ::crc32(0, pData + nOffset, (uInt)nSize)
+                                     : ::adler32(1, pData + nOffset, (uInt)nSize);
+        }
+        ::deflateEnd(&strm);
+    };
+
+    //当前线程也参与压缩，创建线程失败时由已有的线程完成
+    std::vector<std::thread> threads;
+    size_t nExtraThreads = (std::min)((size_t)nThreads, nBlocks) - 1;
+    for (size_t i = 0; i < nExtraThreads; ++i) {
+        try {
+            threads.emplace_back(worker);
+        } catch (const std::system_error &) {
             break;
         }
-    } while (err == Z_OK);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (bFailed) {
+        return false;
+    }
 
-    if (::inflateEnd(&strm) == Z_OK && err == Z_STREAM_END) {
-        return true;
+    //拼接: 头 + 各块 + 合并后的校验值
+    size_t nTotal = 18;
+    for (const auto &block : blocks) {
+        nTotal += block.m_output.size();
+    }
+    output.reserve(nTotal);
+    //头部的压缩级别标志与zlib一致
+    if (bGzip) {
+        uint8_t nExtraFlag = (nLevel == 9) ? 2 : ((nLevel < 2) ? 4 : 0);
+        const uint8_t header[10] = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, nExtraFlag, 0xff};
+        output.insert(output.end(), header, header + sizeof(header));
+    } else {
+        uint32_t nLevelFlag = (nLevel < 2) ? 0 : ((nLevel < 6) ? 1 : ((nLevel == 6) ? 2 : 3));
+        uint32_t nHeader = ((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (nLevelFlag << 6);
+        nHeader += 31 - nHeader % 31;
+        output.push_back((uint8_t)(nHeader >> 8));
+        output.push_back((uint8_t)nHeader);
+    }
+
+    uLong checksum = bGzip ? ::crc32(0, Z_NULL, 0) : ::adler32(0, Z_NULL, 0);
+    for (size_t i = 0; i < nBlocks; ++i) {
+        const TParallelBlock &block = blocks[i];
+        output.insert(output.end(), block.m_output.begin(), block.m_output.end());
+        z_off_t nSize = (z_off_t)(std::min)(nBlockSize, nLength - i * nBlockSize);
+        checksum = bGzip ? ::crc32_combine(checksum, block.m_checksum, nSize)
+                         : ::adler32_combine(checksum, block.m_checksum, nSize);
+    }
+    if (bGzip) {
+        append_uint32(output, (uint32_t)checksum, true);
+        append_uint32(output, (uint32_t)nLength, true);
     } else {
+        append_uint32(output, (uint32_t)checksum, false);
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------
+
+bool compress_data(const void *pInput,
+                   uint32_t nLength,
+                   std::vector<uint8_t> &output,
+                   TCompressCodec codec,
+                   int nLevel /*= -1*/)
+{
+    switch (codec) {
+    case TCompressCodec::ZLIB:
+        return zlib_compress_data(pInput, nLength, output, nLevel);
+    case TCompressCodec::GZIP:
+        return gzip_compress_data(pInput, nLength, output, nLevel);
+    case TCompressCodec::STORE:
+    case TCompressCodec::BROTLI:
+        break;
+    default:
         output.clear();
         return false;
     }
+
+    output.clear();
+    if (!pInput || nLength == 0) {
+        return true;
+    }
+    if (codec == TCompressCodec::STORE) {
+        output.resize(FRAME_HEADER_SIZE + (size_t)nLength);
+        write_frame_header(output.data(), codec, nLength);
+        std::memcpy(output.data() + FRAME_HEADER_SIZE, pInput, nLength);
+        return true;
+    }
+    output.resize(FRAME_HEADER_SIZE);
+    write_frame_header(output.data(), codec, nLength);
+    if (!brotli_encode((const uint8_t *)pInput, nLength, brotli_level(nLevel), output,
+                       FRAME_HEADER_SIZE)) {
+        output.clear();
+        return false;
+    }
+    return true;
 }
 
-bool decompress_data(const void *pInput, uint32_t nLength, void *pOutput, uint32_t &nOutLength)
+bool compress_data(const void *pInput,
+                   uint32_t nLength,
+                   void *pOutput,
+                   uint32_t &nOutLength,
+                   TCompressCodec codec,
+                   int nLevel /*= -1*/)
 {
-    if (!pInput || (nLength == 0)) {
+    switch (codec) {
+    case TCompressCodec::ZLIB:
+        return zlib_compress_data(pInput, nLength, pOutput, nOutLength, nLevel);
+    case TCompressCodec::GZIP:
+        return gzip_compress_data(pInput, nLength, pOutput, nOutLength, nLevel);
+    case TCompressCodec::STORE:
+    case TCompressCodec::BROTLI:
+        break;
+    default:
+        return false;
+    }
+
+    if (!pInput || nLength == 0) {
         return true;
     }
-    assert(pOutput && nOutLength > 6);
-    if (!pOutput || nOutLength <= 6) {
+    if (!pOutput || nOutLength < FRAME_HEADER_SIZE) {
         return false;
     }
-    z_stream strm{0};
-    //Add 32 to windowBits to enable zlib and gzip decoding with automatic header detection.
-    int err = ::inflateInit2(&strm, MAX_WBITS + 32);
-    if (err != Z_OK) {
+    uint8_t *pHeader = (uint8_t *)pOutput;
+    if (codec == TCompressCodec::STORE) {
+        if (nOutLength - FRAME_HEADER_SIZE < nLength) {
+            return false;
+        }
+        write_frame_header(pHeader, codec, nLength);
+        std::memcpy(pHeader + FRAME_HEADER_SIZE, pInput, nLength);
+        nOutLength = FRAME_HEADER_SIZE + nLength;
+        return true;
+    }
+    int nQuality = brotli_level(nLevel);
+    size_t nEncoded = nOutLength - FRAME_HEADER_SIZE;
+    if (nQuality > BROTLI_MAX_QUALITY ||
+        !::BrotliEncoderCompress(nQuality,
+                                 BROTLI_DEFAULT_WINDOW,
+                                 BROTLI_MODE_GENERIC,
+                                 nLength,
+                                 (const uint8_t *)pInput,
+                                 &nEncoded,
+                                 pHeader + FRAME_HEADER_SIZE)) {
         return false;
     }
-    strm.avail_in = nLength;
-    strm.next_in = (Bytef *)pInput;
-    strm.avail_out = nOutLength;
-    strm.next_out = (Bytef *)pOutput;
-    err = ::inflate(&strm, Z_FINISH);
+    write_frame_header(pHeader, codec, nLength);
+    nOutLength = FRAME_HEADER_SIZE + (uint32_t)nEncoded;
+    return true;
+}
 
-    if (::inflateEnd(&strm) == Z_OK && err == Z_STREAM_END) {
-        nOutLength = strm.total_out;
-        return true;
-    } else {
+uint32_t compress_bound(uint32_t nLength, TCompressCodec codec)
+{
+    uint64_t nBound = 0;
+    switch (codec) {
+    case TCompressCodec::STORE:
+        nBound = (uint64_t)FRAME_HEADER_SIZE + nLength;
+        break;
+    case TCompressCodec::ZLIB:
+    case TCompressCodec::GZIP:
+        //不需要压缩流：deflateBound对空的流返回任何压缩级别都够用的上限，包括zlib头尾的6字节;
+        //gzip头尾(不带文件名等可选字段)为18字节，多12字节
+        nBound = ::deflateBound(nullptr, (uLong)nLength);
+        if (codec == TCompressCodec::GZIP) {
+            nBound += 12;
+        }
+        break;
+    case TCompressCodec::BROTLI:
+        nBound = (uint64_t)FRAME_HEADER_SIZE + ::BrotliEncoderMaxCompressedSize(nLength);
+        break;
+    default:
+        break;
+    }
+    return nBound > UINT32_MAX ? 0 : (uint32_t)nBound;
+}
+
+bool detect_compress_codec(const void *pInput, uint32_t nLength, TCompressCodec &codec)
+{
+    const uint8_t *pData = (const uint8_t *)pInput;
+    if (!pData || nLength < 2) {
         return false;
     }
+    uint32_t nOrigin = 0;
+    if (read_frame_header(pData, nLength, codec, nOrigin)) {
+        return true;
+    }
+    if (pData[0] == 0x1f && pData[1] == 0x8b) {
+        codec = TCompressCodec::GZIP;
+        return true;
+    }
+    //CM为8(deflate), CINFO不超过7, 前两个字节是31的倍数
+    if ((pData[0] & 0x0f) == Z_DEFLATED && (pData[0] >> 4) <= 7 &&
+        ((pData[0] << 8) | pData[1]) % 31 == 0) {
+        codec = TCompressCodec::ZLIB;
+        return true;
+    }
+    return false;
 }
 
 SHARELIB_END_NAMESPACE
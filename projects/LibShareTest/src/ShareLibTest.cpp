@@ -90,7 +90,6 @@
 //#include "TestUnit/WindowTest.h"
 //#include "TestUnit/WebCurlTest.h"
 //#include "TestUnit/LuaCppTest.h"
-//#include "TestUnit/TestParallelQueue.h"
 //#include "TestUnit/OpenGLTest.h"
 //#include <openssl/ssl.h>
 using namespace ShareLibTest;
@@ -420,11 +419,6 @@ int APIENTRY _tWinMain(_In_ HINSTANCE hInstance,
         //TestLuaCpp();
     }
 
-    {
-        //TestParallelQueue{}.Test();
-        //TestParallelQueue{}.TestMsgQueue();
-    }
-
     {
         //shr::UniqueDllModule dll{ L"DllTest.dll" };
         //if (dll)
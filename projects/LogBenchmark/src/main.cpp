@@ -0,0 +1,199 @@
+﻿#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/log/attributes.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+#include "Log/BoostLog.h"
+
+/* BoostLog 的 DefaultFormater 性能测试，与原来的实现(每条日志经过time_facet格式化时间戳、
+构造boost::filesystem::path取文件名)对比，输出每条日志的格式化耗时，并检查两者的结果相同
+  --records       预先生成的日志条数，时间戳各不相同
+  --rounds        重复格式化的轮数
+  --message-size  消息的长度
+  --scope         1表示日志带有named scope，0表示没有
+示例:
+  LogBenchmark --records 10000 --rounds 50
+*/
+
+using namespace shr::log;
+
+namespace {
+
+namespace default_names = boost::log::aux::default_attribute_names;
+
+//与 InitLog 中添加的属性名相同
+const char NAMED_SCOPE_ATTR[] = "NAMED_SCOPE_ATTR";
+
+//原来的 DefaultFormater
+void LegacyFormater(const boost::log::record_view &view, boost::log::formatting_ostream &stream)
+{
+    stream << '['
+           << boost::log::extract<boost::log::attributes::local_clock::value_type>(
+                  default_names::timestamp(), view)
+           << ']';
+
+    auto &&channel = boost::log::extract<TLogChannel>(default_names::channel(), view);
+    if (channel) {
+        stream << '[' << channel.get().m_pName << ']';
+    }
+
+    stream << '['
+           << boost::log::extract<boost::log::attributes::current_thread_id::value_type>(
+                  default_names::thread_id(), view)
+           << ']';
+
+    auto &&severityValue = boost::log::extract<LogLevel>(default_names::severity(), view);
+    if (severityValue) {
+        stream << '[' << ToString(severityValue.get()) << ']';
+    }
+
+    auto &&scopeValue = boost::log::extract<boost::log::attributes::named_scope::value_type>(
+        NAMED_SCOPE_ATTR, view);
+    if (scopeValue && !scopeValue.get_ptr()->empty()) {
+        stream << '['
+               << boost::filesystem::path(scopeValue.get_ptr()->back().file_name.str())
+                      .filename()
+                      .string()
+               << '(' << scopeValue.get_ptr()->back().line << "),"
+               << scopeValue.get_ptr()->back().scope_name << ']';
+    }
+
+    stream << boost::log::extract(boost::log::expressions::smessage, view);
+}
+
+void PrintUsage()
+{
+    std::cerr << "usage: LogBenchmark [--records N] [--rounds N] [--message-size N]\n"
+                 "                    [--scope 0|1]\n";
+}
+
+std::vector<boost::log::record_view> MakeRecords(size_t nCount, size_t nMessageSize)
+{
+    global_logger_type logger;
+    TLogChannel channel = InternLogChannel("benchmark");
+    std::string message(nMessageSize, 'x');
+    std::vector<boost::log::record_view> records;
+    records.reserve(nCount);
+    for (size_t i = 0; i < nCount; ++i) {
+        auto rec = logger.open_record((boost::log::keywords::channel = channel,
+                                       boost::log::keywords::severity = LogLevel::info));
+        if (!rec) {
+            break;
+        }
+        {
+            boost::log::record_ostream stream(rec);
+            stream << message << ' ' << i;
+        }
+        records.push_back(rec.lock());
+    }
+    return records;
+}
+
+template<typename TFormater>
+double MeasureFormater(TFormater formater,
+                       const std::vector<boost::log::record_view> &records,
+                       size_t nRounds,
+                       size_t &nChecksum)
+{
+    std::string text;
+    boost::log::formatting_ostream stream(text);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t nRound = 0; nRound < nRounds; ++nRound) {
+        for (auto &rec : records) {
+            text.clear();
+            formater(rec, stream);
+            stream.flush();
+            nChecksum += text.size();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() /
+           (double)(records.size() * nRounds);
+}
+
+int RunBenchmark(size_t nRecords, size_t nRounds, size_t nMessageSize)
+{
+    std::vector<boost::log::record_view> records = MakeRecords(nRecords, nMessageSize);
+    if (records.empty()) {
+        std::cerr << "can not create log records\n";
+        return 1;
+    }
+
+    //两种实现的结果必须相同
+    std::string legacyText;
+    std::string defaultText;
+    boost::log::formatting_ostream legacyStream(legacyText);
+    boost::log::formatting_ostream defaultStream(defaultText);
+    for (auto &rec : records) {
+        legacyText.clear();
+        defaultText.clear();
+        LegacyFormater(rec, legacyStream);
+        DefaultFormater(rec, defaultStream);
+        legacyStream.flush();
+        defaultStream.flush();
+        if (legacyText != defaultText) {
+            std::cerr << "output mismatch:\n  " << legacyText << "\n  " << defaultText << '\n';
+            return 1;
+        }
+    }
+    std::cout << "sample: " << defaultText << '\n';
+
+    size_t nChecksum = 0;
+    double fLegacyNs = MeasureFormater(&LegacyFormater, records, nRounds, nChecksum);
+    double fDefaultNs = MeasureFormater(&DefaultFormater, records, nRounds, nChecksum);
+    std::cout << std::fixed << std::setprecision(1) << "records " << records.size() << " x "
+              << nRounds << " rounds, checksum " << nChecksum << '\n'
+              << "legacy   " << std::setw(8) << fLegacyNs << " ns/record\n"
+              << "default  " << std::setw(8) << fDefaultNs << " ns/record\n"
+              << "speedup  " << std::setw(8) << fLegacyNs / fDefaultNs << "x\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t nRecords = 10000;
+    size_t nRounds = 20;
+    size_t nMessageSize = 64;
+    bool bScope = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 1;
+        }
+        std::string name = argv[i];
+        std::string value = argv[++i];
+        if (name == "--records") {
+            nRecords = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--rounds") {
+            nRounds = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--message-size") {
+            nMessageSize = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--scope") {
+            bScope = (value != "0");
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (nRecords == 0 || nRounds == 0) {
+        PrintUsage();
+        return 1;
+    }
+
+    InitLog();
+
+    //named scope 的值在格式化时读取当前线程的scope，生成及格式化都要在scope内
+    if (bScope) {
+        BOOST_LOG_NAMED_SCOPE("LogBenchmark");
+        return RunBenchmark(nRecords, nRounds, nMessageSize);
+    }
+    return RunBenchmark(nRecords, nRounds, nMessageSize);
+}
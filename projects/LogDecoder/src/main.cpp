@@ -0,0 +1,43 @@
+﻿#include <fstream>
+#include <iostream>
+#include <string>
+#include "Log/BinaryLog.h"
+
+/* 把 FileLog::SetBinaryLogRaw 产生的 *_bin.log 转换成文本，输出到标准输出
+  LogDecoder 文件1 [文件2 ...]
+文件回滚后每个文件都有完整的格式串定义，可以单独转换，也可以按时间顺序一起传入，如:
+  LogDecoder app_bin_103015.log app_bin_113020.log app_bin.log > app.txt
+*/
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "usage: LogDecoder <file_bin.log> [more files in time order]\n";
+        return 1;
+    }
+
+    shr::BinaryLogDecoder decoder;
+    std::string strText;
+    char szBuff[64 * 1024];
+    int nResult = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream file{argv[i], std::ios::binary};
+        if (!file) {
+            std::cerr << "cannot open " << argv[i] << "\n";
+            nResult = 1;
+            continue;
+        }
+        while (file) {
+            file.read(szBuff, sizeof(szBuff));
+            bool bOK = decoder.Decode(szBuff, (size_t)file.gcount(), strText);
+            std::cout.write(strText.data(), (std::streamsize)strText.size());
+            strText.clear();
+            if (!bOK) {
+                std::cerr << "bad record in " << argv[i] << "\n";
+                nResult = 1;
+                break;
+            }
+        }
+    }
+    return nResult;
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "Thread/lockfree_queue.h"
+
+/*!
+ * \file QueueAdaptor.h
+ * \brief 参与对比的队列，统一为 push / try_pop 两个接口
+ */
+
+namespace QueueBenchmark {
+
+/** 测试数据，大小正好为_Size字节，开头4字节记录入队时间
+*/
+template<size_t _Size>
+struct TPayload
+{
+    //入队时间(纳秒)，只保留低32位，计算延迟时按无符号数回绕相减
+    uint32_t m_stamp;
+    char m_data[_Size - sizeof(uint32_t)];
+};
+
+template<>
+struct TPayload<sizeof(uint32_t)>
+{
+    uint32_t m_stamp;
+};
+
+//----------------------------------------------------------------------
+
+template<class T, class _Layout, class _Mode = shr::lockfree_mpmc>
+class LockfreeQueueAdaptor
+{
+public:
+    void push(const T &value) { m_queue.push(value); }
+
+    bool try_pop(T &value) { return m_queue.try_pop(value); }
+
+private:
+    //只用push/try_pop，不需要挂起等待
+    shr::lockfree_queue<T, std::allocator<T>, _Layout, shr::lockfree_nowait<_Mode>> m_queue;
+};
+
+template<class T>
+class BoostLockfreeQueueAdaptor
+{
+public:
+    void push(const T &value)
+    {
+        while (!m_queue.push(value)) {
+            ;
+        }
+    }
+
+    bool try_pop(T &value) { return m_queue.pop(value); }
+
+private:
+    //预分配的节点数，不够时push会再分配
+    boost::lockfree::queue<T> m_queue{4096};
+};
+
+template<class T>
+class BoostSpscQueueAdaptor
+{
+public:
+    void push(const T &value)
+    {
+        while (!m_queue.push(value)) {
+            ;
+        }
+    }
+
+    bool try_pop(T &value) { return m_queue.pop(value); }
+
+private:
+    //固定大小的环形缓冲区，满时push自旋
+    boost::lockfree::spsc_queue<T> m_queue{65536};
+};
+
+template<class T>
+class MutexDequeAdaptor
+{
+public:
+    void push(const T &value)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_queue.push_back(value);
+    }
+
+    bool try_pop(T &value)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_queue.empty()) {
+            return false;
+        }
+        value = m_queue.front();
+        m_queue.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex m_lock;
+    std::deque<T> m_queue;
+};
+
+} // namespace QueueBenchmark
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace QueueBenchmark {
+
+/** 单次测试的参数
+*/
+struct TBenchmarkCase
+{
+    //队列名称，见 GetQueueNames
+    std::string m_queue;
+
+    //生产者、消费者线程数
+    size_t m_nProducers = 1;
+    size_t m_nConsumers = 1;
+
+    //数据大小(字节)，4~256，必须是2的整数次幂
+    size_t m_nValueSize = 8;
+
+    //总数据个数，平均分给每个生产者
+    size_t m_nCount = 1000000;
+
+    //每次连续写入的个数，0表示不间断写入
+    size_t m_nBurst = 0;
+
+    //两次连续写入之间的间隔(微秒)
+    size_t m_nBurstGapUs = 0;
+};
+
+/** 单次测试的结果
+*/
+struct TBenchmarkResult
+{
+    TBenchmarkCase m_case;
+
+    //实际传递的数据个数
+    size_t m_nCount = 0;
+
+    //耗时(秒)
+    double m_seconds = 0;
+
+    //吞吐量(百万次/秒)
+    double m_mops = 0;
+
+    //入队到出队的延迟(纳秒)
+    uint64_t m_p50 = 0;
+    uint64_t m_p99 = 0;
+    uint64_t m_p999 = 0;
+    uint64_t m_max = 0;
+};
+
+/** 支持的队列名称
+*/
+const std::vector<std::string> &GetQueueNames();
+
+/** 队列是否支持参数中的线程数，单写、单读的队列只能用于对应的线程组合
+*/
+bool IsSupportedCase(const TBenchmarkCase &param);
+
+/** 执行一次测试
+@param[in] param 测试参数
+@param[out] result 测试结果
+@return 参数无效时返回false
+*/
+bool RunBenchmark(const TBenchmarkCase &param, TBenchmarkResult &result);
+
+/** 输出一行便于阅读的结果
+*/
+void WriteTableHeader(std::ostream &os);
+void WriteTableRow(std::ostream &os, const TBenchmarkResult &result);
+
+/** 以JSON数组的形式输出全部结果
+*/
+void WriteJson(std::ostream &os, const std::vector<TBenchmarkResult> &results);
+
+} // namespace QueueBenchmark
@@ -0,0 +1,245 @@
+﻿#include "QueueBenchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include "QueueAdaptor.h"
+
+namespace QueueBenchmark {
+
+namespace {
+
+using TClock = std::chrono::steady_clock;
+
+//相对于测试开始时间的纳秒数，只保留低32位
+inline uint32_t GetStamp(TClock::time_point startTime)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() -
+                                                                          startTime)
+        .count();
+}
+
+//忙等到指定时间，sleep的精度不够
+void SpinUntil(TClock::time_point endTime)
+{
+    while (TClock::now() < endTime) {
+        std::this_thread::yield();
+    }
+}
+
+/** 取百分位数
+@param[in,out] latencies 延迟数据，会被部分排序
+@param[in] percent 百分比
+*/
+uint64_t GetPercentile(std::vector<uint32_t> &latencies, double percent)
+{
+    if (latencies.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(percent / 100 * (latencies.size() - 1));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies[index];
+}
+
+template<class TQueue, class TValue>
+void RunQueue(const TBenchmarkCase &param, TBenchmarkResult &result)
+{
+    auto spQueue = std::make_unique<TQueue>();
+    TQueue &queue = *spQueue;
+    size_t nPerProducer = param.m_nCount / param.m_nProducers;
+    std::atomic<bool> bStart{false};
+    std::atomic<size_t> nRunningProducers{param.m_nProducers};
+    std::vector<std::vector<uint32_t>> latencies(param.m_nConsumers);
+    TClock::time_point startTime;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < param.m_nProducers; ++i) {
+        threads.emplace_back([&]() {
+            while (!bStart.load()) {
+                std::this_thread::yield();
+            }
+            TValue value{};
+            size_t nInBurst = 0;
+            for (size_t k = 0; k < nPerProducer; ++k) {
+                value.m_stamp = GetStamp(startTime);
+                queue.push(value);
+                if (param.m_nBurst != 0 && ++nInBurst == param.m_nBurst) {
+                    nInBurst = 0;
+                    SpinUntil(TClock::now() + std::chrono::microseconds(param.m_nBurstGapUs));
+                }
+            }
+            --nRunningProducers;
+        });
+    }
+    for (size_t i = 0; i < param.m_nConsumers; ++i) {
+        auto &curLatencies = latencies[i];
+        curLatencies.reserve(param.m_nCount / param.m_nConsumers * 2);
+        threads.emplace_back([&]() {
+            while (!bStart.load()) {
+                std::this_thread::yield();
+            }
+            TValue value{};
+            for (;;) {
+                if (queue.try_pop(value)) {
+                    curLatencies.push_back(GetStamp(startTime) - value.m_stamp);
+                } else if (nRunningProducers.load() == 0) {
+                    //生产者都已退出，再确认一次队列为空
+                    if (!queue.try_pop(value)) {
+                        break;
+                    }
+                    curLatencies.push_back(GetStamp(startTime) - value.m_stamp);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    startTime = TClock::now();
+    bStart.store(true);
+    for (auto &item : threads) {
+        item.join();
+    }
+    std::chrono::duration<double> elapsed = TClock::now() - startTime;
+
+    std::vector<uint32_t> allLatencies;
+    for (auto &item : latencies) {
+        allLatencies.insert(allLatencies.end(), item.begin(), item.end());
+        item = std::vector<uint32_t>{};
+    }
+    result.m_nCount = allLatencies.size();
+    result.m_seconds = elapsed.count();
+    result.m_mops = result.m_nCount / result.m_seconds / 1e6;
+    result.m_p50 = GetPercentile(allLatencies, 50);
+    result.m_p99 = GetPercentile(allLatencies, 99);
+    result.m_p999 = GetPercentile(allLatencies, 99.9);
+    result.m_max =
+        allLatencies.empty() ? 0 : *std::max_element(allLatencies.begin(), allLatencies.end());
+}
+
+template<size_t _Size>
+bool RunSize(const TBenchmarkCase &param, TBenchmarkResult &result)
+{
+    using TValue = TPayload<_Size>;
+    static_assert(sizeof(TValue) == _Size, "payload size mismatch");
+    if (param.m_queue == "lockfree") {
+        RunQueue<LockfreeQueueAdaptor<TValue, shr::lockfree_compact_layout>, TValue>(param,
+                                                                                       result);
+    } else if (param.m_queue == "lockfree_padded") {
+        RunQueue<LockfreeQueueAdaptor<TValue, shr::lockfree_padded_layout>, TValue>(param,
+                                                                                      result);
+    } else if (param.m_queue == "lockfree_padded128") {
+        RunQueue<LockfreeQueueAdaptor<TValue, shr::lockfree_queue_layout<128, true>>, TValue>(
+            param, result);
+    } else if (param.m_queue == "lockfree_mpsc") {
+        RunQueue<LockfreeQueueAdaptor<TValue, shr::lockfree_compact_layout, shr::lockfree_mpsc>,
+                 TValue>(param, result);
+    } else if (param.m_queue == "lockfree_spsc") {
+        RunQueue<LockfreeQueueAdaptor<TValue, shr::lockfree_compact_layout, shr::lockfree_spsc>,
+                 TValue>(param, result);
+    } else if (param.m_queue == "boost") {
+        RunQueue<BoostLockfreeQueueAdaptor<TValue>, TValue>(param, result);
+    } else if (param.m_queue == "boost_spsc") {
+        RunQueue<BoostSpscQueueAdaptor<TValue>, TValue>(param, result);
+    } else if (param.m_queue == "mutex") {
+        RunQueue<MutexDequeAdaptor<TValue>, TValue>(param, result);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+const std::vector<std::string> &GetQueueNames()
+{
+    static const std::vector<std::string> s_names{"lockfree",
+                                                  "lockfree_padded",
+                                                  "lockfree_padded128",
+                                                  "lockfree_mpsc",
+                                                  "lockfree_spsc",
+                                                  "boost",
+                                                  "boost_spsc",
+                                                  "mutex"};
+    return s_names;
+}
+
+bool IsSupportedCase(const TBenchmarkCase &param)
+{
+    if (param.m_queue == "lockfree_spsc" || param.m_queue == "boost_spsc") {
+        return param.m_nProducers == 1 && param.m_nConsumers == 1;
+    }
+    if (param.m_queue == "lockfree_mpsc") {
+        return param.m_nConsumers == 1;
+    }
+    return true;
+}
+
+bool RunBenchmark(const TBenchmarkCase &param, TBenchmarkResult &result)
+{
+    result = TBenchmarkResult{};
+    result.m_case = param;
+    if (param.m_nProducers == 0 || param.m_nConsumers == 0 || param.m_nCount == 0 ||
+        !IsSupportedCase(param)) {
+        return false;
+    }
+    switch (param.m_nValueSize) {
+    case 4:
+        return RunSize<4>(param, result);
+    case 8:
+        return RunSize<8>(param, result);
+    case 16:
+        return RunSize<16>(param, result);
+    case 32:
+        return RunSize<32>(param, result);
+    case 64:
+        return RunSize<64>(param, result);
+    case 128:
+        return RunSize<128>(param, result);
+    case 256:
+        return RunSize<256>(param, result);
+    default:
+        return false;
+    }
+}
+
+void WriteTableHeader(std::ostream &os)
+{
+    os << std::left << std::setw(20) << "queue" << std::right << std::setw(6) << "P:C"
+       << std::setw(6) << "size" << std::setw(7) << "burst" << std::setw(10) << "Mops/s"
+       << std::setw(10) << "p50(ns)" << std::setw(10) << "p99(ns)" << std::setw(11)
+       << "p999(ns)" << '\n';
+}
+
+void WriteTableRow(std::ostream &os, const TBenchmarkResult &result)
+{
+    const TBenchmarkCase &param = result.m_case;
+    os << std::left << std::setw(20) << param.m_queue << std::right << std::setw(6)
+       << (std::to_string(param.m_nProducers) + ":" + std::to_string(param.m_nConsumers))
+       << std::setw(6) << param.m_nValueSize << std::setw(7) << param.m_nBurst << std::setw(10)
+       << std::fixed << std::setprecision(2) << result.m_mops << std::setw(10) << result.m_p50
+       << std::setw(10) << result.m_p99 << std::setw(11) << result.m_p999 << '\n';
+}
+
+void WriteJson(std::ostream &os, const std::vector<TBenchmarkResult> &results)
+{
+    os << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const TBenchmarkResult &result = results[i];
+        const TBenchmarkCase &param = result.m_case;
+        os << "  {\"queue\": \"" << param.m_queue << "\", \"producers\": " << param.m_nProducers
+           << ", \"consumers\": " << param.m_nConsumers
+           << ", \"value_size\": " << param.m_nValueSize << ", \"burst\": " << param.m_nBurst
+           << ", \"burst_gap_us\": " << param.m_nBurstGapUs << ", \"count\": " << result.m_nCount
+           << ", \"seconds\": " << std::setprecision(6) << result.m_seconds
+           << ", \"mops\": " << std::setprecision(3) << result.m_mops
+           << ", \"latency_ns\": {\"p50\": " << result.m_p50 << ", \"p99\": " << result.m_p99
+           << ", \"p999\": " << result.m_p999 << ", \"max\": " << result.m_max << "}}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
+
+} // namespace QueueBenchmark
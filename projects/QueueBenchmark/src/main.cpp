@@ -0,0 +1,153 @@
+﻿#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "QueueBenchmark.h"
+
+/* lockfree_queue 性能测试，与 boost::lockfree::queue、mutex+deque 对比
+参数组合成矩阵依次执行，每个参数都可以用逗号分隔多个值:
+  --queues     lockfree,lockfree_padded,lockfree_padded128,lockfree_mpsc,lockfree_spsc,
+               boost,boost_spsc,mutex
+               单写、单读的队列自动跳过不支持的线程组合
+  --threads    生产者:消费者，如 1:1,4:4,8:1
+  --sizes      数据大小，4,8,16,32,64,128,256，覆盖 lockfree_queue 每页数据个数的所有分支
+  --bursts     每次连续写入的个数，0表示不间断
+  --gap        两次连续写入之间的间隔(微秒)
+  --count      每次测试的总数据个数
+  --json       结果以JSON格式写入文件，"-"表示标准输出(此时表格输出到标准错误)
+示例，缓存行填充在1~32对线程下的对比:
+  QueueBenchmark --queues lockfree,lockfree_padded --threads 1:1,2:2,4:4,8:8,16:16,32:32
+单写单读、多写单读的对比:
+  QueueBenchmark --queues lockfree,lockfree_mpsc,lockfree_spsc,boost_spsc --threads 1:1,4:1
+*/
+
+using namespace QueueBenchmark;
+
+namespace {
+
+std::vector<std::string> SplitList(const std::string &value)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<size_t> SplitNumbers(const std::string &value)
+{
+    std::vector<size_t> numbers;
+    for (auto &item : SplitList(value)) {
+        numbers.push_back(std::strtoull(item.c_str(), nullptr, 10));
+    }
+    return numbers;
+}
+
+void PrintUsage()
+{
+    std::cerr << "usage: QueueBenchmark [--queues q1,q2] [--threads P:C,...] [--sizes 4,...,256]\n"
+                 "                      [--bursts N,...] [--gap us] [--count N] [--json file|-]\n"
+                 "queues:";
+    for (auto &item : GetQueueNames()) {
+        std::cerr << ' ' << item;
+    }
+    std::cerr << '\n';
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> queues = GetQueueNames();
+    std::vector<std::pair<size_t, size_t>> threads{{1, 1}, {2, 2}, {4, 4}, {8, 8}};
+    std::vector<size_t> sizes{4, 8, 16, 32, 64, 128, 256};
+    std::vector<size_t> bursts{0};
+    size_t nBurstGapUs = 0;
+    size_t nCount = 1000000;
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 1;
+        }
+        std::string name = argv[i];
+        std::string value = argv[++i];
+        if (name == "--queues") {
+            queues = SplitList(value);
+        } else if (name == "--threads") {
+            threads.clear();
+            for (auto &item : SplitList(value)) {
+                auto pos = item.find(':');
+                size_t nProducers = std::strtoull(item.c_str(), nullptr, 10);
+                size_t nConsumers =
+                    (pos == std::string::npos ? nProducers
+                                              : std::strtoull(item.c_str() + pos + 1, nullptr, 10));
+                threads.emplace_back(nProducers, nConsumers);
+            }
+        } else if (name == "--sizes") {
+            sizes = SplitNumbers(value);
+        } else if (name == "--bursts") {
+            bursts = SplitNumbers(value);
+        } else if (name == "--gap") {
+            nBurstGapUs = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--count") {
+            nCount = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--json") {
+            jsonPath = value;
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    std::ostream &table = (jsonPath == "-" ? std::cerr : std::cout);
+    WriteTableHeader(table);
+    std::vector<TBenchmarkResult> results;
+    for (auto nSize : sizes) {
+        for (auto nBurst : bursts) {
+            for (auto &ratio : threads) {
+                for (auto &queue : queues) {
+                    TBenchmarkCase param;
+                    param.m_queue = queue;
+                    param.m_nProducers = ratio.first;
+                    param.m_nConsumers = ratio.second;
+                    param.m_nValueSize = nSize;
+                    param.m_nCount = nCount;
+                    param.m_nBurst = nBurst;
+                    param.m_nBurstGapUs = nBurstGapUs;
+                    if (!IsSupportedCase(param)) {
+                        continue;
+                    }
+                    TBenchmarkResult result;
+                    if (!RunBenchmark(param, result)) {
+                        std::cerr << "invalid case: " << queue << ' ' << ratio.first << ':'
+                                  << ratio.second << " size " << nSize << '\n';
+                        return 1;
+                    }
+                    WriteTableRow(table, result);
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if (jsonPath == "-") {
+        WriteJson(std::cout, results);
+    } else if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath);
+        if (!file) {
+            std::cerr << "can not open " << jsonPath << '\n';
+            return 1;
+        }
+        WriteJson(file, results);
+    }
+    return 0;
+}